@@ -16,6 +16,12 @@ typedef enum metric {
     METRIC_DP_INTERRUPT,
     METRIC_SP_INTERRUPT,
     METRIC_BLOCK_SYSCONFIG_MISS,
+    METRIC_BLOCK_PERSISTENT_CACHE_HIT,
+    METRIC_BLOCK_INVALIDATION,
+    METRIC_BLOCK_REVALIDATION,
+    METRIC_SUPERBLOCK_COMPILATION,
+    METRIC_BLOCK_BOUND_LINK,
+    METRIC_RSP_HLE_TASK,
     NUM_METRICS
 } metric_t;
 
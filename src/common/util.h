@@ -35,6 +35,12 @@ typedef __m128i s128;
 #define unlikely(exp) __builtin_expect(exp, 0)
 #define likely(exp) __builtin_expect(exp, 1)
 
+#ifdef __cplusplus
+#define N64_THREAD_LOCAL thread_local
+#else
+#define N64_THREAD_LOCAL _Thread_local
+#endif
+
 #define N64_APP_NAME "dgb n64"
 
 #ifdef N64_WIN
@@ -2,10 +2,18 @@
 
 #include <mem/n64bus.h>
 #include <dynasm/dasm_proto.h>
+#include <stdlib.h>
 #include <metrics.h>
+#include <perf_map_file.h>
+#include <disassemble.h>
 #include "dynarec_memory_management.h"
+#include "dynarec_profiler.h"
 #include "v1/v1_compiler.h"
 #include "v2/v2_compiler.h"
+#include "v2/instruction_category.h"
+#include "v2/v2_compile_thread.h"
+#include "v2/v2_persistent_cache.h"
+#include <system/scheduler.h>
 
 // Uncomment to try to find idle loops
 //#define DO_REPEATED_EXEC_DETECTION
@@ -17,53 +25,364 @@ void update_sysconfig() {
     //n64dynarec.sysconfig.fr = N64CP0.status.fr;
 }
 
+INLINE u8* link_jump_end(n64_dynarec_link_t* link) {
+    return (u8*)link + link->jump_end_offset;
+}
+
+INLINE void patch_link(n64_dynarec_link_t* link, u8* target) {
+    s32 rel = (s32)(target - link_jump_end(link));
+    memcpy(link_jump_end(link) - sizeof(s32), &rel, sizeof(s32));
+}
+
+INLINE u8* link_target(n64_dynarec_link_t* link) {
+    s32 rel;
+    memcpy(&rel, link_jump_end(link) - sizeof(s32), sizeof(s32));
+    return link_jump_end(link) + rel;
+}
+
+INLINE void undo_link(n64_dynarec_link_t* link) {
+    // Jump to the instruction right after the jmp, which returns to the dispatcher
+    patch_link(link, link_jump_end(link));
+    link->linked = false;
+    if (link->mapped) {
+        n64dynarec.num_mapped_links--;
+    }
+}
+
+void unlink_dynarec_page(u32 outer_index) {
+    n64_dynarec_link_t* link = n64dynarec.page_links[outer_index];
+    while (link != NULL) {
+        undo_link(link);
+        link = link->next;
+    }
+    n64dynarec.page_links[outer_index] = NULL;
+}
+
+// Undo only the links that jump into this block's code
+static void unlink_dynarec_block(n64_dynarec_block_t* block) {
+    u32 outer_index = BLOCKCACHE_OUTER_INDEX(block->physical_address);
+    if (outer_index >= BLOCKCACHE_RDRAM_PAGES || block->link_entry == NULL) {
+        return;
+    }
+
+    n64_dynarec_link_t** prev_next = &n64dynarec.page_links[outer_index];
+    n64_dynarec_link_t* link = n64dynarec.page_links[outer_index];
+    while (link != NULL) {
+        u8* target = link_target(link);
+        if (target == block->link_entry || (block->bound_link_entry != NULL && target == block->bound_link_entry)) {
+            undo_link(link);
+            *prev_next = link->next;
+        } else {
+            prev_next = &link->next;
+        }
+        link = link->next;
+    }
+}
+
+void unlink_mapped_dynarec_blocks() {
+    if (n64dynarec.num_mapped_links == 0) {
+        return;
+    }
+
+    for (int i = 0; i < BLOCKCACHE_RDRAM_PAGES; i++) {
+        n64_dynarec_link_t** prev_next = &n64dynarec.page_links[i];
+        n64_dynarec_link_t* link = n64dynarec.page_links[i];
+        while (link != NULL) {
+            if (link->mapped) {
+                undo_link(link);
+                *prev_next = link->next;
+            } else {
+                prev_next = &link->next;
+            }
+            link = link->next;
+        }
+    }
+}
+
+// Links stored in code that's about to be overwritten
+void forget_dynarec_links_in_range(u8* start, u8* end) {
+    for (int i = 0; i < BLOCKCACHE_RDRAM_PAGES; i++) {
+        n64_dynarec_link_t** prev_next = &n64dynarec.page_links[i];
+        n64_dynarec_link_t* link = n64dynarec.page_links[i];
+        while (link != NULL) {
+            if ((u8*)link >= start && (u8*)link < end) {
+                if (link->mapped) {
+                    n64dynarec.num_mapped_links--;
+                }
+                *prev_next = link->next;
+            } else {
+                prev_next = &link->next;
+            }
+            link = link->next;
+        }
+    }
+
+    if ((u8*)n64dynarec.exit_link >= start && (u8*)n64dynarec.exit_link < end) {
+        n64dynarec.exit_link = NULL;
+    }
+}
+
+INLINE bool is_unmapped_address(u64 virtual_address) {
+    // KSEG0 and KSEG1, sign extended
+    return (virtual_address >> 32) == 0xFFFFFFFF && (((virtual_address >> 29) & 0b110) == 0b100);
+}
+
+// Patch the exit the last block left through to jump straight into the block it went to
+INLINE void link_block(n64_dynarec_link_t* link, n64_dynarec_block_t* block, u32 physical_address) {
+    if (link->linked || link->target_virtual_address != N64CPU.pc) {
+        return;
+    }
+    if (block->link_entry == NULL || physical_address >= N64_RDRAM_SIZE || block->sysconfig.raw != link->sysconfig.raw) {
+        return;
+    }
+
+    link->mapped = !is_unmapped_address(link->target_virtual_address);
+    if (link->mapped) {
+        n64dynarec.num_mapped_links++;
+    }
+
+    // Skip loading the guest registers the source block already left where this one wants them
+    if (block->bound_link_entry != NULL && register_bindings_compatible(link->exit_bindings, block->entry_bindings)) {
+        patch_link(link, block->bound_link_entry);
+        mark_metric(METRIC_BLOCK_BOUND_LINK);
+    } else {
+        patch_link(link, block->link_entry);
+    }
+    link->linked = true;
+
+    u32 outer_index = BLOCKCACHE_OUTER_INDEX(physical_address);
+    link->next = n64dynarec.page_links[outer_index];
+    n64dynarec.page_links[outer_index] = link;
+}
+
+INLINE u32 hash_block_guest_code(u32 physical_address, size_t guest_size) {
+    u32 hash = 2166136261; // FNV-1a, a word at a time
+    for (u32 i = 0; i < guest_size; i += 4) {
+        hash ^= n64_read_physical_word(physical_address + i);
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+void invalidate_dynarec_range(u32 physical_address, u32 length) {
+    if (length == 0) {
+        return;
+    }
+    u32 end = physical_address + length;
+    for (u32 outer_index = BLOCKCACHE_OUTER_INDEX(physical_address); outer_index <= BLOCKCACHE_OUTER_INDEX(end - 1); outer_index++) {
+        n64_dynarec_page_t* page = get_dynarec_page(outer_index);
+        if (page == NULL) {
+            continue;
+        }
+
+        bool invalidated = false;
+        for (int i = 0; i < page->num_blocks; i++) {
+            for (n64_dynarec_block_t* block = &page->blocks[i]; block != NULL && block->run != NULL; block = block->next) {
+                // Idle loop replacements have no host code, but still cover the instructions they replace
+                if (!block->dirty && block->guest_start < end && block->guest_start + block->guest_size > physical_address) {
+                    block->dirty = true;
+                    invalidated = true;
+                    mark_metric(METRIC_BLOCK_INVALIDATION);
+                    if (unlikely(dynarec_profiler_enabled())) {
+                        dynarec_profiler_record_invalidation(block);
+                    }
+                }
+            }
+        }
+
+        // Linked exits would jump straight into dirty blocks without checking them
+        if (invalidated && outer_index < BLOCKCACHE_RDRAM_PAGES && n64dynarec.page_links[outer_index] != NULL) {
+            unlink_dynarec_page(outer_index);
+        }
+    }
+}
+
+// A block whose guest code was written to can keep being used if the code it was compiled from is still there,
+// e.g. when an overlay is loaded again
+INLINE bool revalidate_block(n64_dynarec_block_t* block) {
+    if (hash_block_guest_code(block->guest_start, block->guest_size) != block->guest_hash) {
+        return false;
+    }
+    block->dirty = false;
+    mark_metric(METRIC_BLOCK_REVALIDATION);
+    return true;
+}
+
+// Regular blocks that end in a branch with a constant target are profiled, so they can become superblocks
+INLINE void start_block_profile(n64_dynarec_block_t* block) {
+    block->branch_target = 0;
+    block->profile_entries = 0;
+    block->profile_taken = 0;
+    block->superblock = false;
+
+    if (!v2_superblocks_enabled() || block->host_size == 0 || block->guest_size < 8) {
+        return;
+    }
+    u32 branch_offset = block->guest_size - 8; // the delay slot comes last
+    mips_instruction_t instr;
+    instr.raw = n64_read_physical_word(block->physical_address + branch_offset);
+    u64 target;
+    if (is_branch(instr_category(instr)) && v2_branch_target(instr, block->virtual_address + branch_offset, &target)) {
+        block->branch_target = target;
+    }
+}
+
+dynarec_branch_bias_t dynarec_branch_bias(u64 virtual_address, u32 physical_address, n64_block_sysconfig_t sysconfig) {
+    n64_dynarec_block_t* block = get_dynarec_block(physical_address);
+    while (block != NULL && block->run != NULL) {
+        if (block->sysconfig.raw == sysconfig.raw && block->virtual_address == virtual_address) {
+            return block->dirty ? BRANCH_BIAS_UNKNOWN : get_block_branch_bias(block);
+        }
+        block = block->next;
+    }
+    return BRANCH_BIAS_UNKNOWN;
+}
+
+INLINE n64_dynarec_block_t* block_at_address(n64_block_sysconfig_t current_sysconfig, u64 virtual_address, u32 physical_address);
+
+// Allocating the code for a block can reclaim a code region, which invalidates every page that had code there, maybe
+// including the one the block was just compiled into. If so, the block and its code marks go in the new page instead.
+static n64_dynarec_block_t* rehome_compiled_block(n64_dynarec_block_t* block, n64_dynarec_page_t* page, u32 physical_address) {
+    u32 outer_index = BLOCKCACHE_OUTER_INDEX(physical_address);
+    if (likely(get_dynarec_page(outer_index) == page)) {
+        return block;
+    }
+
+    n64_dynarec_block_t* new_block = block_at_address(block->sysconfig, block->virtual_address, physical_address);
+    copy_dynarec_block(new_block, block);
+    n64_dynarec_page_t* new_page = get_dynarec_page(outer_index);
+    for (u32 address = block->guest_start; address < block->guest_start + block->guest_size; address += 4) {
+        mark_code(new_page, address);
+    }
+    return new_block;
+}
+
+// Compile a block that's done being profiled again, following its branches the way they usually go
+static void promote_to_superblock(n64_dynarec_block_t* block, u32 physical_address) {
+    u32 outer_index = BLOCKCACHE_OUTER_INDEX(physical_address);
+    n64_dynarec_page_t* page = get_dynarec_page(outer_index);
+    // Written to while it ran, or thrown out to make room
+    if (block->dirty || page == NULL) {
+        return;
+    }
+
+    block->branch_target = 0; // done profiling either way
+    if (get_block_branch_bias(block) == BRANCH_BIAS_UNKNOWN) {
+        return;
+    }
+
+    // The old code stays in the code cache until its region is reclaimed, but nothing should jump to it anymore
+    if (outer_index < BLOCKCACHE_RDRAM_PAGES && n64dynarec.page_links[outer_index] != NULL) {
+        unlink_dynarec_page(outer_index);
+    }
+    u64 compile_start = dynarec_profiler_enabled() ? dynarec_profiler_ticks() : 0;
+    if (v2_compile_superblock(block, page, block->virtual_address, physical_address)) {
+        block = rehome_compiled_block(block, page, physical_address);
+        block->superblock = true;
+        block->guest_hash = hash_block_guest_code(block->guest_start, block->guest_size);
+        mark_metric(METRIC_SUPERBLOCK_COMPILATION);
+        if (unlikely(dynarec_profiler_enabled())) {
+            dynarec_profiler_record_compile(block, compile_start);
+        }
+    }
+}
+
+// Run a block that's being profiled, and count where it went
+INLINE int run_profiled_block(n64_dynarec_block_t* block, u32 physical_address) {
+    // Leave through the dispatcher, without following links, so the pc is where this block went
+    N64CPU.block_link_limit = 0;
+    int taken = n64dynarec.run_block((u64)block->run);
+
+    block->profile_entries++;
+    if (N64CPU.pc == block->branch_target) {
+        block->profile_taken++;
+    }
+    if (block->profile_entries == N64_DYNAREC_PROFILE_ENTRIES) {
+        promote_to_superblock(block, physical_address);
+    }
+    return taken;
+}
+
 int missing_block_handler(u32 physical_address, n64_dynarec_block_t* block, n64_block_sysconfig_t current_sysconfig) {
     u32 outer_index = physical_address >> BLOCKCACHE_OUTER_SHIFT;
 
     block->run = NULL;
+    block->link_entry = NULL;
+    block->bound_link_entry = NULL;
+    block->entry_bindings = REGISTER_BINDINGS_NONE;
     block->host_size = 0;
     block->guest_size = 0;
-    block->next = NULL;
     block->sysconfig = current_sysconfig;
     block->virtual_address = N64CPU.pc;
+    block->physical_address = physical_address;
+    block->guest_start = physical_address;
+    block->dirty = false;
 
-    bool* code_mask = n64dynarec.code_mask[outer_index];
+    n64_dynarec_page_t* page = get_dynarec_page(outer_index);
 
 #ifdef N64_LOG_COMPILATIONS
     printf("Compilin' new block at 0x%08" PRIX64 " / 0x%08" PRIX32 "\n", N64CPU.pc, physical_address);
 #endif
 
     mark_metric(METRIC_BLOCK_COMPILATION);
-    v2_compile_new_block(block, code_mask, N64CPU.pc, physical_address);
+    u64 compile_start = dynarec_profiler_enabled() ? dynarec_profiler_ticks() : 0;
+    v2_compile_new_block(block, page, N64CPU.pc, physical_address);
     if (block->run == NULL) {
         logfatal("Failed to compile block!");
-        //v1_compile_new_block(block, code_mask, N64CPU.pc, physical);
+        //v1_compile_new_block(block, page, N64CPU.pc, physical);
+    }
+    block = rehome_compiled_block(block, page, physical_address);
+    block->guest_hash = hash_block_guest_code(block->guest_start, block->guest_size);
+    start_block_profile(block);
+    if (unlikely(dynarec_profiler_enabled())) {
+        dynarec_profiler_record_compile(block, compile_start);
     }
 
     return n64dynarec.run_block((u64)block->run);
 }
 
+// Drop a block from its chain so the slot can be compiled again. Its code stays where it is, but links into it are only
+// undone by invalidating the page, which won't know about this block anymore, so undo them now.
+INLINE void evict_block(n64_dynarec_block_t* block) {
+    unlink_dynarec_block(block);
+    block->run = NULL;
+    block->dirty = false;
+}
+
+// Blocks for other sysconfigs and virtual addresses of the same code are chained behind the first one, most recently
+// used first. Once a chain is MAX_BLOCK_CHAIN_LENGTH long, the least recently used block makes room for new ones.
 INLINE n64_dynarec_block_t* find_matching_block(n64_dynarec_block_t* blocks, n64_block_sysconfig_t current_sysconfig, u64 virtual_address) {
     n64_dynarec_block_t* block_iter = blocks;
+    int chain_length = 1;
     while (block_iter->run != NULL) {
         // make sure it matches the sysconfig and virtual address. If not, keep looking.
         if (block_iter->sysconfig.raw == current_sysconfig.raw && block_iter->virtual_address == virtual_address) {
             if (block_iter != blocks) {
-                n64_dynarec_block_t temp = *blocks;
+                mark_metric(METRIC_BLOCK_SYSCONFIG_MISS); // the most recently used block was for another sysconfig
+                // Move it to the front, shifting the blocks before it back by one
+                n64_dynarec_block_t displaced = *blocks;
                 copy_dynarec_block(blocks, block_iter);
-                copy_dynarec_block(block_iter, &temp);
+                for (n64_dynarec_block_t* shifted = blocks->next; shifted != block_iter->next; shifted = shifted->next) {
+                    n64_dynarec_block_t next_displaced = *shifted;
+                    copy_dynarec_block(shifted, &displaced);
+                    displaced = next_displaced;
+                }
                 return blocks;
             }
             return block_iter;
-        } else {
-            mark_metric(METRIC_BLOCK_SYSCONFIG_MISS); // block was valid, but did not match the current sysconfig.
         }
         // Add a block to the end of the list
         if (block_iter->next == NULL) {
-            block_iter->next = dynarec_bumpalloc_zero(sizeof(n64_dynarec_block_t));
+            mark_metric(METRIC_BLOCK_SYSCONFIG_MISS);
+            if (chain_length == MAX_BLOCK_CHAIN_LENGTH) {
+                evict_block(block_iter);
+                return block_iter;
+            }
+            block_iter->next = calloc(1, sizeof(n64_dynarec_block_t));
             return block_iter->next;
         }
         block_iter = block_iter->next;
+        chain_length++;
     }
     return block_iter;
 }
@@ -71,36 +390,143 @@ INLINE n64_dynarec_block_t* find_matching_block(n64_dynarec_block_t* blocks, n64
 // If a block exists, return it. If not, return a block with a NULL run function.
 INLINE n64_dynarec_block_t* block_at_address(n64_block_sysconfig_t current_sysconfig, u64 virtual_address, u32 physical_address) {
     u32 outer_index = physical_address >> BLOCKCACHE_OUTER_SHIFT;
-    n64_dynarec_block_t* block_list = n64dynarec.blockcache[outer_index];
+    n64_dynarec_page_t* page = get_or_create_dynarec_page(outer_index);
 
-    if (unlikely(block_list == NULL)) {
-#ifdef N64_LOG_COMPILATIONS
-        printf("Need a new block list for page 0x%05X (address 0x%08X virtual 0x%08X)\n", outer_index, physical_address, N64CPU.pc);
-#endif
-        block_list = dynarec_bumpalloc_zero(BLOCKCACHE_INNER_SIZE * sizeof(n64_dynarec_block_t));
-        for (int i = 0; i < BLOCKCACHE_INNER_SIZE; i++) {
-            block_list[i].run = NULL;
-            block_list[i].next = NULL;
-            block_list[i].host_size = 0;
-            block_list[i].guest_size = 0;
-            block_list[i].sysconfig.raw = 0;
+    u32 inner_index = BLOCKCACHE_INNER_INDEX(physical_address);
+    if (unlikely(page->block_index[inner_index] == 0)) {
+        // Blocks are only stored for instructions that have had one compiled, so most pages need just a few
+        if (page->num_blocks == page->blocks_capacity) {
+            int new_capacity = page->blocks_capacity == 0 ? 8 : page->blocks_capacity * 2;
+            page->blocks = realloc(page->blocks, new_capacity * sizeof(n64_dynarec_block_t));
+            if (page->blocks == NULL) {
+                logfatal("Failed to grow the block list of page 0x%05X to %d blocks", outer_index, new_capacity);
+            }
+            memset(&page->blocks[page->blocks_capacity], 0, (new_capacity - page->blocks_capacity) * sizeof(n64_dynarec_block_t));
+            page->blocks_capacity = new_capacity;
         }
-        n64dynarec.blockcache[outer_index] = block_list;
-        n64dynarec.code_mask[outer_index] = dynarec_bumpalloc_zero(BLOCKCACHE_INNER_SIZE * sizeof(bool));
+        page->block_index[inner_index] = ++page->num_blocks;
     }
-
-    u32 inner_index = BLOCKCACHE_INNER_INDEX(physical_address);
-    n64_dynarec_block_t* block = &block_list[inner_index];
+    n64_dynarec_block_t* block = &page->blocks[page->block_index[inner_index] - 1];
 
 
 #ifdef LOG_ENABLED
     static long total_blocks_run;
-    logdebug("Running block at 0x%016" PRIX64 " - block run #%ld - block FP: 0x%016" PRIX64, N64CPU.pc, ++total_blocks_run, (uintptr_t)block->run);
+    logdebug("Running block at 0x%016" PRIX64 " - block run #%ld - block FP: 0x%016" PRIX64, virtual_address, ++total_blocks_run, (uintptr_t)block->run);
 #endif
-    N64CPU.exception = false;
 
     // Find the first block that's both non-null and matches the current sysconfig
-    return find_matching_block(block, n64dynarec.sysconfig, N64CPU.pc);
+    return find_matching_block(block, current_sysconfig, virtual_address);
+}
+
+// Copy a block compiled outside of the code cache into it. The guest code must already have been checked against memory.
+// If host_size is 0, run isn't real code (e.g. the idle loop replacement) and is used as is.
+// Returns NULL if a block for this address and sysconfig was compiled in the meantime.
+n64_dynarec_block_t* install_block(n64_block_sysconfig_t sysconfig, u64 virtual_address, u32 physical_address, int guest_words,
+                                   int guest_size, int (*run)(r4300i_t*), int host_size, int link_entry_offset,
+                                   int bound_link_entry_offset, u64 entry_bindings) {
+    // Allocate the code first, in case reclaiming space for it invalidates this page
+    u8* code = NULL;
+    if (host_size > 0) {
+        code = dynarec_alloc_code(host_size, physical_address);
+    }
+
+    n64_dynarec_block_t* block = block_at_address(sysconfig, virtual_address, physical_address);
+    if (block->run != NULL) {
+        return NULL; // Already compiled
+    }
+
+    n64_dynarec_page_t* page = get_dynarec_page(BLOCKCACHE_OUTER_INDEX(physical_address));
+    for (int i = 0; i < guest_words; i++) {
+        mark_code(page, physical_address + (i << 2));
+    }
+
+    block->link_entry = NULL;
+    block->bound_link_entry = NULL;
+    block->entry_bindings = REGISTER_BINDINGS_NONE;
+    block->next = NULL;
+    block->sysconfig = sysconfig;
+    block->virtual_address = virtual_address;
+    block->physical_address = physical_address;
+    block->guest_start = physical_address;
+    block->guest_size = guest_size;
+    block->guest_hash = hash_block_guest_code(physical_address, guest_size);
+    block->dirty = false;
+    block->host_size = host_size;
+    if (host_size == 0) {
+        block->run = run;
+    } else {
+        memcpy(code, run, host_size);
+        if (link_entry_offset >= 0) {
+            block->link_entry = code + link_entry_offset;
+        }
+        if (bound_link_entry_offset >= 0) {
+            block->bound_link_entry = code + bound_link_entry_offset;
+            block->entry_bindings = entry_bindings;
+        }
+        block->run = (int(*)(r4300i_t*))code;
+
+        char block_name[500];
+        snprintf(block_name, 500, "cpu_jit_block_%08X", physical_address);
+        n64_perf_map_file_write((uintptr_t)code, host_size, block_name);
+    }
+    start_block_profile(block);
+    return block;
+}
+
+// Copy a block the compile thread finished into the code cache
+void install_async_block(v2_compile_job_t* job) {
+    if (job->discarded) {
+        return;
+    }
+
+    u32 physical_address = job->physical_address;
+    // The guest code could have been overwritten while it was being compiled. If so, drop it and compile it again next time.
+    for (int i = 0; i < job->guest_words; i++) {
+        if (n64_read_physical_word(physical_address + (i << 2)) != job->guest_code[i]) {
+            return;
+        }
+    }
+
+    int link_entry_offset = job->block.link_entry ? job->block.link_entry - (u8*)job->block.run : -1;
+    int bound_link_entry_offset = job->block.bound_link_entry ? job->block.bound_link_entry - (u8*)job->block.run : -1;
+    install_block(job->sysconfig, job->virtual_address, physical_address, job->guest_words,
+                  job->block.guest_size, job->block.run, job->block.host_size, link_entry_offset,
+                  bound_link_entry_offset, job->block.entry_bindings);
+}
+
+// Copy a block compiled in an earlier session into the code cache, and fix up its host pointers for this one.
+// Returns NULL if it couldn't be installed.
+n64_dynarec_block_t* install_persistent_block(v2_cached_block_t* cached) {
+    n64_dynarec_block_t* block = install_block(cached->sysconfig, cached->virtual_address, cached->physical_address, cached->guest_words,
+                                               cached->guest_size, (int(*)(r4300i_t*))cached->code, cached->host_size, cached->link_entry_offset,
+                                               cached->bound_link_entry_offset, cached->entry_bindings);
+    if (block == NULL) {
+        return NULL;
+    }
+    v2_persistent_cache_relocate(cached, (u8*)block->run);
+    mark_metric(METRIC_BLOCK_PERSISTENT_CACHE_HIT);
+    return block;
+}
+
+// Run a block's worth of instructions in the interpreter, while the compile thread works on the real block
+int interpret_block() {
+    int taken = 0;
+    while (true) {
+        bool in_delay_slot = N64CPU.branch;
+        u64 next_pc = N64CPU.pc + 4;
+        r4300i_step();
+        taken++;
+
+        // Stop in the same places a compiled block would end: after a delay slot, on anything that jumps (exceptions, eret),
+        // and at the end of a page.
+        if (in_delay_slot || N64CPU.pc != next_pc) {
+            break;
+        }
+        if (!N64CPU.branch && (IS_PAGE_BOUNDARY((u32)N64CPU.pc) || taken >= MAX_BLOCK_LENGTH)) {
+            break;
+        }
+    }
+    return taken;
 }
 
 #ifdef DO_REPEATED_EXEC_DETECTION
@@ -126,9 +552,22 @@ void do_repeated_exec_detection(u32 physical, n64_dynarec_block_t *block) {
 }
 #endif // DO_REPEATED_EXEC_DETECTION
 
-int n64_dynarec_step() {
+INLINE int dynarec_step(u64 link_budget) {
+    if (unlikely(n64dynarec.retired_pages != NULL)) {
+        free_retired_dynarec_pages();
+    }
+
+    if (unlikely(v2_async_compile_finished())) {
+        v2_collect_async_compiles(install_async_block);
+    }
+
+    // Only taken now, installing those blocks can reclaim the code region the link is in, which forgets it
+    n64_dynarec_link_t* exit_link = n64dynarec.exit_link;
+    n64dynarec.exit_link = NULL;
+
     N64CPU.branch = false;
     N64CPU.prev_branch = false;
+    N64CPU.exception = false;
     u32 physical;
     bool cached;
     if (!resolve_virtual_address(N64CPU.pc, BUS_LOAD, &cached, &physical)) {
@@ -140,16 +579,53 @@ int n64_dynarec_step() {
 
     n64_dynarec_block_t* block = block_at_address(n64dynarec.sysconfig, N64CPU.pc, physical);
 
+    // Linked blocks may keep running until the budget runs out
+    u64 link_limit = link_budget / CYCLES_PER_INSTR;
+    N64CPU.block_link_cycles = 0;
+    N64CPU.block_link_limit = link_limit > INT32_MAX ? INT32_MAX : (s32)link_limit;
+    if (unlikely(dynarec_profiler_enabled())) {
+        // Come back here after every block, so each one's runs are counted
+        N64CPU.block_link_limit = 0;
+    }
+
     int taken;
-    if (block->run) {
+    v2_cached_block_t* persistent_block;
+    if (unlikely(block->dirty) && !revalidate_block(block)) {
+        // Compile it again in place, keeping the blocks for other sysconfigs chained to it
+        taken = missing_block_handler(physical, block, n64dynarec.sysconfig);
+    } else if (block->run) {
         #ifdef DO_REPEATED_EXEC_DETECTION
         do_repeated_exec_detection(physical, block);
         #endif
-        taken = n64dynarec.run_block((u64)block->run);
+        if (exit_link) {
+            link_block(exit_link, block, physical);
+        }
+        if (unlikely(block->branch_target != 0) && block->profile_entries < N64_DYNAREC_PROFILE_ENTRIES) {
+            taken = run_profiled_block(block, physical);
+        } else {
+            taken = n64dynarec.run_block((u64)block->run);
+        }
+    } else if (v2_persistent_cache_enabled() && (persistent_block = v2_persistent_cache_find(N64CPU.pc, physical, n64dynarec.sysconfig)) != NULL) {
+        n64_dynarec_block_t* installed = install_persistent_block(persistent_block);
+        if (installed != NULL) {
+            block = installed;
+            taken = n64dynarec.run_block((u64)block->run);
+        } else {
+            // Making room for it can invalidate this page, so look the block up again before compiling it
+            block = block_at_address(n64dynarec.sysconfig, N64CPU.pc, physical);
+            taken = block->run ? n64dynarec.run_block((u64)block->run) : missing_block_handler(physical, block, n64dynarec.sysconfig);
+        }
+    } else if (v2_async_compilation_enabled() && physical < N64_RDRAM_SIZE
+               && v2_request_async_compile(N64CPU.pc, physical, n64dynarec.sysconfig)) {
+        taken = interpret_block();
     } else {
         taken = missing_block_handler(physical, block, n64dynarec.sysconfig);
     }
+    taken += N64CPU.block_link_cycles;
 
+    if (unlikely(dynarec_profiler_enabled()) && block != NULL && block->run != NULL) {
+        dynarec_profiler_record_run(block, taken * CYCLES_PER_INSTR);
+    }
 #ifdef N64_LOG_JIT_SYNC_POINTS
     printf("JITSYNC %d %08X ", taken, N64CPU.pc);
     for (int i = 0; i < 32; i++) {
@@ -165,6 +641,28 @@ int n64_dynarec_step() {
     return taken * CYCLES_PER_INSTR;
 }
 
+int n64_dynarec_step() {
+    return dynarec_step(scheduler_ticks_until_next_event());
+}
+
+// Run blocks until more than `budget` cycles have passed, or until the scheduler queue changes.
+// COUNT and the scheduler's clock are kept up to date after every block, so callers must not tick the scheduler
+// with the returned cycles again.
+int n64_dynarec_run(u64 budget) {
+    s64 remaining = budget;
+    int taken = 0;
+    n64dynarec.run_interrupted = false;
+    do {
+        int block_taken = dynarec_step(remaining);
+        N64CP0.count += block_taken;
+        N64CP0.count &= 0x1FFFFFFFF;
+        scheduler_advance(block_taken);
+        taken += block_taken;
+        remaining -= block_taken;
+    } while (remaining >= 0 && !n64dynarec.run_interrupted);
+    return taken;
+}
+
 void n64_dynarec_init(u8* codecache, size_t codecache_size) {
 #ifdef N64_LOG_COMPILATIONS
     printf("Trying to malloc %ld bytes\n", sizeof(n64_dynarec_t));
@@ -173,10 +671,7 @@ void n64_dynarec_init(u8* codecache, size_t codecache_size) {
 
     n64dynarec.codecache_size = codecache_size;
     n64dynarec.codecache_used = 0;
-
-    for (int i = 0; i < BLOCKCACHE_OUTER_SIZE; i++) {
-        n64dynarec.blockcache[i] = NULL;
-    }
+    n64dynarec.code_region_size = codecache_size / N64_CODECACHE_REGIONS;
 
     n64dynarec.codecache = codecache;
 
@@ -187,7 +682,15 @@ void n64_dynarec_init(u8* codecache, size_t codecache_size) {
 }
 
 void invalidate_dynarec_all_pages() {
-    for (int i = 0; i < BLOCKCACHE_OUTER_SIZE; i++) {
-        n64dynarec.blockcache[i] = NULL;
+    for (int table = 0; table < DYNAREC_NUM_PAGE_TABLES; table++) {
+        u32 first_page = table << DYNAREC_PAGE_TABLE_SHIFT;
+        // Links only jump into RDRAM, so past that only pages that exist need to be looked at
+        if (n64dynarec.page_tables[table] == NULL && first_page >= BLOCKCACHE_RDRAM_PAGES) {
+            continue;
+        }
+        for (u32 i = first_page; i < first_page + DYNAREC_PAGE_TABLE_SIZE; i++) {
+            invalidate_dynarec_page_by_index(i);
+        }
     }
+    n64dynarec.exit_link = NULL;
 }
\ No newline at end of file
@@ -38,6 +38,10 @@ INLINE bool is_branch(dynarec_instruction_category_t category) {
 typedef union n64_block_sysconfig {
     struct {
         u64 fr:1;
+        u64 fpu_rounding:2; // FCR31 rounding mode, float ops that round are compiled for it
+        u64 kernel_mode:1; // unmapped segments are translated inline
+        u64 addressing_64bit:1;
+        u64 cp1_usable:1; // COP1 instructions skip the coprocessor unusable check
     };
     u64 raw;
 } n64_block_sysconfig_t;
@@ -47,53 +51,220 @@ void update_sysconfig();
 
 typedef struct n64_dynarec_block {
     int (*run)(r4300i_t* cpu);
+    u8* link_entry; // where linked blocks jump to, after the prologue. NULL if the block can't be linked to.
+    u8* bound_link_entry; // past the loads of the entry_bindings registers, for links that left them in place. Can be NULL.
+    u64 entry_bindings; // guest registers the block loads into host registers right after link_entry
     size_t guest_size;
     size_t host_size;
     n64_block_sysconfig_t sysconfig;
     u64 virtual_address;
+    u32 physical_address;
+    u32 guest_start; // lowest address of the guest code the block was compiled from. Only below physical_address for superblocks.
+    u32 guest_hash; // of the guest code the block was compiled from
+    bool dirty; // guest code was written to since, check guest_hash before running it again
+    u64 branch_target; // taken target of the branch ending the block, 0 if the block isn't being profiled
+    u16 profile_entries; // times the block was run from the dispatcher while being profiled
+    u16 profile_taken; // how many of those ended up at branch_target
+    bool superblock;
     struct n64_dynarec_block* next; // for other sysconfigs
 } n64_dynarec_block_t;
 
+// Longest chain of blocks for the same physical address. Kept short, since every dispatch walks it until it finds a match.
+#define MAX_BLOCK_CHAIN_LENGTH 4
+
 INLINE void copy_dynarec_block(n64_dynarec_block_t* dest, n64_dynarec_block_t* src) {
     dest->run = src->run;
+    dest->link_entry = src->link_entry;
+    dest->bound_link_entry = src->bound_link_entry;
+    dest->entry_bindings = src->entry_bindings;
     dest->guest_size = src->guest_size;
     dest->host_size = src->host_size;
     dest->sysconfig = src->sysconfig;
     dest->virtual_address = src->virtual_address;
+    dest->physical_address = src->physical_address;
+    dest->guest_start = src->guest_start;
+    dest->guest_hash = src->guest_hash;
+    dest->dirty = src->dirty;
+    dest->branch_target = src->branch_target;
+    dest->profile_entries = src->profile_entries;
+    dest->profile_taken = src->profile_taken;
+    dest->superblock = src->superblock;
 }
 
+// Blocks ending in a branch are run on their own this many times, to see which way the branch usually goes before
+// compiling a superblock that follows it
+#define N64_DYNAREC_PROFILE_ENTRIES 64
+
+typedef enum dynarec_branch_bias {
+    BRANCH_BIAS_UNKNOWN, // not profiled yet, or goes both ways
+    BRANCH_BIAS_TAKEN,
+    BRANCH_BIAS_NOT_TAKEN
+} dynarec_branch_bias_t;
+
+INLINE dynarec_branch_bias_t get_block_branch_bias(n64_dynarec_block_t* block) {
+    if (block->profile_entries < N64_DYNAREC_PROFILE_ENTRIES) {
+        return BRANCH_BIAS_UNKNOWN;
+    }
+    // At least 7 in 8 the same way
+    if (block->profile_taken * 8 >= block->profile_entries * 7) {
+        return BRANCH_BIAS_TAKEN;
+    } else if (block->profile_taken * 8 <= block->profile_entries) {
+        return BRANCH_BIAS_NOT_TAKEN;
+    }
+    return BRANCH_BIAS_UNKNOWN;
+}
+
+// Guest GPRs known to be in host registers. One byte per allocatable host register, in get_preserved_gprs() order, holding
+// the guest register it has the value of, or 0 for none (r0 is never loaded).
+#define MAX_REGISTER_BINDINGS 8
+#define REGISTER_BINDINGS_NONE 0
+
+INLINE u64 register_bindings_mask(u64 bindings) {
+    u64 mask = 0;
+    for (int i = 0; i < MAX_REGISTER_BINDINGS; i++) {
+        if ((bindings >> (i * 8)) & 0xFF) {
+            mask |= 0xFFull << (i * 8);
+        }
+    }
+    return mask;
+}
+
+// Can a block expecting entry_bindings be entered without loading them, when coming from an exit that left exit_bindings?
+INLINE bool register_bindings_compatible(u64 exit_bindings, u64 entry_bindings) {
+    return (exit_bindings & register_bindings_mask(entry_bindings)) == entry_bindings;
+}
+
+// A patchable jump at a block exit with a known target pc. These are stored in the block's code, after the epilogue.
+#define MAX_BLOCK_EXIT_LINKS 2
+typedef struct n64_dynarec_link {
+    u64 target_virtual_address;
+    s32 jump_end_offset; // from this link to just past the jmp rel32 to patch. Relative, so blocks can be moved after compiling.
+    n64_block_sysconfig_t sysconfig; // sysconfig the source block was compiled with
+    u64 exit_bindings; // guest registers still in host registers when the source block takes this exit
+    bool linked;
+    bool mapped; // target is TLB mapped, so the link must be undone when the TLB changes
+    struct n64_dynarec_link* next; // next link into the same page
+} n64_dynarec_link_t;
+
+// Only blocks in RDRAM can be linked to
+#define BLOCKCACHE_RDRAM_PAGES (N64_RDRAM_SIZE >> BLOCKCACHE_OUTER_SHIFT)
+
+// The code cache is split into regions that fill up in order. When the last one is full, the oldest one is reclaimed,
+// along with every page that has code in it, so the whole cache never has to be flushed at once.
+#define N64_CODECACHE_REGIONS 32
+
+typedef struct n64_code_region {
+    u64 used;
+    u32* pages; // outer indices of pages that allocated code here. May have duplicates.
+    int num_pages;
+    int pages_capacity;
+} n64_code_region_t;
+
+// Everything the dynarec knows about a page that has had code compiled from it
+typedef struct n64_dynarec_page {
+    u16 block_index[BLOCKCACHE_INNER_SIZE]; // 1 + index into blocks of the block starting at each instruction, or 0
+    n64_dynarec_block_t* blocks; // only as many as there are blocks in the page
+    int num_blocks;
+    int blocks_capacity;
+    u32 code_mask[BLOCKCACHE_INNER_SIZE / 32]; // bitset, one bit per instruction
+    u32 code_regions; // bitmask of the code cache regions this page has code in
+    struct n64_dynarec_page* next_retired;
+} n64_dynarec_page_t;
+
+// Pages are found through a two level table, so only the parts of the address space that have code in them take up memory
+#define DYNAREC_PAGE_TABLE_SHIFT 10
+#define DYNAREC_PAGE_TABLE_SIZE (1 << DYNAREC_PAGE_TABLE_SHIFT)
+#define DYNAREC_NUM_PAGE_TABLES (BLOCKCACHE_OUTER_SIZE >> DYNAREC_PAGE_TABLE_SHIFT)
+#define DYNAREC_PAGE_TABLE_INDEX(outer_index) ((outer_index) >> DYNAREC_PAGE_TABLE_SHIFT)
+#define DYNAREC_PAGE_INDEX(outer_index) ((outer_index) & (DYNAREC_PAGE_TABLE_SIZE - 1))
+
 typedef struct n64_dynarec {
     int (*run_block)(u64 block_addr);
     u8* codecache;
     u64 codecache_size;
-    u64 codecache_used;
+    u64 codecache_used; // total of all regions
+
+    n64_code_region_t code_regions[N64_CODECACHE_REGIONS];
+    u64 code_region_size;
+    int current_code_region;
 
     n64_block_sysconfig_t sysconfig;
 
-    n64_dynarec_block_t* blockcache[BLOCKCACHE_OUTER_SIZE];
-    bool* code_mask[BLOCKCACHE_OUTER_SIZE];
+    // Pages are allocated on the heap, separately from the code
+    n64_dynarec_page_t** page_tables[DYNAREC_NUM_PAGE_TABLES];
+    // Invalidated pages. They can still be in use by the block that invalidated them, so they're only freed the next
+    // time the dispatcher runs.
+    n64_dynarec_page_t* retired_pages;
+
+    n64_dynarec_link_t* exit_link; // exit link the last block returned through, if it was not linked
+    n64_dynarec_link_t* page_links[BLOCKCACHE_RDRAM_PAGES]; // linked exits that jump into each page
+    int num_mapped_links;
+
+    bool run_interrupted; // set when n64_dynarec_run() needs to return to the system loop early
 } n64_dynarec_t;
 
 extern n64_dynarec_t n64dynarec;
 
+INLINE n64_dynarec_page_t* get_dynarec_page(u32 outer_index) {
+    n64_dynarec_page_t** table = n64dynarec.page_tables[DYNAREC_PAGE_TABLE_INDEX(outer_index)];
+    return table != NULL ? table[DYNAREC_PAGE_INDEX(outer_index)] : NULL;
+}
+
+INLINE void mark_code(n64_dynarec_page_t* page, u32 physical_address) {
+    u32 inner_index = BLOCKCACHE_INNER_INDEX(physical_address);
+    page->code_mask[inner_index >> 5] |= 1u << (inner_index & 31);
+}
+
+// First block compiled at an address, or NULL
+INLINE n64_dynarec_block_t* get_dynarec_block(u32 physical_address) {
+    n64_dynarec_page_t* page = get_dynarec_page(BLOCKCACHE_OUTER_INDEX(physical_address));
+    if (page == NULL) {
+        return NULL;
+    }
+    int index = page->block_index[BLOCKCACHE_INNER_INDEX(physical_address)];
+    return index > 0 ? &page->blocks[index - 1] : NULL;
+}
+
+n64_dynarec_page_t* get_or_create_dynarec_page(u32 outer_index);
+void unlink_dynarec_page(u32 outer_index);
+void unlink_mapped_dynarec_blocks();
+void forget_dynarec_links_in_range(u8* start, u8* end);
+void retire_dynarec_page(u32 outer_index);
+void invalidate_dynarec_range(u32 physical_address, u32 length);
+dynarec_branch_bias_t dynarec_branch_bias(u64 virtual_address, u32 physical_address, n64_block_sysconfig_t sysconfig);
+
 INLINE void invalidate_dynarec_page_by_index(u32 outer_index) {
-    n64dynarec.blockcache[outer_index] = NULL;
+    if (get_dynarec_page(outer_index) != NULL) {
+        retire_dynarec_page(outer_index);
+    }
+    if (outer_index < BLOCKCACHE_RDRAM_PAGES && n64dynarec.page_links[outer_index] != NULL) {
+        unlink_dynarec_page(outer_index);
+    }
+}
+
+// Any new scheduler event could be sooner than the budget the JIT was given, so return to the dispatcher at the next
+// link, and from there to the system loop.
+INLINE void n64_dynarec_stop_run() {
+    N64CPU.block_link_limit = 0;
+    n64dynarec.run_interrupted = true;
 }
 
 INLINE bool is_code(u32 physical_address) {
-    bool* code_mask = n64dynarec.code_mask[physical_address >> BLOCKCACHE_OUTER_SHIFT];
-    return code_mask != NULL && code_mask[BLOCKCACHE_INNER_INDEX(physical_address)];
+    n64_dynarec_page_t* page = get_dynarec_page(BLOCKCACHE_OUTER_INDEX(physical_address));
+    u32 inner_index = BLOCKCACHE_INNER_INDEX(physical_address);
+    return page != NULL && (page->code_mask[inner_index >> 5] & (1u << (inner_index & 31)));
 }
 
+// Only the blocks compiled from the written address are invalidated, not the whole page
 INLINE void invalidate_dynarec_page(u32 physical_address) {
     if (unlikely(is_code(physical_address))) {
-        invalidate_dynarec_page_by_index(BLOCKCACHE_OUTER_INDEX(physical_address));
+        invalidate_dynarec_range(physical_address, 1);
     }
 }
 
 int n64_dynarec_step();
+int n64_dynarec_run(u64 budget);
 void n64_dynarec_init(u8* codecache, size_t codecache_size);
-void invalidate_dynarec_page(u32 physical_address);
 void invalidate_dynarec_all_pages();
 
 #ifdef __cplusplus
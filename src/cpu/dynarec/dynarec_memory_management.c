@@ -1,15 +1,73 @@
 #include <rsp.h>
+#include <stdlib.h>
+#include <inttypes.h>
 #include "dynarec_memory_management.h"
 #include "dynarec.h"
 
-void flush_code_cache() {
-    // Just set the pointer back to the beginning, no need to clear the actual data.
-    n64dynarec.codecache_used = 0;
+n64_dynarec_page_t* get_or_create_dynarec_page(u32 outer_index) {
+    n64_dynarec_page_t** table = n64dynarec.page_tables[DYNAREC_PAGE_TABLE_INDEX(outer_index)];
+    if (unlikely(table == NULL)) {
+        table = calloc(DYNAREC_PAGE_TABLE_SIZE, sizeof(n64_dynarec_page_t*));
+        n64dynarec.page_tables[DYNAREC_PAGE_TABLE_INDEX(outer_index)] = table;
+    }
 
-    // However, the block cache needs to be fully invalidated.
-    for (int i = 0; i < BLOCKCACHE_OUTER_SIZE; i++) {
-        n64dynarec.blockcache[i] = NULL;
+    n64_dynarec_page_t* page = table[DYNAREC_PAGE_INDEX(outer_index)];
+    if (unlikely(page == NULL)) {
+        page = calloc(1, sizeof(n64_dynarec_page_t));
+        table[DYNAREC_PAGE_INDEX(outer_index)] = page;
+    }
+    return page;
+}
+
+void retire_dynarec_page(u32 outer_index) {
+    n64_dynarec_page_t** table = n64dynarec.page_tables[DYNAREC_PAGE_TABLE_INDEX(outer_index)];
+    n64_dynarec_page_t* page = table[DYNAREC_PAGE_INDEX(outer_index)];
+    table[DYNAREC_PAGE_INDEX(outer_index)] = NULL;
+
+    page->next_retired = n64dynarec.retired_pages;
+    n64dynarec.retired_pages = page;
+}
+
+void free_retired_dynarec_pages() {
+    n64_dynarec_page_t* page = n64dynarec.retired_pages;
+    while (page != NULL) {
+        for (int i = 0; i < page->num_blocks; i++) {
+            n64_dynarec_block_t* block = page->blocks[i].next;
+            while (block != NULL) {
+                n64_dynarec_block_t* next = block->next;
+                free(block);
+                block = next;
+            }
+        }
+        free(page->blocks);
+
+        n64_dynarec_page_t* next = page->next_retired;
+        free(page);
+        page = next;
+    }
+    n64dynarec.retired_pages = NULL;
+}
+
+static void reclaim_code_region(int index) {
+    n64_code_region_t* region = &n64dynarec.code_regions[index];
+    u32 region_bit = 1u << index;
+    for (int i = 0; i < region->num_pages; i++) {
+        u32 outer_index = region->pages[i];
+        // Pages invalidated since they put code here are already gone, along with their blocks
+        n64_dynarec_page_t* page = get_dynarec_page(outer_index);
+        if (page != NULL && (page->code_regions & region_bit)) {
+            invalidate_dynarec_page_by_index(outer_index);
+        }
     }
+    region->num_pages = 0;
+
+    // Blocks in other pages may have linked into blocks in this region, but those links were undone above.
+    // Links out of blocks in this region live in the region itself, so just stop tracking them.
+    u8* start = &n64dynarec.codecache[index * n64dynarec.code_region_size];
+    forget_dynarec_links_in_range(start, start + n64dynarec.code_region_size);
+
+    n64dynarec.codecache_used -= region->used;
+    region->used = 0;
 }
 
 #ifdef N64_DYNAREC_V1_ENABLED
@@ -23,32 +81,41 @@ void flush_rsp_code_cache() {
 }
 #endif
 
-void* dynarec_bumpalloc(size_t size) {
-    if (n64dynarec.codecache_used + size >= n64dynarec.codecache_size) {
-        flush_code_cache();
+void* dynarec_alloc_code(size_t size, u32 physical_address) {
+    n64_code_region_t* region = &n64dynarec.code_regions[n64dynarec.current_code_region];
+    if (region->used + size > n64dynarec.code_region_size) {
+        if (size > n64dynarec.code_region_size) {
+            logfatal("Tried to allocate %zu bytes of code, but code cache regions are only %" PRIu64 " bytes", size, n64dynarec.code_region_size);
+        }
+        // Move on to the oldest region
+        n64dynarec.current_code_region = (n64dynarec.current_code_region + 1) % N64_CODECACHE_REGIONS;
+        reclaim_code_region(n64dynarec.current_code_region);
+        region = &n64dynarec.code_regions[n64dynarec.current_code_region];
     }
 
-    void* ptr = &n64dynarec.codecache[n64dynarec.codecache_used];
-
+    void* ptr = &n64dynarec.codecache[n64dynarec.current_code_region * n64dynarec.code_region_size + region->used];
+    region->used += size;
     n64dynarec.codecache_used += size;
 
+    u32 outer_index = BLOCKCACHE_OUTER_INDEX(physical_address);
+    n64_dynarec_page_t* page = get_or_create_dynarec_page(outer_index);
+    u32 region_bit = 1u << n64dynarec.current_code_region;
+    if ((page->code_regions & region_bit) == 0) {
+        page->code_regions |= region_bit;
+        if (region->num_pages == region->pages_capacity) {
+            region->pages_capacity = region->pages_capacity == 0 ? 64 : region->pages_capacity * 2;
+            region->pages = realloc(region->pages, region->pages_capacity * sizeof(u32));
+        }
+        region->pages[region->num_pages++] = outer_index;
+    }
+
 #ifdef N64_LOG_COMPILATIONS
-    printf("bumpalloc: %ld used of %ld\n", n64dynarec.codecache_used, n64dynarec.codecache_size);
+    printf("alloc_code: %ld used of %ld\n", n64dynarec.codecache_used, n64dynarec.codecache_size);
 #endif
 
     return ptr;
 }
 
-void* dynarec_bumpalloc_zero(size_t size) {
-    u8* ptr = dynarec_bumpalloc(size);
-
-    for (int i = 0; i < size; i++) {
-        ptr[i] = 0;
-    }
-
-    return ptr;
-}
-
 #ifdef N64_DYNAREC_V1_ENABLED
 void* rsp_dynarec_bumpalloc(size_t size) {
     if (N64RSPDYNAREC->codecache_used + size >= N64RSPDYNAREC->codecache_size) {
@@ -3,7 +3,9 @@
 
 #include "dynarec.h"
 
-void* dynarec_bumpalloc(size_t size);
-void* dynarec_bumpalloc_zero(size_t size);
+// Allocates space for a block's code. physical_address is the block's, so the page is invalidated when the space
+// is reclaimed.
+void* dynarec_alloc_code(size_t size, u32 physical_address);
+void free_retired_dynarec_pages();
 void* rsp_dynarec_bumpalloc(size_t size);
 #endif //N64_DYNAREC_MEMORY_MANAGEMENT_H
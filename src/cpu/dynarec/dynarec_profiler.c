@@ -0,0 +1,170 @@
+#include "dynarec_profiler.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL_mutex.h>
+#include <SDL_timer.h>
+#include <log.h>
+
+bool dynarec_profiling = false;
+
+static dynarec_block_profile_t* profiles = NULL;
+static int num_profiles = 0;
+// The HTTP API takes snapshots from its own thread while the emulation thread is adding to and updating the table
+static SDL_mutex* profiles_lock = NULL;
+static char dump_path[PATH_MAX];
+
+void dynarec_profiler_enable(const char* path) {
+    if (profiles == NULL) {
+        profiles = calloc(DYNAREC_PROFILER_MAX_BLOCKS, sizeof(dynarec_block_profile_t));
+        if (profiles == NULL) {
+            logfatal("Failed to allocate the JIT profiler's block table");
+        }
+        profiles_lock = SDL_CreateMutex();
+    }
+    dump_path[0] = '\0';
+    if (path != NULL) {
+        snprintf(dump_path, sizeof(dump_path), "%s", path);
+    }
+    dynarec_profiling = true;
+}
+
+u64 dynarec_profiler_ticks() {
+    return SDL_GetPerformanceCounter();
+}
+
+INLINE u32 profile_hash(u64 virtual_address, u32 physical_address, n64_block_sysconfig_t sysconfig) {
+    u64 key = virtual_address ^ ((u64)physical_address << 32) ^ (sysconfig.raw * 0x9E3779B97F4A7C15ull);
+    key ^= key >> 29;
+    key *= 0xBF58476D1CE4E5B9ull;
+    key ^= key >> 32;
+    return key & (DYNAREC_PROFILER_MAX_BLOCKS - 1);
+}
+
+// Finds the profile for a block, adding it if it's new. Returns NULL once the table is full. Call with profiles_lock held.
+static dynarec_block_profile_t* get_profile(n64_dynarec_block_t* block) {
+    u32 index = profile_hash(block->virtual_address, block->physical_address, block->sysconfig);
+    for (int probes = 0; probes < DYNAREC_PROFILER_MAX_BLOCKS; probes++) {
+        dynarec_block_profile_t* profile = &profiles[index];
+        if (!profile->used) {
+            // Keep a little room, so lookups of blocks that are already in the table stay short
+            if (num_profiles >= DYNAREC_PROFILER_MAX_BLOCKS - DYNAREC_PROFILER_MAX_BLOCKS / 8) {
+                static bool warned = false;
+                if (!warned) {
+                    logwarn("JIT profiler is full, blocks compiled from now on won't be profiled");
+                    warned = true;
+                }
+                return NULL;
+            }
+            profile->virtual_address = block->virtual_address;
+            profile->physical_address = block->physical_address;
+            profile->sysconfig = block->sysconfig;
+            profile->used = true;
+            num_profiles++;
+            return profile;
+        }
+        if (profile->virtual_address == block->virtual_address && profile->physical_address == block->physical_address
+            && profile->sysconfig.raw == block->sysconfig.raw) {
+            return profile;
+        }
+        index = (index + 1) & (DYNAREC_PROFILER_MAX_BLOCKS - 1);
+    }
+    return NULL;
+}
+
+void dynarec_profiler_record_run(n64_dynarec_block_t* block, int cycles) {
+    SDL_LockMutex(profiles_lock);
+    dynarec_block_profile_t* profile = get_profile(block);
+    if (profile != NULL) {
+        profile->executions++;
+        profile->cycles += cycles;
+        profile->host_size = block->host_size;
+        profile->guest_size = block->guest_size;
+        profile->superblock = block->superblock;
+    }
+    SDL_UnlockMutex(profiles_lock);
+}
+
+void dynarec_profiler_record_compile(n64_dynarec_block_t* block, u64 compile_start) {
+    u64 elapsed = SDL_GetPerformanceCounter() - compile_start;
+    SDL_LockMutex(profiles_lock);
+    dynarec_block_profile_t* profile = get_profile(block);
+    if (profile != NULL) {
+        profile->compilations++;
+        profile->compile_ns += elapsed * 1000000000ull / SDL_GetPerformanceFrequency();
+        profile->host_size = block->host_size;
+        profile->guest_size = block->guest_size;
+        profile->superblock = block->superblock;
+    }
+    SDL_UnlockMutex(profiles_lock);
+}
+
+void dynarec_profiler_record_invalidation(n64_dynarec_block_t* block) {
+    SDL_LockMutex(profiles_lock);
+    dynarec_block_profile_t* profile = get_profile(block);
+    if (profile != NULL) {
+        profile->invalidations++;
+    }
+    SDL_UnlockMutex(profiles_lock);
+}
+
+static int hottest_first(const void* a, const void* b) {
+    const dynarec_block_profile_t* profile_a = a;
+    const dynarec_block_profile_t* profile_b = b;
+    if (profile_a->cycles != profile_b->cycles) {
+        return profile_a->cycles < profile_b->cycles ? 1 : -1;
+    }
+    return profile_a->physical_address < profile_b->physical_address ? -1 : profile_a->physical_address > profile_b->physical_address;
+}
+
+int dynarec_profiler_snapshot(dynarec_block_profile_t* out, int max) {
+    if (profiles == NULL) {
+        return 0;
+    }
+    int count = 0;
+    SDL_LockMutex(profiles_lock);
+    for (int i = 0; i < DYNAREC_PROFILER_MAX_BLOCKS && count < max; i++) {
+        if (profiles[i].used) {
+            out[count++] = profiles[i];
+        }
+    }
+    SDL_UnlockMutex(profiles_lock);
+    qsort(out, count, sizeof(dynarec_block_profile_t), hottest_first);
+    return count;
+}
+
+void dynarec_profiler_dump() {
+    if (!dynarec_profiling || dump_path[0] == '\0') {
+        return;
+    }
+    FILE* f = fopen(dump_path, "w");
+    if (f == NULL) {
+        logwarn("Failed to open %s for writing, not saving the JIT profile", dump_path);
+        return;
+    }
+
+    dynarec_block_profile_t* snapshot = malloc(DYNAREC_PROFILER_MAX_BLOCKS * sizeof(dynarec_block_profile_t));
+    int count = dynarec_profiler_snapshot(snapshot, DYNAREC_PROFILER_MAX_BLOCKS);
+    u64 total_cycles = 0;
+    for (int i = 0; i < count; i++) {
+        total_cycles += snapshot[i].cycles;
+    }
+
+    // Same layout as the /jit/profile HTTP API route
+    fprintf(f, "{\"total_cycles\":%" PRIu64 ",\"blocks\":[", total_cycles);
+    for (int i = 0; i < count; i++) {
+        dynarec_block_profile_t* profile = &snapshot[i];
+        fprintf(f, "%s\n{\"virtual_address\":\"%016" PRIX64 "\",\"physical_address\":\"%08" PRIX32 "\",\"sysconfig\":%" PRIu64
+                   ",\"executions\":%" PRIu64 ",\"cycles\":%" PRIu64 ",\"host_size\":%" PRIu32 ",\"guest_size\":%" PRIu32
+                   ",\"compilations\":%" PRIu32 ",\"compile_ns\":%" PRIu64 ",\"invalidations\":%" PRIu32 ",\"superblock\":%s}",
+                i == 0 ? "" : ",", profile->virtual_address, profile->physical_address, profile->sysconfig.raw,
+                profile->executions, profile->cycles, profile->host_size, profile->guest_size,
+                profile->compilations, profile->compile_ns, profile->invalidations, profile->superblock ? "true" : "false");
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    free(snapshot);
+    logalways("Wrote the JIT profile of %d blocks to %s", count, dump_path);
+}
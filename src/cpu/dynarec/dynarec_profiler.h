@@ -0,0 +1,54 @@
+#ifndef N64_DYNAREC_PROFILER_H
+#define N64_DYNAREC_PROFILER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "dynarec.h"
+
+// Opt-in per-block statistics, for finding the games and blocks that would benefit from idle loop patterns, superblocks
+// and so on, and for comparing builds. While it's enabled, blocks always return to the dispatcher instead of following
+// links, so every run is counted against the block it was in.
+#define DYNAREC_PROFILER_MAX_BLOCKS 65536
+
+typedef struct dynarec_block_profile {
+    u64 virtual_address;
+    u32 physical_address;
+    n64_block_sysconfig_t sysconfig;
+    bool used;
+    bool superblock;
+    u32 host_size; // of the latest compile
+    u32 guest_size;
+    u64 executions;
+    u64 cycles;
+    u32 compilations;
+    u32 invalidations;
+    u64 compile_ns; // total, over every synchronous compile
+} dynarec_block_profile_t;
+
+extern bool dynarec_profiling;
+
+// dump_path is where the profile is written by dynarec_profiler_dump(), or NULL to not write one
+void dynarec_profiler_enable(const char* dump_path);
+INLINE bool dynarec_profiler_enabled() {
+    return dynarec_profiling;
+}
+
+u64 dynarec_profiler_ticks();
+void dynarec_profiler_record_run(n64_dynarec_block_t* block, int cycles);
+// compile_start is what dynarec_profiler_ticks() returned right before compiling
+void dynarec_profiler_record_compile(n64_dynarec_block_t* block, u64 compile_start);
+void dynarec_profiler_record_invalidation(n64_dynarec_block_t* block);
+
+// Copies up to max blocks into out, hottest (by cycles) first. Returns how many were copied.
+// Can be called from other threads.
+int dynarec_profiler_snapshot(dynarec_block_profile_t* out, int max);
+// Writes the profile as JSON to the path passed to dynarec_profiler_enable()
+void dynarec_profiler_dump();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //N64_DYNAREC_PROFILER_H
@@ -140,9 +140,21 @@ void reset_rsp_dynarec_code_overlay(rsp_code_overlay_t* overlay) {
 }
 
 void reset_rsp_dynarec_code_overlays(rsp_dynarec_t* dynarec) {
-    for (int i = 0; i < RSP_NUM_CODE_OVERLAYS; i++) {
-            reset_rsp_dynarec_code_overlay(&dynarec->code_overlays[i]);
+    for (int i = 0; i < dynarec->code_overlays_allocated; i++) {
+        reset_rsp_dynarec_code_overlay(&dynarec->code_overlays[i]);
     }
+    for (int i = 0; i < RSP_OVERLAY_HASH_TABLE_SIZE; i++) {
+        dynarec->overlay_hashes[i].overlay = -1;
+    }
+}
+
+void rsp_dynarec_rehash_imem(rsp_dynarec_t* dynarec) {
+    dynarec->imem_hash = 0;
+    for (int i = 0; i < RSP_BLOCKCACHE_SIZE; i++) {
+        dynarec->hashed_imem[i] = word_from_byte_array(N64RSP.sp_imem, i << 2);
+        dynarec->imem_hash += rsp_imem_word_hash(i, dynarec->hashed_imem[i]);
+    }
+    dynarec->dirty = true;
 }
 
 rsp_dynarec_t* rsp_dynarec_init(u8* codecache, size_t codecache_size) {
@@ -151,7 +163,18 @@ rsp_dynarec_t* rsp_dynarec_init(u8* codecache, size_t codecache_size) {
     dynarec->codecache_size = codecache_size;
     dynarec->codecache_used = 0;
 
+    dynarec->code_overlays_capacity = RSP_MIN_CODE_OVERLAYS;
+    dynarec->code_overlays = malloc(RSP_MIN_CODE_OVERLAYS * sizeof(rsp_code_overlay_t));
+    if (dynarec->code_overlays == NULL) {
+        logfatal("Failed to allocate RSP code overlays");
+    }
+    // Start out with one overlay selected, so there's always a valid one
+    dynarec->code_overlays_allocated = 1;
+    dynarec->selected_code_overlay = 0;
+    dynarec->code_overlays[0].last_used = 0;
+
     reset_rsp_dynarec_code_overlays(dynarec);
+    rsp_dynarec_rehash_imem(dynarec);
 
     dynarec->codecache = codecache;
 
@@ -191,31 +214,83 @@ bool code_overlay_matches(int index) {
     return true;
 }
 
-int rsp_dynarec_step() {
-    if (N64RSPDYNAREC->dirty) {
-        // see if we match any existing blocks, if yes, switch to the first matching block we find.
-        // if no, allocate a new one.
-        // if we're out of blocks, choose a random one to overwrite and use.
-        bool found_match = false;
-        for (int i = 0; i < N64RSPDYNAREC->code_overlays_allocated && !found_match; i++) {
-            if (code_overlay_matches(i)) {
-                found_match = true;
-                N64RSPDYNAREC->selected_code_overlay = i;
+INLINE rsp_overlay_hash_entry_t* get_overlay_hash_entry(u64 imem_hash) {
+    return &N64RSPDYNAREC->overlay_hashes[imem_hash & (RSP_OVERLAY_HASH_TABLE_SIZE - 1)];
+}
+
+// Returns an empty overlay: a new one if there's room, otherwise the least recently used one.
+int new_code_overlay() {
+    rsp_dynarec_t* dynarec = N64RSPDYNAREC;
+    if (dynarec->code_overlays_allocated == dynarec->code_overlays_capacity) {
+        int lru = 0;
+        for (int i = 1; i < dynarec->code_overlays_allocated; i++) {
+            if (dynarec->code_overlays[i].last_used < dynarec->code_overlays[lru].last_used) {
+                lru = i;
             }
         }
 
-        if (!found_match) {
-            int new_code_overlay = N64RSPDYNAREC->code_overlays_allocated;
-            if (new_code_overlay >= RSP_NUM_CODE_OVERLAYS) {
-                new_code_overlay = rand() % RSP_NUM_CODE_OVERLAYS;
-                logwarn("RSP: Out of code overlays! Selecting %d randomly", new_code_overlay);
-            } else {
-                N64RSPDYNAREC->code_overlays_allocated++;
-                logwarn("RSP: Allocated a new code overlay. Allocated %d so far.", N64RSPDYNAREC->code_overlays_allocated);
+        // If even the least recently used overlay was selected within the last round of switches, the game's microcodes
+        // don't all fit, and evicting would only recompile them over and over.
+        bool thrashing = dynarec->overlay_clock - dynarec->code_overlays[lru].last_used <= (u64)dynarec->code_overlays_capacity;
+        if (thrashing && dynarec->code_overlays_capacity < RSP_MAX_CODE_OVERLAYS) {
+            int capacity = dynarec->code_overlays_capacity * 2;
+            if (capacity > RSP_MAX_CODE_OVERLAYS) {
+                capacity = RSP_MAX_CODE_OVERLAYS;
+            }
+            rsp_code_overlay_t* code_overlays = realloc(dynarec->code_overlays, capacity * sizeof(rsp_code_overlay_t));
+            if (code_overlays == NULL) {
+                logfatal("Failed to grow the RSP code overlays to %d", capacity);
             }
-            reset_rsp_dynarec_code_overlay(&N64RSPDYNAREC->code_overlays[new_code_overlay]);
-            N64RSPDYNAREC->selected_code_overlay = new_code_overlay;
+            dynarec->code_overlays = code_overlays;
+            dynarec->code_overlays_capacity = capacity;
+            logwarn("RSP: Out of code overlays, growing to %d", capacity);
+        } else {
+            for (int i = 0; i < RSP_OVERLAY_HASH_TABLE_SIZE; i++) {
+                if (dynarec->overlay_hashes[i].overlay == lru) {
+                    dynarec->overlay_hashes[i].overlay = -1;
+                }
+            }
+            reset_rsp_dynarec_code_overlay(&dynarec->code_overlays[lru]);
+            logwarn("RSP: Out of code overlays! Evicting %d, the least recently used", lru);
+            return lru;
         }
+    }
+
+    int index = dynarec->code_overlays_allocated++;
+    reset_rsp_dynarec_code_overlay(&dynarec->code_overlays[index]);
+    logwarn("RSP: Allocated a new code overlay. Allocated %d so far.", dynarec->code_overlays_allocated);
+    return index;
+}
+
+int find_code_overlay() {
+    // The overlay last used with the same IMEM is almost always the right one. It still has to be checked, since code
+    // from other microcodes can have been compiled into it since.
+    rsp_overlay_hash_entry_t* entry = get_overlay_hash_entry(N64RSPDYNAREC->imem_hash);
+    if (entry->overlay >= 0 && entry->imem_hash == N64RSPDYNAREC->imem_hash && code_overlay_matches(entry->overlay)) {
+        return entry->overlay;
+    }
+
+    // Only the parts of IMEM that were compiled have to match, so an overlay can still be used with IMEM that hashes
+    // differently. Only happens the first time these IMEM contents are seen.
+    for (int i = 0; i < N64RSPDYNAREC->code_overlays_allocated; i++) {
+        if (code_overlay_matches(i)) {
+            return i;
+        }
+    }
+
+    return new_code_overlay();
+}
+
+int rsp_dynarec_step() {
+    if (N64RSPDYNAREC->dirty) {
+        int overlay = find_code_overlay();
+        N64RSPDYNAREC->selected_code_overlay = overlay;
+        N64RSPDYNAREC->code_overlays[overlay].last_used = ++N64RSPDYNAREC->overlay_clock;
+
+        rsp_overlay_hash_entry_t* entry = get_overlay_hash_entry(N64RSPDYNAREC->imem_hash);
+        entry->imem_hash = N64RSPDYNAREC->imem_hash;
+        entry->overlay = overlay;
+
         N64RSPDYNAREC->dirty = false;
     }
 
@@ -6,8 +6,11 @@
 
 // the same size as IMEM
 #define RSP_BLOCKCACHE_SIZE (0x1000 / 4)
-// TODO tune - games i've tested seem to use 8-10
-#define RSP_NUM_CODE_OVERLAYS 20
+// Overlays are added as games switch between more microcodes. Games i've tested seem to use 8-10
+#define RSP_MIN_CODE_OVERLAYS 8
+#define RSP_MAX_CODE_OVERLAYS 64
+// Must be a power of 2
+#define RSP_OVERLAY_HASH_TABLE_SIZE 256
 
 typedef struct rsp rsp_t;
 
@@ -23,20 +26,54 @@ typedef struct rsp_code_overlay {
     u32 code[RSP_BLOCKCACHE_SIZE];
     // Mapping of index -> executable block
     rsp_dynarec_block_t blockcache[RSP_BLOCKCACHE_SIZE];
+    // overlay_clock when this overlay was last selected, the least recently used overlay is the one evicted
+    u64 last_used;
 } rsp_code_overlay_t;
 
+typedef struct rsp_overlay_hash_entry {
+    u64 imem_hash;
+    int overlay; // -1 if unused
+} rsp_overlay_hash_entry_t;
+
 typedef struct rsp_dynarec {
     u8* codecache;
     u64 codecache_size;
     u64 codecache_used;
 
-    rsp_code_overlay_t code_overlays[RSP_NUM_CODE_OVERLAYS];
+    rsp_code_overlay_t* code_overlays;
+    int code_overlays_capacity;
     int selected_code_overlay;
     int code_overlays_allocated;
+    u64 overlay_clock;
     bool dirty;
+
+    // Sum of rsp_imem_word_hash() over all of IMEM, kept up to date as IMEM is written, so switching back to a microcode
+    // that was seen before can find its overlay without comparing it against every overlay.
+    u64 imem_hash;
+    // IMEM as of the last update of the hash, to take the old words back out of it
+    u32 hashed_imem[RSP_BLOCKCACHE_SIZE];
+    // Which overlay was last used with IMEM that had this hash, indexed by the low bits of the hash
+    rsp_overlay_hash_entry_t overlay_hashes[RSP_OVERLAY_HASH_TABLE_SIZE];
 } rsp_dynarec_t;
 
+INLINE u64 rsp_imem_word_hash(int index, u32 word) {
+    u64 x = ((u64)index << 32) | word;
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDull;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+INLINE void rsp_dynarec_imem_word_written(rsp_dynarec_t* dynarec, int index, u32 word) {
+    dynarec->imem_hash += rsp_imem_word_hash(index, word) - rsp_imem_word_hash(index, dynarec->hashed_imem[index]);
+    dynarec->hashed_imem[index] = word;
+}
+
 void reset_rsp_dynarec_code_overlays(rsp_dynarec_t* dynarec);
+// For when IMEM was changed without going through invalidate_rsp_icache()
+void rsp_dynarec_rehash_imem(rsp_dynarec_t* dynarec);
 rsp_dynarec_t* rsp_dynarec_init(u8* codecache, size_t codecache_size);
 int rsp_dynarec_step();
 int rsp_missing_block_handler();
@@ -4,13 +4,13 @@
 #include "v1_compiler.h"
 #include "v1_emitter.h"
 
-void* v1_link_and_encode(dasm_State** d, size_t* code_size_result) {
+void* v1_link_and_encode(dasm_State** d, size_t* code_size_result, u32 physical_address) {
     size_t code_size;
     dasm_link(d, &code_size);
 #ifdef N64_LOG_COMPILATIONS
     printf("Generated %ld bytes of code\n", code_size);
 #endif
-    void* buf = dynarec_bumpalloc(code_size);
+    void* buf = dynarec_alloc_code(code_size, physical_address);
     dasm_encode(d, buf);
 
     if (code_size_result) {
@@ -145,8 +145,9 @@ bool branch_is_loop(mips_instruction_t instr, u32 block_length) {
     }
 }
 
-void v1_compile_new_block(n64_dynarec_block_t* block, bool* code_mask, u64 virtual_address, u32 physical_address) {
+void v1_compile_new_block(n64_dynarec_block_t* block, n64_dynarec_page_t* page, u64 virtual_address, u32 physical_address) {
     dasm_State** Dst = v1_block_header();
+    u32 block_physical_address = physical_address;
 
     memset(guest_reg_loaded, 0, sizeof(guest_reg_loaded));
     memset(host_reg_used, 0, sizeof(host_reg_used));
@@ -171,7 +172,7 @@ void v1_compile_new_block(n64_dynarec_block_t* block, bool* code_mask, u64 virtu
         mips_instruction_t instr;
         instr.raw = n64_read_physical_word(physical_address);
 
-        code_mask[BLOCKCACHE_INNER_INDEX(physical_address)] = true;
+        mark_code(page, physical_address);
 
         block_is_stable &= instruction_stable(instr);
 
@@ -323,7 +324,7 @@ void v1_compile_new_block(n64_dynarec_block_t* block, bool* code_mask, u64 virtu
     flush_all(Dst);
     end_block(Dst, block_length + block_extra_cycles);
     size_t code_size;
-    void* compiled = v1_link_and_encode(Dst, &code_size);
+    void* compiled = v1_link_and_encode(Dst, &code_size, block_physical_address);
     v1_dasm_free();
 
     block->run = compiled;
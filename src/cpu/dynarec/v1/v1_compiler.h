@@ -24,7 +24,7 @@ typedef struct dynarec_ir {
 } dynarec_ir_t;
 
 
-void v1_compile_new_block(n64_dynarec_block_t* block, bool* code_mask, u64 virtual_address, u32 physical_address);
+void v1_compile_new_block(n64_dynarec_block_t* block, n64_dynarec_page_t* page, u64 virtual_address, u32 physical_address);
 void v1_compiler_init();
 
 #endif // N64_V1_COMPILER_H
\ No newline at end of file
@@ -142,8 +142,11 @@ INLINE dynarec_instruction_category_t cp1_instruction_category(mips_instruction_
             case COP_DMF:
             case COP_MT:
             case COP_DMT:
-            case COP_CT:
                 return NORMAL;
+            case COP_CT:
+                // Float ops are compiled for the rounding mode the block was entered with, so a write to FCR31 has to be
+                // the last thing in it
+                return instr.r.rd == 31 ? BLOCK_ENDER : NORMAL;
             case COP_BC:
                 switch (instr.r.rt) {
                     case COP_BC_BCT:
@@ -163,7 +166,7 @@ INLINE dynarec_instruction_category_t cp1_instruction_category(mips_instruction_
     logfatal("Did not match any instructions.");
 }
 
-dynarec_instruction_category_t instr_category(mips_instruction_t instr) {
+INLINE dynarec_instruction_category_t instr_category(mips_instruction_t instr) {
     if (unlikely(instr.raw == 0)) {
         return NORMAL;
     }
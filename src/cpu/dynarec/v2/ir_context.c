@@ -4,7 +4,7 @@
 #include "ir_context.h"
 #include "ir_optimizer.h"
 
-ir_context_t ir_context;
+N64_THREAD_LOCAL ir_context_t* ir_context_ptr = NULL;
 
 void ir_context_reset() {
     for (int i = 0; i < 64; i++) {
@@ -39,6 +39,16 @@ void ir_context_reset() {
     ir_context.block_end_pc_ir_emitted = false;
 
     ir_context.cp1_checked = false;
+
+    ir_context.sysconfig_written = false;
+    ir_context.count_accessed = false;
+    ir_context.busy_wait = false;
+    ir_context.sysconfig.raw = 0;
+    ir_context.num_exit_pc_targets = 0;
+    ir_context.num_hoisted_guest_reg_loads = 0;
+
+    ir_context.trace_branch = false;
+    ir_context.trace_branch_condition = NULL;
 }
 
 const char* val_type_to_str(ir_value_type_t type) {
@@ -846,6 +856,10 @@ ir_instruction_t* ir_emit_tlb_lookup(int index, ir_instruction_t* virtual_addres
     instruction.type = IR_TLB_LOOKUP;
     instruction.tlb_lookup.virtual_address = virtual_address;
     instruction.tlb_lookup.bus_access = bus_access;
+    instruction.tlb_lookup.mode = TLB_LOOKUP_ANY_MODE;
+    if (ir_context.sysconfig.kernel_mode && !ir_context.sysconfig_written) {
+        instruction.tlb_lookup.mode = ir_context.sysconfig.addressing_64bit ? TLB_LOOKUP_KERNEL_64BIT : TLB_LOOKUP_KERNEL_32BIT;
+    }
     return append_ir_instruction(instruction, index, guest_reg);
 }
 
@@ -3,9 +3,12 @@
 
 #include <util.h>
 #include <cpu/r4300i.h>
+#include <cpu/dynarec/dynarec.h>
 
 // Number of IR instructions that can be cached per block. 4x the max number of instructions per block - should be safe.
 #define IR_CACHE_SIZE 4096
+// Open addressed hash table of values available for common subexpression elimination
+#define IR_CSE_TABLE_SIZE (IR_CACHE_SIZE * 2)
 
 #define IR_GPR_BASE 0
 #define IR_FGR_BASE 32
@@ -67,6 +70,13 @@ typedef enum ir_float_convert_mode {
     FLOAT_CONVERT_MODE_FLOOR,
 } ir_float_convert_mode_t;
 
+// How a TLB lookup translates addresses, picked from the addressing mode the block is compiled for
+typedef enum ir_tlb_lookup_mode {
+    TLB_LOOKUP_ANY_MODE, // JIT TLB, then resolve_virtual_address_for_jit()
+    TLB_LOOKUP_KERNEL_32BIT, // KSEG0 and KSEG1 are translated inline, everything else as above
+    TLB_LOOKUP_KERNEL_64BIT // CKSEG0 and CKSEG1 are translated inline, everything else as above
+} ir_tlb_lookup_mode_t;
+
 typedef enum ir_shift_direction {
     SHIFT_DIRECTION_LEFT,
     SHIFT_DIRECTION_RIGHT
@@ -289,6 +299,7 @@ typedef struct ir_instruction {
         struct {
             struct ir_instruction* virtual_address;
             bus_access_t bus_access;
+            ir_tlb_lookup_mode_t mode;
         } tlb_lookup;
         struct {
             u8 guest_reg;
@@ -360,7 +371,7 @@ typedef struct ir_instruction {
     } cond_exception;
 } ir_instruction_t;
 
-typedef struct ir_context {
+typedef struct ir_context_state {
     /*
      * Maps a guest register to the SSA value currently in it, as of the current context
      * 0-31  - GPR
@@ -383,9 +394,37 @@ typedef struct ir_context {
     bool block_ended;
 
     bool cp1_checked;
+
+    // Writes to CP0 status or FCR31 can change the sysconfig and addressing mode, so blocks containing them are never linked
+    // out of
+    bool sysconfig_written;
+    // The block is only ever entered with this sysconfig, so until something in it writes to CP0 status or FCR31, the
+    // modes in here are known at compile time
+    n64_block_sysconfig_t sysconfig;
+    // COUNT is only synced by the dispatcher, so blocks touching it must always be entered from there
+    bool count_accessed;
+    // The block is a loop that can't see anything change until the next scheduler event, see detect_busy_wait_loop()
+    bool busy_wait;
+    // Constant pcs the block can exit to, for block linking
+    u64 exit_pc_targets[MAX_BLOCK_EXIT_LINKS];
+    int num_exit_pc_targets;
+
+    // Set while emitting a branch a superblock keeps going past. Instead of setting the exit pc, the branch leaves its
+    // condition here (NULL if there's nothing left to check after the delay slot).
+    bool trace_branch;
+    ir_instruction_t* trace_branch_condition;
+
+    // Loads of guest GPRs ir_optimize_hoist_guest_reg_loads() moved to the start of the block
+    int num_hoisted_guest_reg_loads;
+
+    // Scratch space for ir_optimize_common_subexpressions(). Value numbers are indexed by instruction index.
+    ir_instruction_t* cse_value_numbers[IR_CACHE_SIZE];
+    ir_instruction_t* cse_available[IR_CSE_TABLE_SIZE];
 } ir_context_t;
 
-extern ir_context_t ir_context;
+// Each compiler instance has its own context, bound per thread by v2_compiler_bind_instance()
+extern N64_THREAD_LOCAL ir_context_t* ir_context_ptr;
+#define ir_context (*ir_context_ptr)
 
 void ir_context_reset();
 void ir_instr_to_string(ir_instruction_t* instr, char* buf, size_t buf_size);
@@ -397,6 +436,8 @@ void print_ir_block();
 bool instr_exception_possible(ir_instruction_t* instr);
 // Update a guest reg to point at a new value. Mostly used internally.
 void update_guest_reg_mapping(u8 guest_reg, ir_instruction_t* value);
+// Insert an instruction that can't cause an exception after another one. Used by the optimizer.
+ir_instruction_t* insert_ir_instruction(ir_instruction_t* after, ir_instruction_t instruction);
 // Emit a constant to the IR, optionally associating it with a guest register.
 ir_instruction_t* ir_emit_set_constant(ir_set_constant_t value, u8 guest_reg);
 // Load a guest GPR, or return a reference to it if it's already loaded.
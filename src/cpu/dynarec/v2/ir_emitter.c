@@ -22,12 +22,22 @@ ir_instruction_t* ir_get_memory_access_address(int index, mips_instruction_t ins
 }
 
 void ir_emit_conditional_branch(ir_instruction_t* condition, s16 offset, u64 virtual_address) {
+    if (ir_context.trace_branch) {
+        ir_context.trace_branch_condition = condition;
+        return;
+    }
     ir_instruction_t* pc_if_false = ir_emit_set_constant_64(virtual_address + 8, NO_GUEST_REG); // Account for instruction in delay slot
     ir_instruction_t* pc_if_true = ir_emit_set_constant_64(virtual_address + 4 + (s64)offset * 4, NO_GUEST_REG);
     ir_emit_conditional_set_block_exit_pc(condition, pc_if_true, pc_if_false);
 }
 
 void ir_emit_conditional_branch_likely(ir_instruction_t* condition, s16 offset, u64 virtual_address, int index) {
+    if (ir_context.trace_branch) {
+        // Superblocks only follow likely branches when taken, so leave right away if not, skipping the delay slot
+        ir_instruction_t* pc_if_false = ir_emit_set_constant_64(virtual_address + 8, NO_GUEST_REG);
+        ir_emit_conditional_block_exit_address(index, ir_emit_boolean_not(condition, NO_GUEST_REG), pc_if_false);
+        return;
+    }
     // Identical - ir_emit_conditional_branch already skips the delay slot when calculating the exit PC.
     ir_emit_conditional_branch(condition, offset, virtual_address);
     // The only difference is likely branches conditionally exit the block early when not taken.
@@ -35,6 +45,9 @@ void ir_emit_conditional_branch_likely(ir_instruction_t* condition, s16 offset,
 }
 
 void ir_emit_abs_branch(ir_instruction_t* address) {
+    if (ir_context.trace_branch) {
+        return; // only constant targets are followed, so it's already known where this goes
+    }
     ir_emit_set_block_exit_pc(address);
 }
 
@@ -196,7 +209,7 @@ IR_EMITTER(sc) {
 
     ir_instruction_t* llbit_not_set = ir_emit_boolean_not(llbit_set, NO_GUEST_REG);
 
-    ir_instruction_t* block_end_pc = ir_emit_set_constant_64(ir_context.block_start_virtual + (index << 2) + 4, NO_GUEST_REG);
+    ir_instruction_t* block_end_pc = ir_emit_set_constant_64(virtual_address + 4, NO_GUEST_REG);
     ir_emit_conditional_block_exit_address(index, llbit_not_set, block_end_pc); // if llbit is not set: rt should be set to 0 and no other operations should take place
 
     ir_emit_store(VALUE_TYPE_U32, physical, value);
@@ -215,7 +228,7 @@ IR_EMITTER(scd) {
 
     ir_instruction_t* llbit_not_set = ir_emit_boolean_not(llbit_set, NO_GUEST_REG);
 
-    ir_instruction_t* block_end_pc = ir_emit_set_constant_64(ir_context.block_start_virtual + (index << 2) + 4, NO_GUEST_REG);
+    ir_instruction_t* block_end_pc = ir_emit_set_constant_64(virtual_address + 4, NO_GUEST_REG);
     ir_emit_conditional_block_exit_address(index, llbit_not_set, block_end_pc); // if llbit is not set: rt should be set to 0 and no other operations should take place
 
     ir_emit_store(VALUE_TYPE_U64, physical, value);
@@ -860,6 +873,7 @@ IR_EMITTER(mtc0) {
             ir_instruction_t* value_shifted = ir_emit_shift(value_u32, shift_amount, VALUE_TYPE_U32, SHIFT_DIRECTION_LEFT, NO_GUEST_REG);
             ir_emit_set_ptr(VALUE_TYPE_U64, &N64CP0.count, value_shifted);
             ir_emit_call_1((uintptr_t)&reschedule_compare_interrupt, ir_emit_set_constant_u32(index, NO_GUEST_REG));
+            ir_context.count_accessed = true;
             break;
         }
         case R4300I_CP0_REG_CAUSE: {
@@ -883,6 +897,7 @@ IR_EMITTER(mtc0) {
                                     NO_GUEST_REG));
             ir_emit_set_ptr(VALUE_TYPE_U32, &N64CP0.compare, value);
             ir_emit_call_1((uintptr_t)&reschedule_compare_interrupt, ir_emit_set_constant_u32(index, NO_GUEST_REG));
+            ir_context.count_accessed = true;
             break;
         }
         case R4300I_CP0_REG_STATUS: {
@@ -894,6 +909,7 @@ IR_EMITTER(mtc0) {
             ir_instruction_t* new_status = ir_emit_or(value_masked, old_status_masked, NO_GUEST_REG);
             ir_emit_set_ptr(VALUE_TYPE_U32, &N64CP0.status.raw, new_status);
             ir_emit_call_0((uintptr_t)cp0_status_updated);
+            ir_context.sysconfig_written = true;
             break;
         }
         case R4300I_CP0_REG_ENTRYLO0: {
@@ -913,6 +929,7 @@ IR_EMITTER(mtc0) {
             ir_instruction_t* value_sign_extended = ir_emit_mask_and_cast(value, VALUE_TYPE_S32, NO_GUEST_REG);
             ir_instruction_t* masked = ir_emit_and(value_sign_extended, mask, NO_GUEST_REG);
             ir_emit_set_ptr(VALUE_TYPE_U64, &N64CP0.entry_hi.raw, masked);
+            ir_emit_call_0((uintptr_t)cp0_entry_hi_updated);
             break;
         }
         case R4300I_CP0_REG_PAGEMASK: {
@@ -1021,20 +1038,24 @@ IR_EMITTER(dmtc0) {
         case R4300I_CP0_REG_COUNT:
             logfatal("dmtc0 R4300I_CP0_REG_COUNT");
             ir_emit_call_1((uintptr_t)&reschedule_compare_interrupt, ir_emit_set_constant_u32(index, NO_GUEST_REG));
+            ir_context.count_accessed = true;
             break;
         case R4300I_CP0_REG_ENTRYHI: {
             ir_instruction_t* mask = ir_emit_set_constant_64(CP0_ENTRY_HI_WRITE_MASK, NO_GUEST_REG);
             ir_instruction_t* masked = ir_emit_and(value, mask, NO_GUEST_REG);
             ir_emit_set_ptr(VALUE_TYPE_U64, &N64CP0.entry_hi.raw, masked);
+            ir_emit_call_0((uintptr_t)cp0_entry_hi_updated);
             break;
         }
         case R4300I_CP0_REG_COMPARE:
             logfatal("dmtc0 R4300I_CP0_REG_COMPARE");
             ir_emit_call_1((uintptr_t)&reschedule_compare_interrupt, ir_emit_set_constant_u32(index, NO_GUEST_REG));
+            ir_context.count_accessed = true;
             break;
         case R4300I_CP0_REG_STATUS:
             logfatal("dmtc0 R4300I_CP0_REG_STATUS");
             ir_emit_call_0((uintptr_t)cp0_status_updated);
+            ir_context.sysconfig_written = true;
             break;
         case R4300I_CP0_REG_CAUSE:
             logfatal("dmtc0 R4300I_CP0_REG_CAUSE");
@@ -1105,6 +1126,7 @@ IR_EMITTER(dmtc0) {
 IR_EMITTER(eret) {
     ir_emit_eret();
     ir_emit_call_0((uintptr_t)cp0_status_updated);
+    ir_context.sysconfig_written = true;
 }
 
 ir_instruction_t* ir_cp0_get_index(u8 guest_reg) {
@@ -1212,6 +1234,7 @@ IR_EMITTER(mfc0) {
         case R4300I_CP0_REG_RANDOM: logfatal("emit MFC0 R4300I_CP0_REG_RANDOM");
         case R4300I_CP0_REG_COUNT: {
             ir_instruction_t* count = ir_emit_get_ptr(VALUE_TYPE_U64, &N64CP0.count, NO_GUEST_REG);
+            ir_context.count_accessed = true;
             ir_instruction_t* adjusted = ir_emit_add(count, ir_emit_set_constant_u32(index, NO_GUEST_REG), NO_GUEST_REG);
             ir_instruction_t* shifted = ir_emit_shift(adjusted, ir_emit_set_constant_u16(1, NO_GUEST_REG), VALUE_TYPE_U64, SHIFT_DIRECTION_RIGHT, NO_GUEST_REG);
             ir_emit_mask_and_cast(shifted, VALUE_TYPE_S32, instruction.r.rt);
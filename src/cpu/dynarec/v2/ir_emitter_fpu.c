@@ -20,6 +20,10 @@ void flush_if_reg_set(u8 reg) {
 #define CVT(from, to, mode) case FP_FMT_##from: emit_ir_cvt(index, instruction, FLOAT_VALUE_TYPE_##from, FLOAT_VALUE_TYPE_##to, FLOAT_CONVERT_MODE_##mode); break
 
 IR_EMITTER(check_cp1) {
+    // Blocks compiled with the FPU usable don't need to check, unless they change CP0 status before getting here
+    if (ir_context.sysconfig.cp1_usable && !ir_context.sysconfig_written) {
+        ir_context.cp1_checked = true;
+    }
     // Only emit this check once per block.
     if (!ir_context.cp1_checked) {
         ir_instruction_t* mask = ir_emit_set_constant_u32(STATUS_CU1_MASK, NO_GUEST_REG);
@@ -98,6 +102,9 @@ IR_EMITTER(ctc1) {
             ir_instruction_t* mask = ir_emit_set_constant_u32(0x183ffff, NO_GUEST_REG);
             ir_instruction_t* masked = ir_emit_and(mask, value, NO_GUEST_REG);
             ir_emit_set_ptr(VALUE_TYPE_U32, &N64CPU.fcr31.raw, masked);
+            ir_emit_call_0((uintptr_t)fcr31_updated);
+            // The rounding mode might have changed. This also ends the block, see cp1_instruction_category().
+            ir_context.sysconfig_written = true;
             break;
         }
         default:
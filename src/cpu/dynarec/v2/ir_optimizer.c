@@ -1,21 +1,22 @@
 #include <log.h>
 #include <string.h>
 #include <mem/n64bus.h>
+#include <mips_instructions.h>
 #include "ir_optimizer.h"
 #include "target_platform.h"
+#include "register_allocator.h"
 
-bool instr_uses_value(ir_instruction_t* instr, ir_instruction_t* value) {
+void ir_visit_operands(ir_instruction_t* instr, void (*visit)(ir_instruction_t* operand, void* data), void* data) {
     for (int i = 0; i < instr->flush_info.num_regs; i++) {
-        if (instr->flush_info.regs[i].item == value) {
-            return true;
-        }
+        visit(instr->flush_info.regs[i].item, data);
     }
 
     switch (instr->type) {
         // Unary ops
         case IR_SET_BLOCK_EXIT_PC:
         case IR_NOT:
-            return instr->unary_op.operand == value;
+            visit(instr->unary_op.operand, data);
+            return;
 
         // Bin ops
         case IR_OR:
@@ -23,72 +24,90 @@ bool instr_uses_value(ir_instruction_t* instr, ir_instruction_t* value) {
         case IR_ADD:
         case IR_SUB:
         case IR_XOR:
-            return instr->bin_op.operand1 == value || instr->bin_op.operand2 == value;
+            visit(instr->bin_op.operand1, data);
+            visit(instr->bin_op.operand2, data);
+            return;
 
         // Other
         case IR_MASK_AND_CAST:
-            return instr->mask_and_cast.operand == value;
+            visit(instr->mask_and_cast.operand, data);
+            return;
         case IR_CHECK_CONDITION:
-            return instr->check_condition.operand1 == value || instr->check_condition.operand2 == value;
+            visit(instr->check_condition.operand1, data);
+            visit(instr->check_condition.operand2, data);
+            return;
         case IR_TLB_LOOKUP:
-            return instr->tlb_lookup.virtual_address == value;
+            visit(instr->tlb_lookup.virtual_address, data);
+            return;
         case IR_SHIFT:
-            return instr->shift.operand == value || instr->shift.amount == value;
+            visit(instr->shift.operand, data);
+            visit(instr->shift.amount, data);
+            return;
         case IR_STORE:
-            return instr->store.address == value || instr->store.value == value;
+            visit(instr->store.address, data);
+            visit(instr->store.value, data);
+            return;
         case IR_LOAD:
-            return instr->load.address == value;
+            visit(instr->load.address, data);
+            return;
         case IR_SET_COND_BLOCK_EXIT_PC:
-            return instr->set_cond_exit_pc.condition == value || instr->set_cond_exit_pc.pc_if_true == value || instr->set_cond_exit_pc.pc_if_false == value;
+            visit(instr->set_cond_exit_pc.condition, data);
+            visit(instr->set_cond_exit_pc.pc_if_true, data);
+            visit(instr->set_cond_exit_pc.pc_if_false, data);
+            return;
         case IR_FLUSH_GUEST_REG:
-            return instr->flush_guest_reg.value == value;
-        case IR_COND_BLOCK_EXIT: {
-            if (instr->cond_block_exit.condition == value) {
-                return true;
-            }
+            visit(instr->flush_guest_reg.value, data);
+            return;
+        case IR_COND_BLOCK_EXIT:
+            visit(instr->cond_block_exit.condition, data);
             switch (instr->cond_block_exit.type) {
                 case COND_BLOCK_EXIT_TYPE_NONE:
                 case COND_BLOCK_EXIT_TYPE_EXCEPTION:
                     break;
                 case COND_BLOCK_EXIT_TYPE_ADDRESS:
-                    if (instr->cond_block_exit.info.exit_pc == value) {
-                        return true;
-                    }
+                    visit(instr->cond_block_exit.info.exit_pc, data);
                     break;
             }
-            return false;
-        }
+            return;
         case IR_MULTIPLY:
         case IR_DIVIDE:
-            return instr->mult_div.operand1 == value || instr->mult_div.operand2 == value;
+            visit(instr->mult_div.operand1, data);
+            visit(instr->mult_div.operand2, data);
+            return;
         case IR_SET_PTR:
-            return instr->set_ptr.value == value;
+            visit(instr->set_ptr.value, data);
+            return;
         case IR_MOV_REG_TYPE:
-            return instr->mov_reg_type.value == value;
+            visit(instr->mov_reg_type.value, data);
+            return;
         case IR_FLOAT_CONVERT:
-            return instr->float_convert.value == value;
+            visit(instr->float_convert.value, data);
+            return;
         case IR_FLOAT_CHECK_CONDITION:
-            return instr->float_check_condition.operand1 == value || instr->float_check_condition.operand2 == value;
+            visit(instr->float_check_condition.operand1, data);
+            visit(instr->float_check_condition.operand2, data);
+            return;
         case IR_CALL:
             for (int i = 0; i < instr->call.num_args; i++) {
-                if (instr->call.arguments[i] == value) {
-                    return true;
-                }
+                visit(instr->call.arguments[i], data);
             }
-            return false;
+            return;
 
         // Float bin ops
         case IR_FLOAT_DIVIDE:
         case IR_FLOAT_MULTIPLY:
         case IR_FLOAT_ADD:
         case IR_FLOAT_SUB:
-            return instr->float_bin_op.operand1 == value || instr->float_bin_op.operand2 == value;
+            visit(instr->float_bin_op.operand1, data);
+            visit(instr->float_bin_op.operand2, data);
+            return;
 
         // Float unary ops
         case IR_FLOAT_SQRT:
         case IR_FLOAT_ABS:
         case IR_FLOAT_NEG:
-            return instr->float_unary_op.operand == value;
+            visit(instr->float_unary_op.operand, data);
+            return;
 
         // No dependencies
         case IR_ERET:
@@ -98,11 +117,29 @@ bool instr_uses_value(ir_instruction_t* instr, ir_instruction_t* value) {
         case IR_SET_FLOAT_CONSTANT:
         case IR_LOAD_GUEST_REG:
         case IR_INTERPRETER_FALLBACK:
-            return false;
+            return;
     }
     logfatal("Did not match any cases");
 }
 
+typedef struct value_search {
+    ir_instruction_t* value;
+    bool found;
+} value_search_t;
+
+static void check_operand(ir_instruction_t* operand, void* data) {
+    value_search_t* search = data;
+    if (operand == search->value) {
+        search->found = true;
+    }
+}
+
+bool instr_uses_value(ir_instruction_t* instr, ir_instruction_t* value) {
+    value_search_t search = { .value = value, .found = false };
+    ir_visit_operands(instr, check_operand, &search);
+    return search.found;
+}
+
 u32 set_const_to_u32(ir_set_constant_t constant) {
     return (u32)(set_const_to_u64(constant) & 0xFFFFFFFF);
 }
@@ -168,6 +205,389 @@ u64 float_const_to_u64(ir_instruction_t* constant) {
     return set_float_const_to_u64(constant->set_float_constant);
 }
 
+u64 mask_and_cast_constant(u64 value, ir_value_type_t type) {
+    switch (type) {
+        case VALUE_TYPE_S8:
+            return (s64)(s8)(value & 0xFF);
+        case VALUE_TYPE_U8:
+            return value & 0xFF;
+        case VALUE_TYPE_S16:
+            return (s64)(s16)(value & 0xFFFF);
+        case VALUE_TYPE_U16:
+            return value & 0xFFFF;
+        case VALUE_TYPE_S32:
+            return (s64)(s32)(value & 0xFFFFFFFF);
+        case VALUE_TYPE_U32:
+            return value & 0xFFFFFFFF;
+        case VALUE_TYPE_U64:
+        case VALUE_TYPE_S64:
+            return value;
+    }
+    logfatal("Did not match any cases");
+}
+
+void ir_evaluate_const_multiply(ir_set_constant_t operand1, ir_set_constant_t operand2, ir_value_type_t type, u64* lo, u64* hi) {
+    switch (type) {
+        case VALUE_TYPE_U8:
+            logfatal("const VALUE_TYPE_U8 multiply");
+            break;
+        case VALUE_TYPE_S8:
+            logfatal("const VALUE_TYPE_S8 multiply");
+            break;
+        case VALUE_TYPE_S16:
+            logfatal("const VALUE_TYPE_S16 multiply");
+            break;
+        case VALUE_TYPE_U16:
+            logfatal("const VALUE_TYPE_U16 multiply");
+            break;
+        case VALUE_TYPE_S32: {
+            s64 multiplicand_1 = set_const_to_s32(operand1);
+            s64 multiplicand_2 = set_const_to_s32(operand2);
+
+            s64 result = multiplicand_1 * multiplicand_2;
+
+            s32 result_lower = result & 0xFFFFFFFF;
+            s32 result_upper = (result >> 32) & 0xFFFFFFFF;
+
+            *lo = (s64)result_lower;
+            *hi = (s64)result_upper;
+            break;
+        }
+        case VALUE_TYPE_U32: {
+            u64 multiplicand_1 = set_const_to_u32(operand1);
+            u64 multiplicand_2 = set_const_to_u32(operand2);
+
+            u64 result = multiplicand_1 * multiplicand_2;
+
+            s32 result_lower = result & 0xFFFFFFFF;
+            s32 result_upper = (result >> 32) & 0xFFFFFFFF;
+
+            *lo = (s64)result_lower;
+            *hi = (s64)result_upper;
+            break;
+        }
+        case VALUE_TYPE_U64:
+            *lo = multu_64_to_128(set_const_to_u64(operand1), set_const_to_u64(operand2), hi);
+            break;
+        case VALUE_TYPE_S64: {
+            *lo = mult_64_to_128(set_const_to_s64(operand1), set_const_to_s64(operand2), hi);
+            break;
+        }
+    }
+}
+
+void ir_evaluate_const_divide(ir_set_constant_t operand_dividend, ir_set_constant_t operand_divisor, ir_value_type_t type, u64* result_quotient, u64* result_remainder) {
+    switch (type) {
+        case VALUE_TYPE_U8:
+            logfatal("const VALUE_TYPE_U8 divide");
+            break;
+        case VALUE_TYPE_S8:
+            logfatal("const VALUE_TYPE_S8 divide");
+            break;
+        case VALUE_TYPE_S16:
+            logfatal("const VALUE_TYPE_S16 divide");
+            break;
+        case VALUE_TYPE_U16:
+            logfatal("const VALUE_TYPE_U16 divide");
+            break;
+        case VALUE_TYPE_S32: {
+            s64 dividend = set_const_to_s32(operand_dividend);
+            s64 divisor = set_const_to_s32(operand_divisor);
+
+            if (divisor == 0) {
+                logwarn("Divide by zero");
+                *result_remainder = dividend;
+                if (dividend >= 0) {
+                    *result_quotient = -1;
+                } else {
+                    *result_quotient = 1;
+                }
+            } else {
+                s32 quotient = dividend / divisor;
+                s32 remainder = dividend % divisor;
+
+                *result_quotient = quotient;
+                *result_remainder = remainder;
+            }
+            break;
+        }
+        case VALUE_TYPE_U32: {
+            u32 dividend = set_const_to_u32(operand_dividend);
+            u32 divisor  = set_const_to_u32(operand_divisor);
+
+            if (divisor == 0) {
+                *result_quotient = 0xFFFFFFFFFFFFFFFF;
+                *result_remainder = (s32)dividend;
+            } else {
+                s32 quotient  = dividend / divisor;
+                s32 remainder = dividend % divisor;
+
+                *result_quotient = quotient;
+                *result_remainder = remainder;
+            }
+            break;
+        }
+        case VALUE_TYPE_U64: {
+            u64 dividend = set_const_to_u64(operand_dividend);
+            u64 divisor  = set_const_to_u64(operand_divisor);
+
+            if (divisor == 0) {
+                *result_quotient = 0xFFFFFFFFFFFFFFFF;
+                *result_remainder = dividend;
+            } else {
+                u64 quotient  = dividend / divisor;
+                u64 remainder = dividend % divisor;
+
+                *result_quotient = quotient;
+                *result_remainder = remainder;
+            }
+            break;
+        }
+        case VALUE_TYPE_S64: {
+            s64 dividend = set_const_to_s64(operand_dividend);
+            s64 divisor  = set_const_to_s64(operand_divisor);
+
+            if (unlikely(divisor == 0)) {
+                logwarn("Divide by zero");
+                *result_remainder = dividend;
+                if (dividend >= 0) {
+                    *result_quotient = (s64)-1;
+                } else {
+                    *result_quotient = (s64)1;
+                }
+            } else if (unlikely(divisor == -1 && dividend == INT64_MIN)) {
+                *result_quotient = dividend;
+                *result_remainder = 0;
+            } else {
+                *result_quotient = (s64)(dividend / divisor);;
+                *result_remainder = (s64)(dividend % divisor);
+            }
+            break;
+        }
+    }
+}
+
+
+// Returns the base 2 log of a power of two, or -1 for anything else
+INLINE int power_of_two_exponent(u64 value) {
+    if (value == 0 || (value & (value - 1)) != 0) {
+        return -1;
+    }
+    return __builtin_ctzll(value);
+}
+
+INLINE ir_instruction_t* insert_before(ir_instruction_t* instr, ir_instruction_t new_instr) {
+    return insert_ir_instruction(instr->prev, new_instr);
+}
+
+static ir_instruction_t* insert_constant_before(ir_instruction_t* instr, u64 value) {
+    ir_instruction_t constant;
+    constant.type = IR_SET_CONSTANT;
+    constant.set_constant.type = VALUE_TYPE_U64;
+    constant.set_constant.value_u64 = value;
+    return insert_before(instr, constant);
+}
+
+static ir_instruction_t* insert_shift_before(ir_instruction_t* instr, ir_instruction_t* operand, int amount, ir_value_type_t type, ir_shift_direction_t direction) {
+    ir_instruction_t shift;
+    shift.type = IR_SHIFT;
+    shift.shift.operand = operand;
+    shift.shift.amount = insert_constant_before(instr, amount);
+    shift.shift.type = type;
+    shift.shift.direction = direction;
+    return insert_before(instr, shift);
+}
+
+static ir_instruction_t* insert_mask_and_cast_before(ir_instruction_t* instr, ir_instruction_t* operand, ir_value_type_t type) {
+    ir_instruction_t mask_and_cast;
+    mask_and_cast.type = IR_MASK_AND_CAST;
+    mask_and_cast.mask_and_cast.operand = operand;
+    mask_and_cast.mask_and_cast.type = type;
+    return insert_before(instr, mask_and_cast);
+}
+
+// type is IR_ADD, IR_SUB, IR_AND...
+static ir_instruction_t* insert_bin_op_before(ir_instruction_t* instr, int type, ir_instruction_t* operand1, ir_instruction_t* operand2) {
+    ir_instruction_t bin_op;
+    bin_op.type = type;
+    bin_op.bin_op.operand1 = operand1;
+    bin_op.bin_op.operand2 = operand2;
+    return insert_before(instr, bin_op);
+}
+
+// Turn a multiply or divide into writes of results computed by other instructions to LO and HI
+static void replace_with_lo_hi(ir_instruction_t* instr, ir_instruction_t* lo, ir_instruction_t* hi) {
+    instr->type = IR_SET_PTR;
+    instr->set_ptr.type = VALUE_TYPE_U64;
+    instr->set_ptr.ptr = (uintptr_t)&N64CPU.mult_lo;
+    instr->set_ptr.value = lo;
+
+    ir_instruction_t set_hi;
+    set_hi.type = IR_SET_PTR;
+    set_hi.set_ptr.type = VALUE_TYPE_U64;
+    set_hi.set_ptr.ptr = (uintptr_t)&N64CPU.mult_hi;
+    set_hi.set_ptr.value = hi;
+    insert_ir_instruction(instr, set_hi);
+}
+
+// Multiplies by zero or a power of two become shifts. Returns false if the multiply has to stay.
+static bool reduce_multiply(ir_instruction_t* instr) {
+    ir_instruction_t* value = instr->mult_div.operand1;
+    ir_instruction_t* multiplier = instr->mult_div.operand2;
+    if (is_constant(value)) {
+        value = instr->mult_div.operand2;
+        multiplier = instr->mult_div.operand1;
+    }
+    if (!is_constant(multiplier)) {
+        return false;
+    }
+
+    ir_value_type_t type = instr->mult_div.mult_div_type;
+    u64 constant = const_to_u64(multiplier);
+    if (type == VALUE_TYPE_S32 || type == VALUE_TYPE_U32) {
+        constant &= 0xFFFFFFFF;
+    }
+    if (constant == 0) {
+        ir_instruction_t* zero = insert_constant_before(instr, 0);
+        replace_with_lo_hi(instr, zero, zero);
+        return true;
+    }
+
+    int shift = power_of_two_exponent(constant);
+    ir_instruction_t* lo = NULL;
+    ir_instruction_t* hi = NULL;
+    switch (type) {
+        CASE_SIZE_8:
+        CASE_SIZE_16:
+            logfatal("Smaller than 32 bit multiply");
+            return false;
+        case VALUE_TYPE_S32: {
+            if (shift < 0 || shift > 30) { // 1 << 31 is negative
+                return false;
+            }
+            // The whole 64 bit product is exact, so HI is just its upper half
+            ir_instruction_t* product = insert_mask_and_cast_before(instr, value, VALUE_TYPE_S32);
+            if (shift > 0) {
+                product = insert_shift_before(instr, product, shift, VALUE_TYPE_U64, SHIFT_DIRECTION_LEFT);
+            }
+            lo = insert_mask_and_cast_before(instr, product, VALUE_TYPE_S32);
+            hi = insert_shift_before(instr, product, 32, VALUE_TYPE_S64, SHIFT_DIRECTION_RIGHT);
+            break;
+        }
+        case VALUE_TYPE_U32: {
+            if (shift < 0) {
+                return false;
+            }
+            ir_instruction_t* product = insert_mask_and_cast_before(instr, value, VALUE_TYPE_U32);
+            if (shift > 0) {
+                product = insert_shift_before(instr, product, shift, VALUE_TYPE_U64, SHIFT_DIRECTION_LEFT);
+            }
+            lo = insert_mask_and_cast_before(instr, product, VALUE_TYPE_S32);
+            ir_instruction_t* upper = insert_shift_before(instr, product, 32, VALUE_TYPE_U64, SHIFT_DIRECTION_RIGHT);
+            hi = insert_mask_and_cast_before(instr, upper, VALUE_TYPE_S32);
+            break;
+        }
+        case VALUE_TYPE_U64:
+            if (shift < 0) {
+                return false;
+            } else if (shift == 0) {
+                lo = value;
+                hi = insert_constant_before(instr, 0);
+            } else {
+                lo = insert_shift_before(instr, value, shift, VALUE_TYPE_U64, SHIFT_DIRECTION_LEFT);
+                hi = insert_shift_before(instr, value, 64 - shift, VALUE_TYPE_U64, SHIFT_DIRECTION_RIGHT);
+            }
+            break;
+        case VALUE_TYPE_S64:
+            if (shift < 0 || shift > 62) {
+                return false;
+            }
+            lo = shift == 0 ? value : insert_shift_before(instr, value, shift, VALUE_TYPE_U64, SHIFT_DIRECTION_LEFT);
+            // The bits shifted out, sign extended into the upper half of the 128 bit product
+            hi = insert_shift_before(instr, value, shift == 0 ? 63 : 64 - shift, VALUE_TYPE_S64, SHIFT_DIRECTION_RIGHT);
+            break;
+    }
+    replace_with_lo_hi(instr, lo, hi);
+    return true;
+}
+
+// Signed division rounds towards zero, so negative dividends get 2^shift - 1 added before the arithmetic shift
+static void signed_divide_by_power_of_two(ir_instruction_t* instr, ir_instruction_t* value, int shift, ir_instruction_t** quotient, ir_instruction_t** remainder) {
+    if (shift == 0) {
+        *quotient = value;
+        *remainder = insert_constant_before(instr, 0);
+        return;
+    }
+    ir_instruction_t* sign = insert_shift_before(instr, value, 63, VALUE_TYPE_S64, SHIFT_DIRECTION_RIGHT);
+    ir_instruction_t* bias = insert_shift_before(instr, sign, 64 - shift, VALUE_TYPE_U64, SHIFT_DIRECTION_RIGHT);
+    ir_instruction_t* biased = insert_bin_op_before(instr, IR_ADD, value, bias);
+    *quotient = insert_shift_before(instr, biased, shift, VALUE_TYPE_S64, SHIFT_DIRECTION_RIGHT);
+    ir_instruction_t* truncated = insert_shift_before(instr, *quotient, shift, VALUE_TYPE_U64, SHIFT_DIRECTION_LEFT);
+    *remainder = insert_bin_op_before(instr, IR_SUB, value, truncated);
+}
+
+// Divides by a positive power of two become shifts and masks. Other constant divisors are left to the backend.
+// Returns false if the divide has to stay.
+static bool reduce_divide(ir_instruction_t* instr) {
+    ir_instruction_t* dividend = instr->mult_div.operand1;
+    ir_instruction_t* divisor = instr->mult_div.operand2;
+    if (is_constant(dividend) || !is_constant(divisor)) {
+        return false;
+    }
+
+    ir_instruction_t* lo = NULL;
+    ir_instruction_t* hi = NULL;
+    switch (instr->mult_div.mult_div_type) {
+        CASE_SIZE_8:
+        CASE_SIZE_16:
+            logfatal("Smaller than 32 bit divide");
+            return false;
+        case VALUE_TYPE_S32: {
+            s32 constant = set_const_to_s32(divisor->set_constant);
+            int shift = constant > 0 ? power_of_two_exponent(constant) : -1;
+            if (shift < 0) {
+                return false;
+            }
+            // Both results fit in 32 bits, so they're already sign extended
+            ir_instruction_t* value = insert_mask_and_cast_before(instr, dividend, VALUE_TYPE_S32);
+            signed_divide_by_power_of_two(instr, value, shift, &lo, &hi);
+            break;
+        }
+        case VALUE_TYPE_U32: {
+            int shift = power_of_two_exponent(set_const_to_u32(divisor->set_constant));
+            if (shift < 0) {
+                return false;
+            }
+            ir_instruction_t* value = insert_mask_and_cast_before(instr, dividend, VALUE_TYPE_U32);
+            ir_instruction_t* quotient = shift == 0 ? value : insert_shift_before(instr, value, shift, VALUE_TYPE_U64, SHIFT_DIRECTION_RIGHT);
+            ir_instruction_t* remainder = insert_bin_op_before(instr, IR_AND, value, insert_constant_before(instr, (1ULL << shift) - 1));
+            lo = insert_mask_and_cast_before(instr, quotient, VALUE_TYPE_S32);
+            hi = insert_mask_and_cast_before(instr, remainder, VALUE_TYPE_S32);
+            break;
+        }
+        case VALUE_TYPE_U64: {
+            int shift = power_of_two_exponent(const_to_u64(divisor));
+            if (shift < 0) {
+                return false;
+            }
+            lo = shift == 0 ? dividend : insert_shift_before(instr, dividend, shift, VALUE_TYPE_U64, SHIFT_DIRECTION_RIGHT);
+            hi = insert_bin_op_before(instr, IR_AND, dividend, insert_constant_before(instr, (1ULL << shift) - 1));
+            break;
+        }
+        case VALUE_TYPE_S64: {
+            s64 constant = set_const_to_s64(divisor->set_constant);
+            int shift = constant > 0 ? power_of_two_exponent(constant) : -1;
+            if (shift < 0) {
+                return false;
+            }
+            signed_divide_by_power_of_two(instr, dividend, shift, &lo, &hi);
+            break;
+        }
+    }
+    replace_with_lo_hi(instr, lo, hi);
+    return true;
+}
+
 ir_instruction_t* last_value_usage(ir_instruction_t* value) {
     ir_instruction_t* last_usage = value;
     ir_instruction_t* iter = value->next;
@@ -216,9 +636,27 @@ void ir_optimize_constant_propagation() {
             case IR_INTERPRETER_FALLBACK:
             case IR_COND_BLOCK_EXIT: // Const condition checked in compiler
             // TODO
+            case IR_CALL:
+                break;
+
             case IR_MULTIPLY:
+                if (is_constant(instr->mult_div.operand1) && is_constant(instr->mult_div.operand2)) {
+                    u64 lo, hi;
+                    ir_evaluate_const_multiply(instr->mult_div.operand1->set_constant, instr->mult_div.operand2->set_constant, instr->mult_div.mult_div_type, &lo, &hi);
+                    replace_with_lo_hi(instr, insert_constant_before(instr, lo), insert_constant_before(instr, hi));
+                } else {
+                    reduce_multiply(instr);
+                }
+                break;
+
             case IR_DIVIDE:
-            case IR_CALL:
+                if (is_constant(instr->mult_div.operand1) && is_constant(instr->mult_div.operand2)) {
+                    u64 quotient, remainder;
+                    ir_evaluate_const_divide(instr->mult_div.operand1->set_constant, instr->mult_div.operand2->set_constant, instr->mult_div.mult_div_type, &quotient, &remainder);
+                    replace_with_lo_hi(instr, insert_constant_before(instr, quotient), insert_constant_before(instr, remainder));
+                } else {
+                    reduce_divide(instr);
+                }
                 break;
 
             case IR_MOV_REG_TYPE:
@@ -442,33 +880,8 @@ void ir_optimize_constant_propagation() {
 
             case IR_MASK_AND_CAST:
                 if (is_constant(instr->mask_and_cast.operand)) {
-                    u64 value = const_to_u64(instr->mask_and_cast.operand);
-                    u64 result;
+                    u64 result = mask_and_cast_constant(const_to_u64(instr->mask_and_cast.operand), instr->mask_and_cast.type);
                     instr->type = IR_SET_CONSTANT;
-                    switch (instr->mask_and_cast.type) {
-                        case VALUE_TYPE_S8:
-                            result = (s64)(s8)(value & 0xFF);
-                            break;
-                        case VALUE_TYPE_U8:
-                            result = value & 0xFF;
-                            break;
-                        case VALUE_TYPE_S16:
-                            result = (s64)(s16)(value & 0xFFFF);
-                            break;
-                        case VALUE_TYPE_U16:
-                            result = value & 0xFFFF;
-                            break;
-                        case VALUE_TYPE_S32:
-                            result = (s64)(s32)(value & 0xFFFFFFFF);
-                            break;
-                        case VALUE_TYPE_U32:
-                            result = value & 0xFFFFFFFF;
-                            break;
-                        case VALUE_TYPE_U64:
-                        case VALUE_TYPE_S64:
-                            result = value;
-                            break;
-                    }
                     instr->set_constant.type = VALUE_TYPE_U64;
                     instr->set_constant.value_u64 = result;
                 }
@@ -582,6 +995,443 @@ void ir_optimize_constant_propagation() {
     }
 }
 
+// Index into ir_context.cse_available, only pure instructions go in there
+static u64 expression_hash(ir_instruction_t* instr, ir_instruction_t* operand1, ir_instruction_t* operand2) {
+    u64 hash = 0xCBF29CE484222325 ^ instr->type;
+    hash = (hash ^ (uintptr_t)operand1) * 0x100000001B3;
+    hash = (hash ^ (uintptr_t)operand2) * 0x100000001B3;
+    return hash ^ (hash >> 32);
+}
+
+// The earlier instruction this one computes the same value as, or the instruction itself if there isn't one
+INLINE ir_instruction_t* value_number(ir_instruction_t* value) {
+    ir_instruction_t* number = ir_context.cse_value_numbers[value->index];
+    return number != NULL ? number : value;
+}
+
+// Constants are cheaper to use as immediates than to share, so only other values are ever replaced
+INLINE void forward_value(ir_instruction_t** operand) {
+    if (!is_constant(*operand)) {
+        *operand = value_number(*operand);
+    }
+}
+
+static void forward_operands(ir_instruction_t* instr) {
+    for (int i = 0; i < instr->flush_info.num_regs; i++) {
+        forward_value(&instr->flush_info.regs[i].item);
+    }
+
+    switch (instr->type) {
+        // Unary ops
+        case IR_SET_BLOCK_EXIT_PC:
+        case IR_NOT:
+            forward_value(&instr->unary_op.operand);
+            break;
+
+        // Bin ops
+        case IR_OR:
+        case IR_AND:
+        case IR_ADD:
+        case IR_SUB:
+        case IR_XOR:
+            forward_value(&instr->bin_op.operand1);
+            forward_value(&instr->bin_op.operand2);
+            break;
+
+        // Other
+        case IR_MASK_AND_CAST:
+            forward_value(&instr->mask_and_cast.operand);
+            break;
+        case IR_CHECK_CONDITION:
+            forward_value(&instr->check_condition.operand1);
+            forward_value(&instr->check_condition.operand2);
+            break;
+        case IR_TLB_LOOKUP:
+            forward_value(&instr->tlb_lookup.virtual_address);
+            break;
+        case IR_SHIFT:
+            forward_value(&instr->shift.operand);
+            forward_value(&instr->shift.amount);
+            break;
+        case IR_STORE:
+            forward_value(&instr->store.address);
+            forward_value(&instr->store.value);
+            break;
+        case IR_LOAD:
+            forward_value(&instr->load.address);
+            break;
+        case IR_SET_COND_BLOCK_EXIT_PC:
+            forward_value(&instr->set_cond_exit_pc.condition);
+            forward_value(&instr->set_cond_exit_pc.pc_if_true);
+            forward_value(&instr->set_cond_exit_pc.pc_if_false);
+            break;
+        case IR_FLUSH_GUEST_REG:
+            forward_value(&instr->flush_guest_reg.value);
+            break;
+        case IR_COND_BLOCK_EXIT:
+            forward_value(&instr->cond_block_exit.condition);
+            if (instr->cond_block_exit.type == COND_BLOCK_EXIT_TYPE_ADDRESS) {
+                forward_value(&instr->cond_block_exit.info.exit_pc);
+            }
+            break;
+        case IR_MULTIPLY:
+        case IR_DIVIDE:
+            forward_value(&instr->mult_div.operand1);
+            forward_value(&instr->mult_div.operand2);
+            break;
+        case IR_SET_PTR:
+            forward_value(&instr->set_ptr.value);
+            break;
+        case IR_MOV_REG_TYPE:
+            forward_value(&instr->mov_reg_type.value);
+            break;
+        case IR_FLOAT_CONVERT:
+            forward_value(&instr->float_convert.value);
+            break;
+        case IR_FLOAT_CHECK_CONDITION:
+            forward_value(&instr->float_check_condition.operand1);
+            forward_value(&instr->float_check_condition.operand2);
+            break;
+        case IR_CALL:
+            for (int i = 0; i < instr->call.num_args; i++) {
+                forward_value(&instr->call.arguments[i]);
+            }
+            break;
+
+        // Float bin ops
+        case IR_FLOAT_DIVIDE:
+        case IR_FLOAT_MULTIPLY:
+        case IR_FLOAT_ADD:
+        case IR_FLOAT_SUB:
+            forward_value(&instr->float_bin_op.operand1);
+            forward_value(&instr->float_bin_op.operand2);
+            break;
+
+        // Float unary ops
+        case IR_FLOAT_SQRT:
+        case IR_FLOAT_ABS:
+        case IR_FLOAT_NEG:
+            forward_value(&instr->float_unary_op.operand);
+            break;
+
+        // No dependencies
+        case IR_ERET:
+        case IR_GET_PTR:
+        case IR_NOP:
+        case IR_SET_CONSTANT:
+        case IR_SET_FLOAT_CONSTANT:
+        case IR_LOAD_GUEST_REG:
+        case IR_INTERPRETER_FALLBACK:
+            break;
+    }
+}
+
+INLINE bool is_commutative(ir_instruction_t* instr) {
+    return instr->type == IR_OR || instr->type == IR_XOR || instr->type == IR_AND || instr->type == IR_ADD;
+}
+
+// Finds the operands an instruction's value depends on, in a canonical order. Returns false if it isn't pure.
+static bool expression_operands(ir_instruction_t* instr, ir_instruction_t** operand1, ir_instruction_t** operand2) {
+    *operand1 = NULL;
+    *operand2 = NULL;
+    switch (instr->type) {
+        case IR_SET_CONSTANT:
+            return true;
+        case IR_NOT:
+            *operand1 = value_number(instr->unary_op.operand);
+            return true;
+        case IR_OR:
+        case IR_XOR:
+        case IR_AND:
+        case IR_ADD:
+        case IR_SUB:
+            *operand1 = value_number(instr->bin_op.operand1);
+            *operand2 = value_number(instr->bin_op.operand2);
+            if (is_commutative(instr) && (uintptr_t)*operand1 > (uintptr_t)*operand2) {
+                ir_instruction_t* temp = *operand1;
+                *operand1 = *operand2;
+                *operand2 = temp;
+            }
+            return true;
+        case IR_SHIFT:
+            *operand1 = value_number(instr->shift.operand);
+            *operand2 = value_number(instr->shift.amount);
+            return true;
+        case IR_MASK_AND_CAST:
+            *operand1 = value_number(instr->mask_and_cast.operand);
+            return true;
+        case IR_CHECK_CONDITION:
+            *operand1 = value_number(instr->check_condition.operand1);
+            *operand2 = value_number(instr->check_condition.operand2);
+            return true;
+        default:
+            return false;
+    }
+}
+
+// a is an earlier instruction already in the table, so its operands are already value numbers
+static bool same_expression(ir_instruction_t* a, ir_instruction_t* b, ir_instruction_t* b_operand1, ir_instruction_t* b_operand2) {
+    if (a->type != b->type) {
+        return false;
+    }
+    ir_instruction_t* a_operand1;
+    ir_instruction_t* a_operand2;
+    expression_operands(a, &a_operand1, &a_operand2);
+    if (a_operand1 != b_operand1 || a_operand2 != b_operand2) {
+        return false;
+    }
+
+    switch (a->type) {
+        case IR_SET_CONSTANT:
+            return const_to_u64(a) == const_to_u64(b);
+        case IR_NOT:
+        case IR_OR:
+        case IR_XOR:
+        case IR_AND:
+        case IR_ADD:
+        case IR_SUB:
+            return true;
+        case IR_SHIFT:
+            return a->shift.type == b->shift.type && a->shift.direction == b->shift.direction;
+        case IR_MASK_AND_CAST:
+            return a->mask_and_cast.type == b->mask_and_cast.type;
+        case IR_CHECK_CONDITION:
+            return a->check_condition.condition == b->check_condition.condition;
+        default:
+            return false;
+    }
+}
+
+// Returns the earlier instruction computing the same value as a pure instruction, adding it to the table if there isn't one
+static ir_instruction_t* find_available_expression(ir_instruction_t* instr, ir_instruction_t* operand1, ir_instruction_t* operand2) {
+    u64 hash = expression_hash(instr, operand1, operand2);
+    if (instr->type == IR_SET_CONSTANT) {
+        hash = expression_hash(instr, (ir_instruction_t*)(uintptr_t)const_to_u64(instr), NULL);
+    }
+
+    for (int probe = 0; probe < IR_CSE_TABLE_SIZE; probe++) {
+        ir_instruction_t** slot = &ir_context.cse_available[(hash + probe) & (IR_CSE_TABLE_SIZE - 1)];
+        if (*slot == NULL) {
+            *slot = instr;
+            return NULL;
+        } else if (same_expression(*slot, instr, operand1, operand2)) {
+            return *slot;
+        }
+    }
+    return NULL;
+}
+
+INLINE int value_type_size(ir_value_type_t type) {
+    switch (type) {
+        CASE_SIZE_8:
+            return 1;
+        CASE_SIZE_16:
+            return 2;
+        CASE_SIZE_32:
+            return 4;
+        CASE_SIZE_64:
+            return 8;
+    }
+    logfatal("Did not match any cases");
+}
+
+// A value known to be in RDRAM at a constant address, because it was just stored or loaded
+typedef struct cse_memory_value {
+    u32 address;
+    int size;
+    ir_instruction_t* value;
+} cse_memory_value_t;
+
+#define CSE_MAX_MEMORY_VALUES 32
+#define CSE_MAX_TLB_LOOKUPS 32
+
+INLINE bool is_rdram_constant(ir_instruction_t* address, int size) {
+    return is_constant(address) && const_to_u64(address) + size <= N64_RDRAM_SIZE;
+}
+
+INLINE bool is_gpr_value(ir_instruction_t* value) {
+    return is_constant(value) || get_required_register_type(value) == REGISTER_TYPE_GPR;
+}
+
+// Turn an instruction into one that doesn't need its old operands or flush info anymore
+INLINE void retire_instruction(ir_instruction_t* instr, ir_instruction_t* replacement) {
+    ir_context.cse_value_numbers[instr->index] = replacement;
+    instr->type = IR_NOP;
+    instr->flush_info.num_regs = 0;
+}
+
+// Loads from RDRAM can reuse what was stored to or loaded from the same address earlier in the block,
+// as long as nothing that could write to it happened in between
+static void forward_load(ir_instruction_t* instr, cse_memory_value_t* memory_values, int* num_memory_values) {
+    int size = value_type_size(instr->load.type);
+    if (instr->load.reg_type != REGISTER_TYPE_GPR || !is_rdram_constant(instr->load.address, size)) {
+        return;
+    }
+    u32 address = const_to_u64(instr->load.address);
+
+    for (int i = 0; i < *num_memory_values; i++) {
+        cse_memory_value_t* known = &memory_values[i];
+        if (known->address != address || known->size != size) {
+            continue;
+        }
+
+        ir_value_type_t type = instr->load.type;
+        ir_instruction_t* value = known->value;
+        instr->flush_info.num_regs = 0;
+        if (is_constant(value)) {
+            instr->type = IR_SET_CONSTANT;
+            instr->set_constant.type = VALUE_TYPE_U64;
+            instr->set_constant.value_u64 = mask_and_cast_constant(const_to_u64(value), type);
+        } else if (value->type == IR_LOAD && value->load.type == type) {
+            retire_instruction(instr, value);
+        } else {
+            // Stores only write the low bits, so a load sees them extended the way it always extends
+            instr->type = IR_MASK_AND_CAST;
+            instr->mask_and_cast.type = type;
+            instr->mask_and_cast.operand = value;
+        }
+        return;
+    }
+
+    if (*num_memory_values < CSE_MAX_MEMORY_VALUES) {
+        memory_values[(*num_memory_values)++] = (cse_memory_value_t){ .address = address, .size = size, .value = instr };
+    }
+}
+
+static void remember_store(ir_instruction_t* instr, cse_memory_value_t* memory_values, int* num_memory_values) {
+    int size = value_type_size(instr->store.type);
+    if (!is_rdram_constant(instr->store.address, size)) {
+        // Could be anywhere, or a register write that starts a DMA into RDRAM
+        *num_memory_values = 0;
+        return;
+    }
+    u32 address = const_to_u64(instr->store.address);
+
+    int kept = 0;
+    for (int i = 0; i < *num_memory_values; i++) {
+        cse_memory_value_t* known = &memory_values[i];
+        if (known->address >= address + size || known->address + known->size <= address) {
+            memory_values[kept++] = *known;
+        }
+    }
+    *num_memory_values = kept;
+
+    if (is_gpr_value(instr->store.value) && *num_memory_values < CSE_MAX_MEMORY_VALUES) {
+        memory_values[(*num_memory_values)++] = (cse_memory_value_t){ .address = address, .size = size, .value = instr->store.value };
+    }
+}
+
+// A lookup of the same address already succeeded, unless something that could change the TLB happened in between.
+// Loads can use the result of an earlier lookup for a store, but not the other way around, since a store can fail on
+// a page that isn't writable.
+static void dedupe_tlb_lookup(ir_instruction_t* instr, ir_instruction_t** tlb_lookups, int* num_tlb_lookups) {
+    ir_instruction_t* address = value_number(instr->tlb_lookup.virtual_address);
+    for (int i = 0; i < *num_tlb_lookups; i++) {
+        ir_instruction_t* lookup = tlb_lookups[i];
+        bool same_address = value_number(lookup->tlb_lookup.virtual_address) == address;
+        if (same_address && (lookup->tlb_lookup.bus_access == instr->tlb_lookup.bus_access || lookup->tlb_lookup.bus_access == BUS_STORE)) {
+            retire_instruction(instr, lookup);
+            return;
+        }
+    }
+
+    if (*num_tlb_lookups < CSE_MAX_TLB_LOOKUPS) {
+        tlb_lookups[(*num_tlb_lookups)++] = instr;
+    }
+}
+
+void ir_optimize_common_subexpressions() {
+    memset(ir_context.cse_value_numbers, 0, sizeof(ir_instruction_t*) * ir_context.ir_cache_index);
+    memset(ir_context.cse_available, 0, sizeof(ir_context.cse_available));
+
+    cse_memory_value_t memory_values[CSE_MAX_MEMORY_VALUES];
+    int num_memory_values = 0;
+    ir_instruction_t* tlb_lookups[CSE_MAX_TLB_LOOKUPS];
+    int num_tlb_lookups = 0;
+
+    ir_instruction_t* instr = ir_context.ir_cache_head;
+    while (instr != NULL) {
+        forward_operands(instr);
+
+        switch (instr->type) {
+            case IR_SET_CONSTANT:
+            case IR_NOT:
+            case IR_OR:
+            case IR_XOR:
+            case IR_AND:
+            case IR_ADD:
+            case IR_SUB:
+            case IR_SHIFT:
+            case IR_MASK_AND_CAST:
+            case IR_CHECK_CONDITION: {
+                ir_instruction_t* operand1;
+                ir_instruction_t* operand2;
+                expression_operands(instr, &operand1, &operand2);
+                ir_instruction_t* available = find_available_expression(instr, operand1, operand2);
+                if (available != NULL) {
+                    // Constants keep their own instruction, but still compare equal to each other from here on
+                    ir_context.cse_value_numbers[instr->index] = available;
+                }
+                break;
+            }
+
+            case IR_TLB_LOOKUP:
+                dedupe_tlb_lookup(instr, tlb_lookups, &num_tlb_lookups);
+                break;
+            case IR_LOAD:
+                forward_load(instr, memory_values, &num_memory_values);
+                break;
+            case IR_STORE:
+                remember_store(instr, memory_values, &num_memory_values);
+                break;
+
+            // Can write to memory and the TLB
+            case IR_CALL:
+            case IR_ERET:
+            case IR_INTERPRETER_FALLBACK:
+                num_memory_values = 0;
+                num_tlb_lookups = 0;
+                break;
+            // Can write to CP0
+            case IR_SET_PTR:
+                num_tlb_lookups = 0;
+                break;
+
+            // Not worth it, or reads state that can change in the middle of the block
+            case IR_NOP:
+            case IR_SET_FLOAT_CONSTANT:
+            case IR_GET_PTR:
+            case IR_SET_COND_BLOCK_EXIT_PC:
+            case IR_SET_BLOCK_EXIT_PC:
+            case IR_COND_BLOCK_EXIT:
+            case IR_LOAD_GUEST_REG:
+            case IR_FLUSH_GUEST_REG:
+            case IR_MULTIPLY:
+            case IR_DIVIDE:
+            case IR_MOV_REG_TYPE:
+            case IR_FLOAT_CONVERT:
+            case IR_FLOAT_MULTIPLY:
+            case IR_FLOAT_DIVIDE:
+            case IR_FLOAT_ADD:
+            case IR_FLOAT_SUB:
+            case IR_FLOAT_SQRT:
+            case IR_FLOAT_ABS:
+            case IR_FLOAT_NEG:
+            case IR_FLOAT_CHECK_CONDITION:
+                break;
+        }
+
+        instr = instr->next;
+    }
+
+    // Values replaced by earlier ones are now unused, and removed by dead code elimination
+    for (int i = 0; i < 64; i++) {
+        if (ir_context.guest_reg_to_value[i] != NULL) {
+            forward_value(&ir_context.guest_reg_to_value[i]);
+        }
+    }
+}
+
 void ir_optimize_eliminate_dead_code() {
     ir_instruction_t* instr = ir_context.ir_cache_tail;
     // Loop through instructions backwards
@@ -781,3 +1631,87 @@ void ir_optimize_shrink_constants() {
     }
 }
 
+// Can the instruction change a guest register in memory?
+INLINE bool writes_guest_regs(ir_instruction_t* instr) {
+    switch (instr->type) {
+        case IR_FLUSH_GUEST_REG:
+        case IR_SET_PTR:
+        case IR_CALL:
+        case IR_ERET:
+        case IR_INTERPRETER_FALLBACK:
+            return true;
+
+        case IR_NOP:
+        case IR_SET_CONSTANT:
+        case IR_SET_FLOAT_CONSTANT:
+        case IR_OR:
+        case IR_XOR:
+        case IR_AND:
+        case IR_NOT:
+        case IR_ADD:
+        case IR_SUB:
+        case IR_SHIFT:
+        case IR_STORE:
+        case IR_LOAD:
+        case IR_GET_PTR:
+        case IR_MASK_AND_CAST:
+        case IR_CHECK_CONDITION:
+        case IR_SET_COND_BLOCK_EXIT_PC:
+        case IR_SET_BLOCK_EXIT_PC:
+        case IR_COND_BLOCK_EXIT:
+        case IR_TLB_LOOKUP:
+        case IR_LOAD_GUEST_REG:
+        case IR_MULTIPLY:
+        case IR_DIVIDE:
+        case IR_MOV_REG_TYPE:
+        case IR_FLOAT_CONVERT:
+        case IR_FLOAT_MULTIPLY:
+        case IR_FLOAT_DIVIDE:
+        case IR_FLOAT_ADD:
+        case IR_FLOAT_SUB:
+        case IR_FLOAT_SQRT:
+        case IR_FLOAT_ABS:
+        case IR_FLOAT_NEG:
+        case IR_FLOAT_CHECK_CONDITION:
+            return false;
+    }
+    logfatal("Unknown IR instruction type %d", instr->type);
+}
+
+void ir_optimize_hoist_guest_reg_loads() {
+    // Hoisted loads stay live from the start of the block, so only move a few to leave the rest of it enough registers
+    int max_hoisted = get_num_preserved_gprs() / 2;
+    ir_instruction_t* last_hoisted = NULL;
+    ir_context.num_hoisted_guest_reg_loads = 0;
+
+    ir_instruction_t* instr = ir_context.ir_cache_head;
+    while (instr != NULL && ir_context.num_hoisted_guest_reg_loads < max_hoisted && !writes_guest_regs(instr)) {
+        ir_instruction_t* next = instr->next;
+        bool gpr_load = instr->type == IR_LOAD_GUEST_REG && IR_IS_GPR(instr->load_guest_reg.guest_reg);
+        if (gpr_load && instr->prev != last_hoisted) {
+            // Unlink it
+            instr->prev->next = instr->next;
+            if (instr->next != NULL) {
+                instr->next->prev = instr->prev;
+            } else {
+                ir_context.ir_cache_tail = instr->prev;
+            }
+
+            // And put it right after the loads hoisted so far
+            ir_instruction_t* insert_before = last_hoisted ? last_hoisted->next : ir_context.ir_cache_head;
+            instr->prev = last_hoisted;
+            instr->next = insert_before;
+            insert_before->prev = instr;
+            if (last_hoisted) {
+                last_hoisted->next = instr;
+            } else {
+                ir_context.ir_cache_head = instr;
+            }
+        }
+        if (gpr_load) {
+            last_hoisted = instr;
+            ir_context.num_hoisted_guest_reg_loads++;
+        }
+        instr = next;
+    }
+}
@@ -36,6 +36,8 @@ INLINE bool binop_valid_immediate(ir_instruction_t* instr) {
     return instr_valid_immediate(instr->bin_op.operand1) && instr_valid_immediate(instr->bin_op.operand2);
 }
 
+// Calls visit on every value the instruction uses, including the ones it flushes to guest registers
+void ir_visit_operands(ir_instruction_t* instr, void (*visit)(ir_instruction_t* operand, void* data), void* data);
 bool instr_uses_value(ir_instruction_t* instr, ir_instruction_t* value);
 
 u32 set_const_to_u32(ir_set_constant_t constant);
@@ -44,13 +46,22 @@ u64 set_const_to_u64(ir_set_constant_t constant);
 s64 set_const_to_s64(ir_set_constant_t constant);
 
 u64 const_to_u64(ir_instruction_t* constant);
+u64 mask_and_cast_constant(u64 value, ir_value_type_t type);
 
 u64 set_float_const_to_u64(ir_set_float_constant_t constant);
 u64 float_const_to_u64(ir_instruction_t* constant);
 
+// Results of MULT/DIV style instructions, as they'd be written to LO and HI
+void ir_evaluate_const_multiply(ir_set_constant_t operand1, ir_set_constant_t operand2, ir_value_type_t type, u64* lo, u64* hi);
+void ir_evaluate_const_divide(ir_set_constant_t operand_dividend, ir_set_constant_t operand_divisor, ir_value_type_t type, u64* result_quotient, u64* result_remainder);
+
 void ir_optimize_flush_guest_regs();
 void ir_optimize_constant_propagation();
+// Share values computed more than once in a block, and reuse values from memory instead of loading them again
+void ir_optimize_common_subexpressions();
 void ir_optimize_eliminate_dead_code();
 void ir_optimize_shrink_constants();
+// Move the first few guest GPR loads to the start of the block, so blocks linked to this one can skip them
+void ir_optimize_hoist_guest_reg_loads();
 
 #endif //N64_IR_OPTIMIZER_H
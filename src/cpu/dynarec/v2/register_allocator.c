@@ -11,27 +11,6 @@ typedef struct register_allocation_state {
 } register_allocation_state_t;
 
 
-// How many more instructions this value needs to hang around for
-int value_lifetime(ir_instruction_t* value, ir_instruction_t** last_use) {
-    int lifetime = 0;
-    ir_instruction_t* instr = value->next;
-    int times_stepped = 1;
-
-    while (instr) {
-        if (instr_uses_value(instr, value)) {
-            lifetime = times_stepped;
-
-            if (last_use) {
-                *last_use = instr;
-            }
-        }
-        instr = instr->next;
-        times_stepped++;
-    }
-
-    return lifetime;
-}
-
 ir_register_type_t get_required_register_type(ir_instruction_t* instr) {
     switch (instr->type) {
         case IR_SET_CONSTANT:
@@ -130,10 +109,33 @@ void ir_recalculate_indices() {
     int index = 0;
     while (value != NULL) {
         value->index = index++;
+        value->last_use = -1;
         value = value->next;
     }
 }
 
+static void mark_use(ir_instruction_t* value, void* data) {
+    ir_instruction_t* instr = data;
+    // We're walking backwards, so the first use we see is the last one
+    if (value->last_use < 0) {
+        value->last_use = instr->index;
+    }
+}
+
+// Fill in last_use for every value with a single backwards pass. Must be run after ir_recalculate_indices().
+void ir_calculate_live_intervals() {
+    ir_instruction_t* instr = ir_context.ir_cache_tail;
+    while (instr != NULL) {
+        ir_visit_operands(instr, mark_use, instr);
+        // All uses come after the value, so if none were found by now, there aren't any.
+        // Value never used, but dead code elimination didn't get rid of it - might be a LOAD, or something else that has a side effect
+        if (instr->last_use < 0) {
+            instr->last_use = instr->index;
+        }
+        instr = instr->prev;
+    }
+}
+
 INLINE void sort_active(register_allocation_state_t* state) {
     if (state->num_active > 0) {
         qsort(state->active, state->num_active, sizeof(ir_instruction_t*), active_value_comparator);
@@ -198,14 +200,6 @@ void allocate_register(
         ir_register_type_t type,
         spill_data_t* spill_data,
         register_allocation_state_t* state) {
-    ir_instruction_t* last_use = NULL;
-    value_lifetime(value, &last_use);
-    // Value never used, but dead code elimination didn't get rid of it - might be a LOAD, or something else that has a side effect
-    if (!last_use) {
-        last_use = value;
-    }
-    value->last_use = last_use->index;
-
     if (state->num_active == state->num_regs) {
         int active_index = state->num_active - 1; // last entry in active
         ir_instruction_t* spill = state->active[active_index];
@@ -238,12 +232,13 @@ void allocate_register(
 
 }
 
-spill_data_t spill_data = { 0 };
+N64_THREAD_LOCAL spill_data_t spill_data = { 0 };
 
 // https://web.cs.ucla.edu/~palsberg/course/cs132/linearscan.pdf
 void ir_allocate_registers() {
     // Recalculate indices before register allocation. Needed because previous steps can insert values into the middle of the list without updating the index values.
     ir_recalculate_indices();
+    ir_calculate_live_intervals();
 
     memset(&spill_data, 0, sizeof(spill_data_t));
 
@@ -264,7 +259,6 @@ void ir_allocate_registers() {
         fgr_state.reg_available[get_available_fgrs()[i]] = true;
     }
 
-    // TODO: replace last_use calculations with a single backwards pass instead of the worst-case O(n^2) algorithm of calling value_lifetime()
     ir_instruction_t* value = ir_context.ir_cache_head;
     while (value != NULL) {
         // Sort in order of increasing last usage
@@ -288,3 +282,77 @@ void ir_allocate_registers() {
         value = value->next;
     }
 }
+
+// Index of the allocatable host register a value is in, or -1 if it isn't in one
+static int binding_index(ir_instruction_t* value) {
+    if (value->reg_alloc.type != REGISTER_TYPE_GPR || value->reg_alloc.spilled) {
+        return -1;
+    }
+    for (int i = 0; i < get_num_preserved_gprs() && i < MAX_REGISTER_BINDINGS; i++) {
+        if (get_preserved_gprs()[i] == value->reg_alloc.host_reg) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+INLINE u64 set_binding(u64 bindings, int index, u8 guest_reg) {
+    return (bindings & ~(0xFFull << (index * 8))) | ((u64)guest_reg << (index * 8));
+}
+
+u64 ir_entry_register_bindings() {
+    u64 bindings = REGISTER_BINDINGS_NONE;
+    ir_instruction_t* instr = ir_context.ir_cache_head;
+    for (int i = 0; i < ir_context.num_hoisted_guest_reg_loads; i++) {
+        int index = binding_index(instr);
+        if (index >= 0) {
+            bindings = set_binding(bindings, index, instr->load_guest_reg.guest_reg);
+        }
+        instr = instr->next;
+    }
+    return bindings;
+}
+
+u64 ir_exit_register_bindings() {
+    u64 bindings = REGISTER_BINDINGS_NONE;
+    ir_instruction_t* contents[MAX_REGISTER_BINDINGS] = { NULL };
+
+    ir_instruction_t* instr = ir_context.ir_cache_head;
+    while (instr != NULL) {
+        switch (instr->type) {
+            case IR_FLUSH_GUEST_REG:
+                if (IR_IS_GPR(instr->flush_guest_reg.guest_reg)) {
+                    u8 guest_reg = instr->flush_guest_reg.guest_reg;
+                    // Whatever else had the old value doesn't anymore
+                    for (int i = 0; i < MAX_REGISTER_BINDINGS; i++) {
+                        if (((bindings >> (i * 8)) & 0xFF) == guest_reg) {
+                            bindings = set_binding(bindings, i, 0);
+                        }
+                    }
+                    int index = binding_index(instr->flush_guest_reg.value);
+                    if (index >= 0 && contents[index] == instr->flush_guest_reg.value) {
+                        bindings = set_binding(bindings, index, guest_reg);
+                    }
+                }
+                break;
+            // Can change guest registers behind our back
+            case IR_SET_PTR:
+            case IR_CALL:
+            case IR_ERET:
+            case IR_INTERPRETER_FALLBACK:
+                bindings = REGISTER_BINDINGS_NONE;
+                break;
+            default:
+                break;
+        }
+
+        int index = binding_index(instr);
+        if (index >= 0) {
+            contents[index] = instr;
+            bool gpr_load = instr->type == IR_LOAD_GUEST_REG && IR_IS_GPR(instr->load_guest_reg.guest_reg);
+            bindings = set_binding(bindings, index, gpr_load ? instr->load_guest_reg.guest_reg : 0);
+        }
+        instr = instr->next;
+    }
+    return bindings;
+}
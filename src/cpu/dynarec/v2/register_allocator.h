@@ -1,6 +1,15 @@
 #ifndef N64_REGISTER_ALLOCATOR_H
 #define N64_REGISTER_ALLOCATOR_H
 
+#include "ir_context.h"
+
+ir_register_type_t get_required_register_type(ir_instruction_t* instr);
+
 void ir_allocate_registers();
 
+// Guest GPRs in host registers after the loads hoisted to the start of the block, and at the end of the block.
+// Must be run after ir_allocate_registers().
+u64 ir_entry_register_bindings();
+u64 ir_exit_register_bindings();
+
 #endif //N64_REGISTER_ALLOCATOR_H
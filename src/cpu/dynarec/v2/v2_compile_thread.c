@@ -0,0 +1,124 @@
+#include "v2_compile_thread.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <SDL_thread.h>
+#include <SDL_mutex.h>
+#include <log.h>
+
+static bool async_compilation_enabled = false;
+
+static v2_compile_job_t compile_jobs[V2_COMPILE_QUEUE_SIZE];
+int v2_num_finished_compile_jobs = 0;
+
+static SDL_Thread* compile_thread = NULL;
+static SDL_sem* jobs_queued = NULL;
+
+static v2_compiler_instance_t* compile_thread_compiler = NULL;
+
+INLINE v2_compile_job_state_t get_job_state(v2_compile_job_t* job) {
+    return __atomic_load_n(&job->state, __ATOMIC_ACQUIRE);
+}
+
+INLINE void set_job_state(v2_compile_job_t* job, v2_compile_job_state_t state) {
+    __atomic_store_n(&job->state, state, __ATOMIC_RELEASE);
+}
+
+static void compile_job(v2_compile_job_t* job) {
+    fill_temp_code(job->virtual_address, job->physical_address, NULL);
+
+    // Everything that was read, including anything trimmed off the end of the block
+    job->guest_words = temp_code_len;
+    for (int i = 0; i < temp_code_len; i++) {
+        job->guest_code[i] = temp_code[i].raw;
+    }
+
+    memset(&job->block, 0, sizeof(n64_dynarec_block_t));
+    job->block.sysconfig = job->sysconfig;
+    job->block.virtual_address = job->virtual_address;
+
+    // The FPU emitters pick register locations from the live status.fr bit, so if it changed since the block was
+    // requested, the result can't be trusted.
+    job->discarded = N64CP0.status.fr != job->sysconfig.fr;
+    v2_compile_temp_code(&job->block, job->virtual_address, job->physical_address);
+    job->discarded |= N64CP0.status.fr != job->sysconfig.fr;
+}
+
+static int compile_thread_main(void* data) {
+    v2_compiler_bind_instance(compile_thread_compiler);
+    while (true) {
+        SDL_SemWait(jobs_queued);
+        for (int i = 0; i < V2_COMPILE_QUEUE_SIZE; i++) {
+            v2_compile_job_t* job = &compile_jobs[i];
+            if (get_job_state(job) == COMPILE_JOB_QUEUED) {
+                compile_job(job);
+                set_job_state(job, COMPILE_JOB_DONE);
+                __atomic_add_fetch(&v2_num_finished_compile_jobs, 1, __ATOMIC_RELEASE);
+            }
+        }
+    }
+    return 0;
+}
+
+static void start_compile_thread() {
+    compile_thread_compiler = calloc(1, sizeof(v2_compiler_instance_t));
+    compile_thread_compiler->private_output = true;
+
+    jobs_queued = SDL_CreateSemaphore(0);
+    compile_thread = SDL_CreateThread(compile_thread_main, "v2 compiler", NULL);
+    if (compile_thread == NULL) {
+        logfatal("Failed to start the compile thread: %s", SDL_GetError());
+    }
+}
+
+void v2_set_async_compilation_enabled(bool enabled) {
+    async_compilation_enabled = enabled;
+}
+
+bool v2_async_compilation_enabled() {
+    return async_compilation_enabled;
+}
+
+bool v2_request_async_compile(u64 virtual_address, u32 physical_address, n64_block_sysconfig_t sysconfig) {
+    if (compile_thread == NULL) {
+        start_compile_thread();
+    }
+
+    v2_compile_job_t* free_job = NULL;
+    for (int i = 0; i < V2_COMPILE_QUEUE_SIZE; i++) {
+        v2_compile_job_t* job = &compile_jobs[i];
+        if (get_job_state(job) == COMPILE_JOB_FREE) {
+            if (free_job == NULL) {
+                free_job = job;
+            }
+        } else if (job->virtual_address == virtual_address && job->physical_address == physical_address && job->sysconfig.raw == sysconfig.raw) {
+            return true; // Already on its way
+        }
+    }
+
+    if (free_job == NULL) {
+        return false;
+    }
+
+    free_job->virtual_address = virtual_address;
+    free_job->physical_address = physical_address;
+    free_job->sysconfig = sysconfig;
+    set_job_state(free_job, COMPILE_JOB_QUEUED);
+    SDL_SemPost(jobs_queued);
+    return true;
+}
+
+void v2_collect_async_compiles(void (*install)(v2_compile_job_t* job)) {
+    for (int i = 0; i < V2_COMPILE_QUEUE_SIZE; i++) {
+        v2_compile_job_t* job = &compile_jobs[i];
+        if (get_job_state(job) == COMPILE_JOB_DONE) {
+            install(job);
+            if (job->block.host_size > 0) {
+                free(job->block.run);
+            }
+            job->block.run = NULL;
+            set_job_state(job, COMPILE_JOB_FREE);
+            __atomic_sub_fetch(&v2_num_finished_compile_jobs, 1, __ATOMIC_RELEASE);
+        }
+    }
+}
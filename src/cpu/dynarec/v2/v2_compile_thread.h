@@ -0,0 +1,44 @@
+#ifndef N64_V2_COMPILE_THREAD_H
+#define N64_V2_COMPILE_THREAD_H
+
+#include <dynarec/dynarec.h>
+#include "v2_compiler.h"
+
+#define V2_COMPILE_QUEUE_SIZE 64
+
+typedef enum v2_compile_job_state {
+    COMPILE_JOB_FREE,
+    COMPILE_JOB_QUEUED,
+    COMPILE_JOB_DONE
+} v2_compile_job_state_t;
+
+typedef struct v2_compile_job {
+    int state; // v2_compile_job_state_t, accessed atomically
+
+    // Filled in by the emulation thread
+    u64 virtual_address;
+    u32 physical_address;
+    n64_block_sysconfig_t sysconfig;
+
+    // Filled in by the compile thread
+    n64_dynarec_block_t block; // run points to malloc()ed code, unless host_size is 0
+    bool discarded;
+    int guest_words;
+    u32 guest_code[TEMP_CODE_SIZE]; // what the block was compiled from, to check it wasn't overwritten in the meantime
+} v2_compile_job_t;
+
+void v2_set_async_compilation_enabled(bool enabled);
+bool v2_async_compilation_enabled();
+
+// Returns false if the queue is full
+bool v2_request_async_compile(u64 virtual_address, u32 physical_address, n64_block_sysconfig_t sysconfig);
+
+extern int v2_num_finished_compile_jobs;
+INLINE bool v2_async_compile_finished() {
+    return __atomic_load_n(&v2_num_finished_compile_jobs, __ATOMIC_ACQUIRE) > 0;
+}
+
+// Calls install() on the emulation thread for every job the compile thread has finished, then frees them
+void v2_collect_async_compiles(void (*install)(v2_compile_job_t* job));
+
+#endif //N64_V2_COMPILE_THREAD_H
@@ -40,29 +40,30 @@ bool should_break(u32 address) {
 }
 
 static bool v2_idle_loop_detection_enabled = true;
+static bool v2_superblocks_enabled_flag = false;
 
-int temp_code_len = 0;
-mips_instruction_t temp_code[TEMP_CODE_SIZE];
-dynarec_instruction_category_t temp_code_category[TEMP_CODE_SIZE];
-u64 temp_code_vaddr = 0;
+static v2_compiler_instance_t emulation_thread_compiler;
+N64_THREAD_LOCAL v2_compiler_instance_t* v2_compiler_ptr = NULL;
+
+void v2_compiler_bind_instance(v2_compiler_instance_t* instance) {
+    v2_compiler_ptr = instance;
+    ir_context_ptr = &instance->ir;
+}
 
 #define LAST_INSTR_CATEGORY (temp_code_category[temp_code_len - 1])
 #define LAST_INSTR_IS_BRANCH ((temp_code_len > 0) && ((LAST_INSTR_CATEGORY == BRANCH) || (LAST_INSTR_CATEGORY == BRANCH_LIKELY)))
 
 u64 v2_get_last_compiled_block() {
-    return temp_code_vaddr;
+    return emulation_thread_compiler.code_vaddr;
 }
 
-// Determine what instructions should be compiled into the block and load them into temp_code
-void fill_temp_code(u64 virtual_address, u32 physical_address, bool* code_mask) {
-    temp_code_vaddr = virtual_address;
+// Append instructions to temp_code, starting at the given address, until the rules for ending a block say to stop
+// page may be NULL, if the caller marks the code itself.
+static void fill_temp_code_segment(u64 virtual_address, u32 physical_address, n64_dynarec_page_t* page) {
     int instructions_left_in_block = -1;
 
-    temp_code_len = 0;
-#ifdef N64_LOG_COMPILATIONS
-    printf("Starting a new block:\n");
-#endif
-    for (int i = 0; i < MAX_BLOCK_LENGTH || instructions_left_in_block > 0; i++) {
+    for (int i = 0; temp_code_len < MAX_BLOCK_LENGTH || instructions_left_in_block > 0; i++) {
+        int index = temp_code_len;
         u32 instr_address = physical_address + (i << 2);
         u32 next_instr_address = instr_address + 4;
 
@@ -70,18 +71,23 @@ void fill_temp_code(u64 virtual_address, u32 physical_address, bool* code_mask)
 
         dynarec_instruction_category_t prev_instr_category = NORMAL;
         if (i > 0) {
-            prev_instr_category = temp_code_category[i - 1];
+            prev_instr_category = temp_code_category[index - 1];
         }
 
-        code_mask[BLOCKCACHE_INNER_INDEX(instr_address)] = true;
+        if (page) {
+            mark_code(page, instr_address);
+        }
 
-        temp_code[i].raw = n64_read_physical_word(instr_address);
-        temp_code_category[i] = instr_category(temp_code[i]);
+        temp_code[index].raw = n64_read_physical_word(instr_address);
+        temp_code_category[index] = instr_category(temp_code[index]);
+        temp_code_vaddrs[index] = virtual_address + (i << 2);
+        temp_code_paddrs[index] = instr_address;
+        temp_code_trace[index] = TRACE_BRANCH_EXIT;
         temp_code_len++;
         instructions_left_in_block--;
 
         bool instr_ends_block;
-        switch (temp_code_category[i]) {
+        switch (temp_code_category[index]) {
             // Possible to end block
             case CACHE:
             case STORE:
@@ -119,9 +125,9 @@ void fill_temp_code(u64 virtual_address, u32 physical_address, bool* code_mask)
 
 #ifdef N64_LOG_COMPILATIONS
         static char buf[50];
-        u64 instr_virtual_address = virtual_address + (i << 2);
-        disassemble(instr_virtual_address, temp_code[i].instr.raw, buf, 50);
-        printf("%d [%08X]=%08X %s\n", i, (u32)instr_virtual_address, temp_code[i].instr.raw, buf);
+        u64 instr_virtual_address = temp_code_vaddrs[index];
+        disassemble(instr_virtual_address, temp_code[index].instr.raw, buf, 50);
+        printf("%d [%08X]=%08X %s\n", index, (u32)instr_virtual_address, temp_code[index].instr.raw, buf);
 #endif
 
 
@@ -129,15 +135,139 @@ void fill_temp_code(u64 virtual_address, u32 physical_address, bool* code_mask)
             break;
         }
     }
+}
+
+// If we filled up the buffer, make sure the last instruction is not a branch
+static void strip_temp_code_overflow() {
+    if (temp_code_len == TEMP_CODE_SIZE && is_branch(temp_code_category[TEMP_CODE_SIZE - 1])) {
+        logwarn("Filled temp_code buffer, but the last instruction was a branch. Stripping it out.");
+        temp_code_len--;
+    }
+}
+
+// Determine what instructions should be compiled into the block and load them into temp_code
+// page may be NULL, if the caller marks the code itself.
+void fill_temp_code(u64 virtual_address, u32 physical_address, n64_dynarec_page_t* page) {
+    temp_code_vaddr = virtual_address;
+    temp_code_len = 0;
+    temp_code_is_trace = false;
+#ifdef N64_LOG_COMPILATIONS
+    printf("Starting a new block:\n");
+#endif
+    fill_temp_code_segment(virtual_address, physical_address, page);
 
 #ifdef N64_LOG_COMPILATIONS
     printf("Ending block after %d instructions\n", temp_code_len);
 #endif
+    strip_temp_code_overflow();
+}
 
-    // If we filled up the buffer, make sure the last instruction is not a branch
-    if (temp_code_len == TEMP_CODE_SIZE && is_branch(temp_code_category[TEMP_CODE_SIZE - 1])) {
-        logwarn("Filled temp_code buffer, but the last instruction was a branch. Stripping it out.");
-        temp_code_len--;
+// Target of a branch with a constant target. False for jumps to registers.
+bool v2_branch_target(mips_instruction_t instr, u64 virtual_address, u64* target) {
+    switch (instr.op) {
+        case OPC_SPCL: // jr, jalr
+            return false;
+        case OPC_J:
+        case OPC_JAL:
+            *target = ((u64)instr.j.target << 2) | (virtual_address & 0xFFFFFFFFF0000000);
+            return true;
+        default:
+            *target = virtual_address + 4 + (s64)(s16)instr.i.immediate * 4;
+            return true;
+    }
+}
+
+// Like fill_temp_code, but keeps going past branches that almost always go the same way, as long as where they go
+// is in the same page. Each block the trace passes through must have been profiled already.
+// Returns false if the trace didn't get past the first block, in which case there's nothing to gain over it.
+bool fill_trace_code(u64 virtual_address, u32 physical_address, n64_dynarec_page_t* page, n64_block_sysconfig_t sysconfig) {
+    temp_code_vaddr = virtual_address;
+    temp_code_len = 0;
+    temp_code_is_trace = true;
+
+    u64 segment_starts[V2_MAX_TRACE_SEGMENTS];
+    int num_segments = 0;
+    u64 segment_virtual = virtual_address;
+    u32 segment_physical = physical_address;
+#ifdef N64_LOG_COMPILATIONS
+    printf("Starting a new superblock:\n");
+#endif
+    while (true) {
+        segment_starts[num_segments++] = segment_virtual;
+        fill_temp_code_segment(segment_virtual, segment_physical, page);
+
+        // Only continue past a branch whose delay slot made it into the segment
+        if (num_segments == V2_MAX_TRACE_SEGMENTS || temp_code_len >= MAX_BLOCK_LENGTH || temp_code_len < 2) {
+            break;
+        }
+        int branch_index = temp_code_len - 2;
+        dynarec_instruction_category_t category = temp_code_category[branch_index];
+        dynarec_instruction_category_t delay_slot_category = temp_code_category[branch_index + 1];
+        if (!is_branch(category) || (delay_slot_category != NORMAL && delay_slot_category != STORE)) {
+            break;
+        }
+        if (BLOCKCACHE_OUTER_INDEX(temp_code_paddrs[branch_index + 1]) != BLOCKCACHE_OUTER_INDEX(physical_address)) {
+            break;
+        }
+
+        u64 target;
+        if (!v2_branch_target(temp_code[branch_index], temp_code_vaddrs[branch_index], &target)) {
+            break;
+        }
+
+        bool follow_taken = true;
+        if (temp_code[branch_index].op != OPC_J && temp_code[branch_index].op != OPC_JAL) {
+            dynarec_branch_bias_t bias = dynarec_branch_bias(segment_virtual, segment_physical, sysconfig);
+            if (bias == BRANCH_BIAS_UNKNOWN) {
+                break;
+            }
+            follow_taken = bias == BRANCH_BIAS_TAKEN;
+        }
+        // Not taken likely branches skip their delay slot, so traces only follow them when taken
+        if (category == BRANCH_LIKELY && !follow_taken) {
+            break;
+        }
+
+        u64 next_virtual = follow_taken ? target : temp_code_vaddrs[branch_index] + 8;
+        if ((next_virtual >> BLOCKCACHE_OUTER_SHIFT) != (virtual_address >> BLOCKCACHE_OUTER_SHIFT)) {
+            break;
+        }
+        // Don't unroll loops. Ending the trace here lets the exit be linked back to the start instead.
+        bool already_in_trace = false;
+        for (int i = 0; i < num_segments; i++) {
+            already_in_trace |= segment_starts[i] == next_virtual;
+        }
+        if (already_in_trace) {
+            break;
+        }
+
+        temp_code_trace[branch_index] = follow_taken ? TRACE_BRANCH_FOLLOW_TAKEN : TRACE_BRANCH_FOLLOW_NOT_TAKEN;
+        segment_virtual = next_virtual;
+        segment_physical = (physical_address & ~(BLOCKCACHE_PAGE_SIZE - 1)) | (next_virtual & (BLOCKCACHE_PAGE_SIZE - 1));
+    }
+
+#ifdef N64_LOG_COMPILATIONS
+    printf("Ending superblock after %d instructions in %d blocks\n", temp_code_len, num_segments);
+#endif
+    strip_temp_code_overflow();
+    return num_segments > 1;
+}
+
+// Remember a successful translation so the JIT's inline lookup can skip resolve_virtual_address_for_jit next time
+void fill_jit_tlb(u64 virtual, u32 physical, bus_access_t bus_access) {
+    jit_tlb_entry_t* entry = &N64CP0.jit_tlb[GET_JIT_TLB_INDEX(virtual)];
+    u64 tag = GET_JIT_TLB_TAG(virtual);
+    u64 physical_page = physical - GET_JIT_TLB_PAGE_OFFSET(virtual);
+
+    if ((entry->load_tag != tag && entry->store_tag != tag) || entry->physical != physical_page) {
+        memset(entry, 0, sizeof(jit_tlb_entry_t));
+        entry->physical = physical_page;
+    }
+
+    // If a store succeeded, loads from the same page will too.
+    entry->load_tag = tag;
+    if (bus_access == BUS_STORE) {
+        entry->store_tag = tag;
     }
 }
 
@@ -154,6 +284,7 @@ u64 resolve_virtual_address_for_jit(u64 virtual, u64 except_pc, bus_access_t bus
 
     bool cached; // ignored for now
     if (resolve_virtual_address(virtual, bus_access, &cached, &physical)) {
+        fill_jit_tlb(virtual, physical, bus_access);
         return physical;
     } else {
         on_tlb_exception(virtual);
@@ -192,17 +323,169 @@ int idle_loop_replacement() {
     return ticks_to_skip;
 }
 
-void v2_compile_new_block(
-        n64_dynarec_block_t* block,
-        bool* code_mask,
-        u64 virtual_address,
-        u32 physical_address) {
+#define BUSY_WAIT_MAX_LENGTH 16
+
+// Finds the registers an instruction in a busy wait loop reads and writes. Returns false if it could do anything else,
+// like write to memory, touch a coprocessor or HI/LO, or raise an exception other than from a load's address.
+static bool busy_wait_instruction(mips_instruction_t instr, u32* reads, u32* writes) {
+    *reads = 0;
+    *writes = 0;
+    switch (instr.op) {
+        case OPC_LB:
+        case OPC_LBU:
+        case OPC_LH:
+        case OPC_LHU:
+        case OPC_LW:
+        case OPC_LWU:
+        case OPC_LD:
+        case OPC_ADDIU:
+        case OPC_DADDIU:
+        case OPC_ANDI:
+        case OPC_ORI:
+        case OPC_XORI:
+        case OPC_SLTI:
+        case OPC_SLTIU:
+            *reads = 1 << instr.i.rs;
+            *writes = 1 << instr.i.rt;
+            break;
+        case OPC_LUI:
+            *writes = 1 << instr.i.rt;
+            break;
+        case OPC_BEQ:
+        case OPC_BEQL:
+        case OPC_BNE:
+        case OPC_BNEL:
+            *reads = (1 << instr.i.rs) | (1 << instr.i.rt);
+            break;
+        case OPC_BGTZ:
+        case OPC_BGTZL:
+        case OPC_BLEZ:
+        case OPC_BLEZL:
+            *reads = 1 << instr.i.rs;
+            break;
+        case OPC_J:
+            break;
+        case OPC_REGIMM:
+            switch (instr.i.rt) {
+                case RT_BLTZ:
+                case RT_BLTZL:
+                case RT_BGEZ:
+                case RT_BGEZL:
+                    *reads = 1 << instr.i.rs;
+                    break;
+                default:
+                    return false;
+            }
+            break;
+        case OPC_SPCL:
+            switch (instr.r.funct) {
+                case FUNCT_SLL:
+                case FUNCT_SRL:
+                case FUNCT_SRA:
+                case FUNCT_DSLL:
+                case FUNCT_DSRL:
+                case FUNCT_DSRA:
+                case FUNCT_DSLL32:
+                case FUNCT_DSRL32:
+                case FUNCT_DSRA32:
+                    *reads = 1 << instr.r.rt;
+                    *writes = 1 << instr.r.rd;
+                    break;
+                case FUNCT_SLLV:
+                case FUNCT_SRLV:
+                case FUNCT_SRAV:
+                case FUNCT_DSLLV:
+                case FUNCT_DSRLV:
+                case FUNCT_DSRAV:
+                case FUNCT_ADDU:
+                case FUNCT_SUBU:
+                case FUNCT_DADDU:
+                case FUNCT_DSUBU:
+                case FUNCT_AND:
+                case FUNCT_OR:
+                case FUNCT_XOR:
+                case FUNCT_NOR:
+                case FUNCT_SLT:
+                case FUNCT_SLTU:
+                    *reads = (1 << instr.r.rs) | (1 << instr.r.rt);
+                    *writes = 1 << instr.r.rd;
+                    break;
+                default:
+                    return false;
+            }
+            break;
+        default:
+            return false;
+    }
+    // r0 is never really read or written
+    *reads &= ~1;
+    *writes &= ~1;
+    return true;
+}
+
+// A short block that branches back to its own start, only reads memory, and doesn't carry any register values from one
+// time around the loop to the next, does exactly the same thing every time until something it reads changes.
+// Other than the CPU itself, nothing changes memory or MMIO registers between scheduler events, so once such a loop goes
+// around, it can skip straight to the next event. This covers polling RDRAM variables set by interrupt handlers, and
+// MMIO registers like VI_V_CURRENT.
+bool detect_busy_wait_loop(u64 virtual_address) {
+    if (!v2_idle_loop_detection_enabled || temp_code_is_trace) {
+        return false;
+    }
+    if (temp_code_len < 2 || temp_code_len > BUSY_WAIT_MAX_LENGTH) {
+        return false;
+    }
+
+    int branch_index = temp_code_len - 2;
+    u64 target;
+    if (!is_branch(temp_code_category[branch_index]) || !v2_branch_target(temp_code[branch_index], temp_code_vaddrs[branch_index], &target) || target != virtual_address) {
+        return false;
+    }
+
+    u32 reads[BUSY_WAIT_MAX_LENGTH];
+    u32 writes[BUSY_WAIT_MAX_LENGTH];
+    u32 written_in_loop = 0;
+    for (int i = 0; i < temp_code_len; i++) {
+        if (temp_code_vaddrs[i] != virtual_address + i * 4) {
+            return false;
+        }
+        if (i < branch_index && is_branch(temp_code_category[i])) {
+            return false;
+        }
+        if (!busy_wait_instruction(temp_code[i], &reads[i], &writes[i])) {
+            return false;
+        }
+        written_in_loop |= writes[i];
+    }
 
-    fill_temp_code(virtual_address, physical_address, code_mask);
+    // Every register the loop writes has to be written before it's read, so nothing depends on the last time around
+    u32 written_so_far = 0;
+    for (int i = 0; i < temp_code_len; i++) {
+        if (reads[i] & written_in_loop & ~written_so_far) {
+            return false;
+        }
+        written_so_far |= writes[i];
+    }
+    return true;
+}
+
+int v2_busy_wait_skip(int block_length) {
+    u64 ran = (u64)(N64CPU.block_link_cycles + block_length) * CYCLES_PER_INSTR;
+    u64 until_event = scheduler_ticks_until_next_event();
+    if (until_event <= ran) {
+        return block_length;
+    }
+    return block_length + (until_event - ran + CYCLES_PER_INSTR - 1) / CYCLES_PER_INSTR;
+}
 
-    if (detect_idle_loop(virtual_address)) {
+// Compile what fill_temp_code() loaded into the current compiler instance's temp_code
+void v2_compile_temp_code(n64_dynarec_block_t* block, u64 virtual_address, u32 physical_address) {
+    if (!temp_code_is_trace && detect_idle_loop(virtual_address)) {
         block->run = idle_loop_replacement;
-        block->guest_size = 0;
+        block->link_entry = NULL;
+        block->bound_link_entry = NULL;
+        block->entry_bindings = REGISTER_BINDINGS_NONE;
+        block->guest_size = temp_code_len * 4; // so writes to the loop still invalidate it
         block->host_size = 0;
         return;
     }
@@ -210,6 +493,8 @@ void v2_compile_new_block(
     ir_context_reset();
     ir_context.block_start_virtual = virtual_address;
     ir_context.block_start_physical = physical_address;
+    ir_context.busy_wait = detect_busy_wait_loop(virtual_address);
+    ir_context.sysconfig = block->sysconfig;
 #ifdef N64_LOG_COMPILATIONS
     printf("Translating to IR:\n");
 #endif
@@ -223,14 +508,33 @@ void v2_compile_new_block(
         temp_code_len--;
     }
 
+    ir_instruction_t* trace_branch_condition = NULL;
     for (int i = 0; i < temp_code_len; i++) {
-        u64 instr_virtual_address = virtual_address + (i << 2);
-        u32 instr_physical_address = physical_address + (i << 2);
-        emit_instruction_ir(temp_code[i], i, instr_virtual_address, instr_physical_address);
+        // Branches a superblock keeps going past don't end it, the side exit for the other direction is added below
+        ir_context.trace_branch = temp_code_trace[i] != TRACE_BRANCH_EXIT;
+        ir_context.trace_branch_condition = NULL;
+        emit_instruction_ir(temp_code[i], i, temp_code_vaddrs[i], temp_code_paddrs[i]);
+        ir_context.trace_branch = false;
+
+        if (i > 0 && temp_code_trace[i - 1] != TRACE_BRANCH_EXIT) {
+            // Just emitted the delay slot. Likely and unconditional branches have no condition left to check here.
+            if (trace_branch_condition != NULL) {
+                bool follow_taken = temp_code_trace[i - 1] == TRACE_BRANCH_FOLLOW_TAKEN;
+                u64 exit_pc = temp_code_vaddrs[i - 1] + 8;
+                if (!follow_taken) {
+                    v2_branch_target(temp_code[i - 1], temp_code_vaddrs[i - 1], &exit_pc);
+                }
+                ir_instruction_t* leave_trace = follow_taken ? ir_emit_boolean_not(trace_branch_condition, NO_GUEST_REG) : trace_branch_condition;
+                ir_emit_conditional_block_exit_address(i, leave_trace, ir_emit_set_constant_64(exit_pc, NO_GUEST_REG));
+            }
+            // TLB lookups in the delay slot set this, and exceptions after it aren't in one
+            ir_emit_set_ptr(VALUE_TYPE_U8, &N64CPU.prev_branch, ir_emit_set_constant_u16(0, NO_GUEST_REG));
+        }
+        trace_branch_condition = ir_context.trace_branch_condition;
     }
 
     if (!ir_context.block_end_pc_ir_emitted && temp_code_len > 0) {
-        ir_instruction_t* end_pc = ir_emit_set_constant_64(virtual_address + (temp_code_len << 2), NO_GUEST_REG);
+        ir_instruction_t* end_pc = ir_emit_set_constant_64(temp_code_vaddrs[temp_code_len - 1] + 4, NO_GUEST_REG);
         ir_emit_set_block_exit_pc(end_pc);
     }
 
@@ -243,9 +547,13 @@ void v2_compile_new_block(
     print_ir_block();
     printf("Optimizing:\n");
 #endif
+    ir_optimize_constant_propagation();
+    ir_optimize_common_subexpressions();
+    // Loads forwarded from stores of constants are constants now, fold whatever uses them
     ir_optimize_constant_propagation();
     ir_optimize_eliminate_dead_code();
     ir_optimize_shrink_constants();
+    ir_optimize_hoist_guest_reg_loads();
     ir_allocate_registers();
 #ifdef N64_LOG_COMPILATIONS
     print_ir_block();
@@ -268,6 +576,36 @@ void v2_compile_new_block(
 #endif
 }
 
+void v2_compile_new_block(
+        n64_dynarec_block_t* block,
+        n64_dynarec_page_t* page,
+        u64 virtual_address,
+        u32 physical_address) {
+    if (v2_compiler_ptr == NULL) {
+        v2_compiler_bind_instance(&emulation_thread_compiler);
+    }
+
+    fill_temp_code(virtual_address, physical_address, page);
+    v2_compile_temp_code(block, virtual_address, physical_address);
+}
+
+// Returns false without compiling anything if the block's branches don't lead anywhere a superblock could follow
+bool v2_compile_superblock(
+        n64_dynarec_block_t* block,
+        n64_dynarec_page_t* page,
+        u64 virtual_address,
+        u32 physical_address) {
+    if (v2_compiler_ptr == NULL) {
+        v2_compiler_bind_instance(&emulation_thread_compiler);
+    }
+
+    if (!fill_trace_code(virtual_address, physical_address, page, block->sysconfig)) {
+        return false;
+    }
+    v2_compile_temp_code(block, virtual_address, physical_address);
+    return true;
+}
+
 void v2_compiler_init() {
     N64CPU.s_mask[0] = 0xFFFFFFFF;
     N64CPU.d_mask[0] = 0xFFFFFFFFFFFFFFFF;
@@ -285,4 +623,12 @@ void v2_compiler_init() {
 
 void v2_set_idle_loop_detection_enabled(bool enabled) {
     v2_idle_loop_detection_enabled = enabled;
+}
+
+void v2_set_superblocks_enabled(bool enabled) {
+    v2_superblocks_enabled_flag = enabled;
+}
+
+bool v2_superblocks_enabled() {
+    return v2_superblocks_enabled_flag;
 }
\ No newline at end of file
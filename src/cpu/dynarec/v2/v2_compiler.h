@@ -2,6 +2,7 @@
 #define N64_V2_COMPILER_H
 
 #include <dynarec/dynarec.h>
+#include "ir_context.h"
 
 INLINE bool is_memory(u64 address) {
     return false; // TODO
@@ -10,17 +11,60 @@ INLINE bool is_memory(u64 address) {
 // Extra slot for the edge case where the branch delay slot is in the next page
 #define TEMP_CODE_SIZE (BLOCKCACHE_INNER_SIZE + 1)
 #define MAX_BLOCK_LENGTH BLOCKCACHE_INNER_SIZE
+// Blocks a superblock can be made of
+#define V2_MAX_TRACE_SEGMENTS 8
 
-extern int temp_code_len;
-extern u64 temp_code_vaddr;
-extern mips_instruction_t temp_code[TEMP_CODE_SIZE];
-extern dynarec_instruction_category_t temp_code_category[TEMP_CODE_SIZE];
+typedef enum v2_trace_branch {
+    TRACE_BRANCH_EXIT, // not a branch, or the block exits through it like normal
+    TRACE_BRANCH_FOLLOW_TAKEN,
+    TRACE_BRANCH_FOLLOW_NOT_TAKEN
+} v2_trace_branch_t;
+
+// Everything one compile needs. The emulation thread and the compile thread each have their own.
+typedef struct v2_compiler_instance {
+    ir_context_t ir; // not named ir_context, since that name is taken by the accessor macro
+
+    int code_len;
+    u64 code_vaddr;
+    mips_instruction_t code[TEMP_CODE_SIZE];
+    dynarec_instruction_category_t code_category[TEMP_CODE_SIZE];
+    // Only contiguous in regular blocks, superblocks jump around within the page
+    u64 code_vaddrs[TEMP_CODE_SIZE];
+    u32 code_paddrs[TEMP_CODE_SIZE];
+    v2_trace_branch_t code_trace[TEMP_CODE_SIZE];
+    bool code_is_trace;
+
+    // Encode blocks into malloc()ed memory instead of the code cache. They're copied in later by the emulation thread.
+    bool private_output;
+} v2_compiler_instance_t;
+
+extern N64_THREAD_LOCAL v2_compiler_instance_t* v2_compiler_ptr;
+#define temp_code_len (v2_compiler_ptr->code_len)
+#define temp_code_vaddr (v2_compiler_ptr->code_vaddr)
+#define temp_code (v2_compiler_ptr->code)
+#define temp_code_category (v2_compiler_ptr->code_category)
+#define temp_code_vaddrs (v2_compiler_ptr->code_vaddrs)
+#define temp_code_paddrs (v2_compiler_ptr->code_paddrs)
+#define temp_code_trace (v2_compiler_ptr->code_trace)
+#define temp_code_is_trace (v2_compiler_ptr->code_is_trace)
+
+void v2_compiler_bind_instance(v2_compiler_instance_t* instance);
 
 bool should_break(u32 address);
 u64 resolve_virtual_address_for_jit(u64 virtual, u64 except_pc, bus_access_t bus_access);
 u64 v2_get_last_compiled_block();
-void v2_compile_new_block(n64_dynarec_block_t *block, bool *code_mask, u64 virtual_address, u32 physical_address);
+void fill_temp_code(u64 virtual_address, u32 physical_address, n64_dynarec_page_t* page);
+bool fill_trace_code(u64 virtual_address, u32 physical_address, n64_dynarec_page_t* page, n64_block_sysconfig_t sysconfig);
+bool v2_branch_target(mips_instruction_t instr, u64 virtual_address, u64* target);
+void v2_compile_temp_code(n64_dynarec_block_t* block, u64 virtual_address, u32 physical_address);
+void v2_compile_new_block(n64_dynarec_block_t *block, n64_dynarec_page_t *page, u64 virtual_address, u32 physical_address);
+bool v2_compile_superblock(n64_dynarec_block_t *block, n64_dynarec_page_t *page, u64 virtual_address, u32 physical_address);
 void v2_compiler_init();
 void v2_set_idle_loop_detection_enabled(bool enabled);
+// Called when a busy wait loop goes around again. Returns how many instructions to count the block as, to get to the next
+// scheduler event.
+int v2_busy_wait_skip(int block_length);
+void v2_set_superblocks_enabled(bool enabled);
+bool v2_superblocks_enabled();
 
 #endif // N64_V2_COMPILER_H
\ No newline at end of file
@@ -1,11 +1,13 @@
 #include "v2_compiler_platformspecific.h"
 #include "v2_emitter.h"
 #include "ir_optimizer.h"
+#include "register_allocator.h"
 #include "v2_compiler.h"
 #include <dynarec/dynarec_memory_management.h>
 #include <mem/n64bus.h>
 #include <mips_instructions.h>
 #include <perf_map_file.h>
+#include "v2_persistent_cache.h"
 #include <r4300i_register_access.h>
 #include <system/mprotect_utils.h>
 
@@ -125,32 +127,30 @@ void compile_ir_store(dasm_State** Dst, ir_instruction_t* instr) {
     if (instr_valid_immediate(instr->store.address) && is_memory(const_to_u64(instr->store.address))) {
         logfatal("Emitting IR_STORE directly to memory");
     } else {
+        uintptr_t fp;
         switch (instr->store.type) {
             case VALUE_TYPE_S8:
             case VALUE_TYPE_U8:
-                val_to_func_arg(Dst, instr->store.address, 0);
-                val_to_func_arg(Dst, instr->store.value, 1);
-                host_emit_call(Dst, (uintptr_t)n64_write_physical_byte);
+                fp = (uintptr_t)n64_write_physical_byte;
                 break;
             case VALUE_TYPE_S16:
             case VALUE_TYPE_U16:
-                val_to_func_arg(Dst, instr->store.address, 0);
-                val_to_func_arg(Dst, instr->store.value, 1);
-                host_emit_call(Dst, (uintptr_t)n64_write_physical_half);
+                fp = (uintptr_t)n64_write_physical_half;
                 break;
             case VALUE_TYPE_S32:
             case VALUE_TYPE_U32:
-                val_to_func_arg(Dst, instr->store.address, 0);
-                val_to_func_arg(Dst, instr->store.value, 1);
-                host_emit_call(Dst, (uintptr_t)n64_write_physical_word);
+                fp = (uintptr_t)n64_write_physical_word;
                 break;
             case VALUE_TYPE_U64:
             case VALUE_TYPE_S64:
-                val_to_func_arg(Dst, instr->store.address, 0);
-                val_to_func_arg(Dst, instr->store.value, 1);
-                host_emit_call(Dst, (uintptr_t)n64_write_physical_dword);
+                fp = (uintptr_t)n64_write_physical_dword;
                 break;
         }
+
+        val_to_func_arg(Dst, instr->store.address, 0);
+        val_to_func_arg(Dst, instr->store.value, 1);
+        // RDRAM is written inline, everything else calls fp
+        host_emit_fastmem_store(Dst, instr->store.type, fp);
     }
 }
 
@@ -180,7 +180,8 @@ void compile_ir_load(dasm_State** Dst, ir_instruction_t* instr) {
         }
 
         val_to_func_arg(Dst, instr->load.address, 0);
-        host_emit_call(Dst, fp);
+        // RDRAM is read inline, everything else calls fp
+        host_emit_fastmem_load(Dst, instr->load.type, fp);
         host_emit_mov_reg_reg(Dst, instr->reg_alloc, alloc_gpr(get_return_value_reg()), instr->load.type);
     }
 }
@@ -229,11 +230,22 @@ void compile_ir_set_cond_block_exit_pc(dasm_State** Dst, ir_instruction_t* instr
     } else {
         host_emit_cmov_pc_binary(Dst, instr->set_cond_exit_pc.condition->reg_alloc, instr->set_cond_exit_pc.pc_if_true, instr->set_cond_exit_pc.pc_if_false);
     }
+
+    ir_context.num_exit_pc_targets = 0;
+    if (is_constant(instr->set_cond_exit_pc.pc_if_true) && is_constant(instr->set_cond_exit_pc.pc_if_false)) {
+        ir_context.exit_pc_targets[ir_context.num_exit_pc_targets++] = const_to_u64(instr->set_cond_exit_pc.pc_if_true);
+        ir_context.exit_pc_targets[ir_context.num_exit_pc_targets++] = const_to_u64(instr->set_cond_exit_pc.pc_if_false);
+    }
 }
 
 void compile_ir_set_block_exit_pc(dasm_State** Dst, ir_instruction_t* instr) {
     ir_context.block_end_pc_compiled = true;
     host_emit_mov_pc(Dst, instr->unary_op.operand);
+
+    ir_context.num_exit_pc_targets = 0;
+    if (is_constant(instr->unary_op.operand)) {
+        ir_context.exit_pc_targets[ir_context.num_exit_pc_targets++] = const_to_u64(instr->unary_op.operand);
+    }
 }
 
 
@@ -242,26 +254,14 @@ void compile_ir_tlb_lookup(dasm_State** Dst, ir_instruction_t* instr) {
         logfatal("TLB lookup compiled with a block length of %d", instr->block_length);
     }
     bool prev_branch = instr->block_length > 1 && (temp_code_category[instr->block_length - 2] == BRANCH || temp_code_category[instr->block_length - 2] == BRANCH_LIKELY);
-    static_assert(sizeof(N64CPU.prev_branch) == 1, "prev_branch should be one byte");
-
-    ir_set_constant_t prev_branch_const = { .type = VALUE_TYPE_U8, .value_u8 = prev_branch };
-    host_emit_mov_mem_imm(Dst, (uintptr_t)&N64CPU.prev_branch, prev_branch_const, VALUE_TYPE_U8);
 
     ir_register_allocation_t return_value_reg = alloc_gpr(get_return_value_reg());
     val_to_func_arg(Dst, instr->tlb_lookup.virtual_address, 0);
 
     // faulting pc for if an exception occurs
-    ir_set_constant_t except_pc;
-    except_pc.type = VALUE_TYPE_U64;
-    except_pc.value_u64 = temp_code_vaddr + ((instr->block_length - 1) * 4u);
-    host_emit_mov_reg_imm(Dst, alloc_gpr(get_func_arg_registers()[1]), except_pc);
+    u64 except_pc = temp_code_vaddrs[instr->block_length - 1];
 
-    ir_set_constant_t bus_access;
-    bus_access.type = VALUE_TYPE_U16;
-    bus_access.value_u16 = instr->tlb_lookup.bus_access;
-    host_emit_mov_reg_imm(Dst, alloc_gpr(get_func_arg_registers()[2]), bus_access);
-
-    host_emit_call(Dst, (uintptr_t)resolve_virtual_address_for_jit);
+    host_emit_tlb_lookup(Dst, instr->tlb_lookup.bus_access, instr->tlb_lookup.mode, except_pc, prev_branch);
     // Move the full value into the destination reg. Don't need to worry about the success bit, because if that bit is set, the return value is junk anyway.
     host_emit_mov_reg_reg(Dst, instr->reg_alloc, return_value_reg, VALUE_TYPE_U64);
     // Shift the success bit into bit 0
@@ -365,54 +365,7 @@ void evaluate_const_multiply(dasm_State** Dst, ir_set_constant_t operand1, ir_se
 
     result_lo.type = VALUE_TYPE_S64;
     result_hi.type = VALUE_TYPE_S64;
-
-    switch (type) {
-        case VALUE_TYPE_U8:
-            logfatal("const VALUE_TYPE_U8 multiply");
-            break;
-        case VALUE_TYPE_S8:
-            logfatal("const VALUE_TYPE_S8 multiply");
-            break;
-        case VALUE_TYPE_S16:
-            logfatal("const VALUE_TYPE_S16 multiply");
-            break;
-        case VALUE_TYPE_U16:
-            logfatal("const VALUE_TYPE_U16 multiply");
-            break;
-        case VALUE_TYPE_S32: {
-            s64 multiplicand_1 = set_const_to_s32(operand1);
-            s64 multiplicand_2 = set_const_to_s32(operand2);
-
-            s64 result = multiplicand_1 * multiplicand_2;
-
-            s32 result_lower = result & 0xFFFFFFFF;
-            s32 result_upper = (result >> 32) & 0xFFFFFFFF;
-
-            result_lo.value_s64 = (s64)result_lower;
-            result_hi.value_s64 = (s64)result_upper;
-            break;
-        }
-        case VALUE_TYPE_U32: {
-            u64 multiplicand_1 = set_const_to_u32(operand1);
-            u64 multiplicand_2 = set_const_to_u32(operand2);
-
-            u64 result = multiplicand_1 * multiplicand_2;
-
-            s32 result_lower = result & 0xFFFFFFFF;
-            s32 result_upper = (result >> 32) & 0xFFFFFFFF;
-
-            result_lo.value_s64 = (s64)result_lower;
-            result_hi.value_s64 = (s64)result_upper;
-            break;
-        }
-        case VALUE_TYPE_U64:
-            result_lo.value_s64 = multu_64_to_128(set_const_to_u64(operand1), set_const_to_u64(operand2), (u64*)&result_hi.value_s64);
-            break;
-        case VALUE_TYPE_S64: {
-            result_lo.value_s64 = mult_64_to_128(set_const_to_s64(operand1), set_const_to_s64(operand2), (u64*)&result_hi.value_s64);
-            break;
-        }
-    }
+    ir_evaluate_const_multiply(operand1, operand2, type, (u64*)&result_lo.value_s64, (u64*)&result_hi.value_s64);
 
     host_emit_mov_mem_imm(Dst, (uintptr_t)&N64CPU.mult_lo, result_lo, VALUE_TYPE_S64);
     host_emit_mov_mem_imm(Dst, (uintptr_t)&N64CPU.mult_hi, result_hi, VALUE_TYPE_S64);
@@ -424,95 +377,7 @@ void evaluate_const_divide(dasm_State** Dst, ir_set_constant_t operand_dividend,
 
     result_quotient.type = VALUE_TYPE_S64;
     result_remainder.type = VALUE_TYPE_S64;
-
-    switch (type) {
-        case VALUE_TYPE_U8:
-            logfatal("const VALUE_TYPE_U8 divide");
-            break;
-        case VALUE_TYPE_S8:
-            logfatal("const VALUE_TYPE_S8 divide");
-            break;
-        case VALUE_TYPE_S16:
-            logfatal("const VALUE_TYPE_S16 divide");
-            break;
-        case VALUE_TYPE_U16:
-            logfatal("const VALUE_TYPE_U16 divide");
-            break;
-        case VALUE_TYPE_S32: {
-            s64 dividend = set_const_to_s32(operand_dividend);
-            s64 divisor = set_const_to_s32(operand_divisor);
-
-            if (divisor == 0) {
-                logwarn("Divide by zero");
-                result_remainder.value_s64 = dividend;
-                if (dividend >= 0) {
-                    result_quotient.value_s64 = -1;
-                } else {
-                    result_quotient.value_s64 = 1;
-                }
-            } else {
-                s32 quotient = dividend / divisor;
-                s32 remainder = dividend % divisor;
-
-                result_quotient.value_s64 = quotient;
-                result_remainder.value_s64 = remainder;
-            }
-            break;
-        }
-        case VALUE_TYPE_U32: {
-            u32 dividend = set_const_to_u32(operand_dividend);
-            u32 divisor  = set_const_to_u32(operand_divisor);
-
-            if (divisor == 0) {
-                result_quotient.value_s64 = 0xFFFFFFFFFFFFFFFF;
-                result_remainder.value_s64 = (s32)dividend;
-            } else {
-                s32 quotient  = dividend / divisor;
-                s32 remainder = dividend % divisor;
-
-                result_quotient.value_s64 = quotient;
-                result_remainder.value_s64 = remainder;
-            }
-            break;
-        }
-        case VALUE_TYPE_U64: {
-            u64 dividend = set_const_to_u64(operand_dividend);
-            u64 divisor  = set_const_to_u64(operand_divisor);
-
-            if (divisor == 0) {
-                result_quotient.value_s64 = 0xFFFFFFFFFFFFFFFF;
-                result_remainder.value_s64 = dividend;
-            } else {
-                u64 quotient  = dividend / divisor;
-                u64 remainder = dividend % divisor;
-
-                result_quotient.value_s64 = quotient;
-                result_remainder.value_s64 = remainder;
-            }
-            break;
-        }
-        case VALUE_TYPE_S64: {
-            s64 dividend = set_const_to_s64(operand_dividend);
-            s64 divisor  = set_const_to_s64(operand_divisor);
-
-            if (unlikely(divisor == 0)) {
-                logwarn("Divide by zero");
-                result_remainder.value_s64 = dividend;
-                if (dividend >= 0) {
-                    result_quotient.value_s64 = (s64)-1;
-                } else {
-                    result_quotient.value_s64 = (s64)1;
-                }
-            } else if (unlikely(divisor == -1 && dividend == INT64_MIN)) {
-                result_quotient.value_s64 = dividend;
-                result_remainder.value_s64 = 0;
-            } else {
-                result_quotient.value_s64 = (s64)(dividend / divisor);;
-                result_remainder.value_s64 = (s64)(dividend % divisor);
-            }
-            break;
-        }
-    }
+    ir_evaluate_const_divide(operand_dividend, operand_divisor, type, (u64*)&result_quotient.value_s64, (u64*)&result_remainder.value_s64);
 
     host_emit_mov_mem_imm(Dst, (uintptr_t)&N64CPU.mult_lo, result_quotient, VALUE_TYPE_S64);
     host_emit_mov_mem_imm(Dst, (uintptr_t)&N64CPU.mult_hi, result_remainder, VALUE_TYPE_S64);
@@ -638,10 +503,26 @@ void compile_ir_set_float_constant(dasm_State** Dst, ir_instruction_t* instr) {
     host_emit_mov_fgr_gpr(Dst, instr->reg_alloc, TMPREG1_ALLOC, c.type);
 }
 
+// The host runs in round to nearest. Blocks compiled for another FCR31 rounding mode switch to it around each float op
+// that rounds, so round to nearest blocks, by far the most common, get plain SSE.
+INLINE void begin_guest_rounding(dasm_State** Dst) {
+    if (ir_context.sysconfig.fpu_rounding != R4300I_CP1_ROUND_NEAREST) {
+        host_emit_set_rounding_mode(Dst, ir_context.sysconfig.fpu_rounding);
+    }
+}
+
+INLINE void end_guest_rounding(dasm_State** Dst) {
+    if (ir_context.sysconfig.fpu_rounding != R4300I_CP1_ROUND_NEAREST) {
+        host_emit_set_rounding_mode(Dst, R4300I_CP1_ROUND_NEAREST);
+    }
+}
+
 void compile_ir_float_convert(dasm_State** Dst, ir_instruction_t* instr) {
     switch (instr->float_convert.mode) {
         case FLOAT_CONVERT_MODE_CONVERT:
+            begin_guest_rounding(Dst);
             host_emit_float_convert_reg_reg(Dst, instr->float_convert.from_type, instr->float_convert.value->reg_alloc, instr->float_convert.to_type, instr->reg_alloc);
+            end_guest_rounding(Dst);
             break;
         case FLOAT_CONVERT_MODE_TRUNC:
             host_emit_float_trunc_reg_reg(Dst, instr->float_convert.from_type, instr->float_convert.value->reg_alloc, instr->float_convert.to_type, instr->reg_alloc);
@@ -659,28 +540,38 @@ void compile_ir_float_divide(dasm_State** Dst, ir_instruction_t* instr) {
     unimplemented(is_constant(instr->float_bin_op.operand1), "float div with constant dividend");
     unimplemented(is_constant(instr->float_bin_op.operand2), "float div with constant divisor");
     host_emit_mov_fgr_fgr(Dst, instr->reg_alloc, instr->float_bin_op.operand1->reg_alloc, instr->float_bin_op.format);
+    begin_guest_rounding(Dst);
     host_emit_float_div_reg_reg(Dst, instr->reg_alloc, instr->float_bin_op.operand2->reg_alloc, instr->float_bin_op.format);
+    end_guest_rounding(Dst);
 }
 
 void compile_ir_float_multiply(dasm_State** Dst, ir_instruction_t* instr) {
     unimplemented(is_constant(instr->float_bin_op.operand1), "float mult with constant multiplicand1");
     unimplemented(is_constant(instr->float_bin_op.operand2), "float mult with constant multiplicand2");
     host_emit_mov_fgr_fgr(Dst, instr->reg_alloc, instr->float_bin_op.operand1->reg_alloc, instr->float_bin_op.format);
+    begin_guest_rounding(Dst);
     host_emit_float_mult_reg_reg(Dst, instr->reg_alloc, instr->float_bin_op.operand2->reg_alloc, instr->float_bin_op.format);
+    end_guest_rounding(Dst);
 }
 
 void compile_ir_float_add(dasm_State** Dst, ir_instruction_t* instr) {
     host_emit_mov_fgr_fgr(Dst, instr->reg_alloc, instr->float_bin_op.operand1->reg_alloc, instr->float_bin_op.format);
+    begin_guest_rounding(Dst);
     host_emit_float_add_reg_reg(Dst, instr->reg_alloc, instr->float_bin_op.operand2->reg_alloc, instr->float_bin_op.format);
+    end_guest_rounding(Dst);
 }
 
 void compile_ir_float_sub(dasm_State** Dst, ir_instruction_t* instr) {
     host_emit_mov_fgr_fgr(Dst, instr->reg_alloc, instr->float_bin_op.operand1->reg_alloc, instr->float_bin_op.format);
+    begin_guest_rounding(Dst);
     host_emit_float_sub_reg_reg(Dst, instr->reg_alloc, instr->float_bin_op.operand2->reg_alloc, instr->float_bin_op.format);
+    end_guest_rounding(Dst);
 }
 
 void compile_ir_float_sqrt(dasm_State** Dst, ir_instruction_t* instr) {
+    begin_guest_rounding(Dst);
     host_emit_float_sqrt_reg_reg(Dst, instr->reg_alloc, instr->float_unary_op.operand->reg_alloc, instr->float_unary_op.format);
+    end_guest_rounding(Dst);
 }
 
 void compile_ir_float_neg(dasm_State** Dst, ir_instruction_t* instr) {
@@ -830,7 +721,23 @@ void v2_emit_block(n64_dynarec_block_t* block, u32 physical_address) {
     if (should_break(physical_address)) {
         host_emit_debugbreak(Dst);
     }
+    // The hoisted guest register loads that ended up in host registers come first, so linked blocks that already have
+    // them there can skip them. The spilled ones have to be loaded no matter what.
     ir_instruction_t* instr = ir_context.ir_cache_head;
+    for (int i = 0; i < ir_context.num_hoisted_guest_reg_loads; i++) {
+        if (!instr->reg_alloc.spilled) {
+            v2_emit_instr(Dst, instr);
+        }
+        instr = instr->next;
+    }
+    v2_bound_link_entry(Dst);
+    instr = ir_context.ir_cache_head;
+    for (int i = 0; i < ir_context.num_hoisted_guest_reg_loads; i++) {
+        if (instr->reg_alloc.spilled) {
+            v2_emit_instr(Dst, instr);
+        }
+        instr = instr->next;
+    }
     while (instr) {
         v2_emit_instr(Dst, instr);
         instr = instr->next;
@@ -839,19 +746,53 @@ void v2_emit_block(n64_dynarec_block_t* block, u32 physical_address) {
     if (!ir_context.block_end_pc_compiled && temp_code_len > 0) {
         logfatal("TODO: emit end of block PC");
     }
-    v2_end_block(Dst, temp_code_len);
+    u64 exit_bindings = ir_exit_register_bindings();
+    int num_exit_links = v2_end_block(Dst, temp_code_len);
     size_t code_size = v2_link(Dst);
 #ifdef N64_LOG_COMPILATIONS
     printf("Generated %zu bytes of code\n", code_size);
 #endif
-    block->guest_size = temp_code_len * 4;
+    // Superblocks can jump backwards in the page, so they cover everything between their lowest and highest instruction
+    u32 guest_start = physical_address;
+    u32 guest_end = physical_address;
+    for (int i = 0; i < temp_code_len; i++) {
+        guest_start = temp_code_paddrs[i] < guest_start ? temp_code_paddrs[i] : guest_start;
+        guest_end = temp_code_paddrs[i] + 4 > guest_end ? temp_code_paddrs[i] + 4 : guest_end;
+    }
+    block->guest_start = guest_start;
+    block->guest_size = guest_end - guest_start;
     block->host_size = code_size;
-    block->run = (int(*)(r4300i_t *))dynarec_bumpalloc(code_size);
-
-    v2_encode(Dst, (u8*)block->run);
-    char block_name[500];
-    snprintf(block_name, 500, "cpu_jit_block_%08X", physical_address);
-    n64_perf_map_file_write((uintptr_t)block->run, code_size, block_name);
+    if (v2_compiler_ptr->private_output) {
+        block->run = malloc(code_size);
+    } else {
+        block->run = (int(*)(r4300i_t *))dynarec_alloc_code(code_size, physical_address);
+    }
+
+    u8* code = (u8*)block->run;
+    v2_encode(Dst, code);
+    block->link_entry = ir_context.count_accessed ? NULL : code + v2_get_label_offset(Dst, V2_LABEL_LINK_ENTRY);
+    block->entry_bindings = ir_entry_register_bindings();
+    block->bound_link_entry = NULL;
+    if (block->link_entry != NULL && block->entry_bindings != REGISTER_BINDINGS_NONE) {
+        block->bound_link_entry = code + v2_get_label_offset(Dst, V2_LABEL_BOUND_LINK_ENTRY);
+    }
+    for (int i = 0; i < num_exit_links; i++) {
+        int record_offset = v2_get_label_offset(Dst, V2_LABEL_EXIT_LINK_RECORD(i));
+        n64_dynarec_link_t* link = (n64_dynarec_link_t*)(code + record_offset);
+        memset(link, 0, sizeof(n64_dynarec_link_t));
+        link->target_virtual_address = ir_context.exit_pc_targets[i];
+        link->jump_end_offset = v2_get_label_offset(Dst, V2_LABEL_EXIT_LINK(i)) - record_offset;
+        link->sysconfig = block->sysconfig;
+        link->exit_bindings = exit_bindings;
+    }
+    if (v2_persistent_cache_enabled()) {
+        v2_persistent_cache_record(Dst, block, physical_address);
+    }
+    if (!v2_compiler_ptr->private_output) {
+        char block_name[500];
+        snprintf(block_name, 500, "cpu_jit_block_%08X", physical_address);
+        n64_perf_map_file_write((uintptr_t)block->run, code_size, block_name);
+    }
     v2_dasm_free();
 }
 
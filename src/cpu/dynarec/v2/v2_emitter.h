@@ -39,7 +39,22 @@ void host_emit_div_reg_imm(dasm_State** Dst, ir_register_allocation_t reg_alloc,
 void host_emit_div_imm_reg(dasm_State** Dst, ir_set_constant_t imm, ir_register_allocation_t reg_alloc, ir_value_type_t divide_type);
 void host_emit_div_reg_reg(dasm_State** Dst, ir_register_allocation_t operand1_alloc, ir_register_allocation_t operand2_alloc, ir_value_type_t divide_type);
 
-void v2_end_block(dasm_State** Dst, int block_length);
+// Dynamic labels marking the locations block linking needs to find after encoding
+#define V2_LABEL_LINK_ENTRY 0
+#define V2_LABEL_BOUND_LINK_ENTRY 1
+#define V2_LABEL_EXIT_LINK(index) (2 + (index))
+#define V2_LABEL_EXIT_LINK_RECORD(index) (2 + MAX_BLOCK_EXIT_LINKS + (index))
+// Just past each host_emit_mov_reg_host_ptr(), so the 64 bit immediate ends at the label
+#define V2_LABEL_HOST_POINTER(index) (2 + 2 * MAX_BLOCK_EXIT_LINKS + (index))
+
+// Host addresses baked into the block currently being emitted. If there were more than V2_MAX_HOST_POINTERS, only the
+// first V2_MAX_HOST_POINTERS are recorded, and the block can't be relocated.
+#define V2_MAX_HOST_POINTERS 1024
+extern N64_THREAD_LOCAL int v2_num_host_pointers;
+extern N64_THREAD_LOCAL uintptr_t v2_host_pointers[V2_MAX_HOST_POINTERS];
+
+int v2_end_block(dasm_State** Dst, int block_length);
+void v2_bound_link_entry(dasm_State** Dst);
 void host_emit_cmp_reg_imm(dasm_State** Dst, ir_register_allocation_t dest_reg_alloc, ir_condition_t cond, ir_register_allocation_t operand1_alloc, ir_set_constant_t operand2, enum args_reversed args_reversed);
 void host_emit_cmp_reg_reg(dasm_State** Dst, ir_register_allocation_t dest_reg_alloc, ir_condition_t cond, ir_register_allocation_t operand1_alloc, ir_register_allocation_t operand2_alloc, enum args_reversed args_reversed);
 void host_emit_cmov_pc_binary(dasm_State** Dst, ir_register_allocation_t cond_register_alloc, ir_instruction_t* if_true, ir_instruction_t* if_false);
@@ -67,13 +82,19 @@ void host_emit_float_div_reg_reg(dasm_State** Dst, ir_register_allocation_t oper
 void host_emit_float_mult_reg_reg(dasm_State** Dst, ir_register_allocation_t operand1_alloc, ir_register_allocation_t operand2_alloc, ir_float_value_type_t format);
 
 void host_emit_float_sqrt_reg_reg(dasm_State** Dst, ir_register_allocation_t dst_alloc, ir_register_allocation_t operand_alloc, ir_float_value_type_t format);
+// Sets the host rounding mode to one of the R4300I_CP1_ROUND_* modes. The rest of MXCSR is left alone.
+void host_emit_set_rounding_mode(dasm_State** Dst, int rounding_mode);
 void host_emit_float_abs_reg_reg(dasm_State** Dst, ir_register_allocation_t dst_alloc, ir_register_allocation_t operand_alloc, ir_float_value_type_t format);
 void host_emit_float_neg_reg_reg(dasm_State** Dst, ir_register_allocation_t dst_alloc, ir_register_allocation_t operand_alloc, ir_float_value_type_t format);
 
 void host_emit_float_cmp(dasm_State** Dst, ir_float_condition_t condition, ir_float_value_type_t format, ir_register_allocation_t operand1, ir_register_allocation_t operand2);
 
 void host_emit_debugbreak(dasm_State** Dst);
+void host_emit_mov_reg_host_ptr(dasm_State** Dst, int reg, uintptr_t ptr);
 void host_emit_call(dasm_State** Dst, uintptr_t function);
+void host_emit_fastmem_load(dasm_State** Dst, ir_value_type_t type, uintptr_t slow_path);
+void host_emit_fastmem_store(dasm_State** Dst, ir_value_type_t type, uintptr_t slow_path);
+void host_emit_tlb_lookup(dasm_State** Dst, bus_access_t bus_access, ir_tlb_lookup_mode_t mode, u64 except_pc, bool prev_branch);
 
 void host_emit_eret(dasm_State** Dst);
 
@@ -81,5 +102,6 @@ void host_emit_interpreter_fallback_until_no_branch(dasm_State** Dst, int extra_
 
 size_t v2_link(dasm_State** d);
 void v2_encode(dasm_State** d, u8* buf);
+int v2_get_label_offset(dasm_State** d, int label);
 
 #endif // N64_V2_EMITTER_H
@@ -0,0 +1,347 @@
+#include "v2_persistent_cache.h"
+#include "v2_compiler.h"
+#include "v2_emitter.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <SDL_mutex.h>
+#include <generated/version.h>
+#include <mem/n64bus.h>
+#include <log.h>
+
+#define PERSISTENT_CACHE_MAGIC "N64JIT1"
+#define PERSISTENT_CACHE_BUCKETS 4096
+#define BUCKET_INDEX(physical_address) (((physical_address) >> 2) & (PERSISTENT_CACHE_BUCKETS - 1))
+
+typedef struct v2_persistent_cache_header {
+    char magic[8];
+    char build[64];
+    u32 rom_crc1;
+    u32 rom_crc2;
+    u64 image_signature;
+    u32 n64cpu_size;
+    u32 num_blocks;
+} v2_persistent_cache_header_t;
+
+static bool persistent_cache_enabled = false;
+static bool loaded = false;
+static bool dirty = false;
+static char cache_path[PATH_MAX];
+static u32 rom_crc1;
+static u32 rom_crc2;
+
+static SDL_mutex* cache_lock = NULL;
+static v2_cached_block_t* buckets[PERSISTENT_CACHE_BUCKETS];
+static int num_blocks = 0;
+
+// Relocations against the emulator's own functions and globals are relative to this, so they survive ASLR
+#define IMAGE_BASE ((uintptr_t)&n64dynarec)
+
+// Changes when the emulator is rebuilt with a different layout, which makes every cached block useless
+INLINE u64 image_signature() {
+    return (uintptr_t)n64_read_physical_word - IMAGE_BASE;
+}
+
+INLINE u32 hash_guest_code(const u32* code, int words) {
+    u32 hash = 2166136261; // FNV-1a
+    for (int i = 0; i < words; i++) {
+        for (int b = 0; b < 4; b++) {
+            hash ^= (code[i] >> (b * 8)) & 0xFF;
+            hash *= 16777619;
+        }
+    }
+    return hash;
+}
+
+INLINE bool guest_code_matches(v2_cached_block_t* cached) {
+    for (int i = 0; i < cached->guest_words; i++) {
+        if (n64_read_physical_word(cached->physical_address + (i << 2)) != cached->guest_code[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void free_cached_block(v2_cached_block_t* cached) {
+    free(cached->guest_code);
+    free(cached->relocations);
+    free(cached->code);
+    free(cached);
+}
+
+static void clear_cache() {
+    for (int i = 0; i < PERSISTENT_CACHE_BUCKETS; i++) {
+        v2_cached_block_t* cached = buckets[i];
+        while (cached) {
+            v2_cached_block_t* next = cached->next;
+            free_cached_block(cached);
+            cached = next;
+        }
+        buckets[i] = NULL;
+    }
+    num_blocks = 0;
+}
+
+static void insert_cached_block(v2_cached_block_t* cached) {
+    int index = BUCKET_INDEX(cached->physical_address);
+    cached->next = buckets[index];
+    buckets[index] = cached;
+    num_blocks++;
+}
+
+void v2_set_persistent_cache_enabled(bool enabled) {
+    persistent_cache_enabled = enabled;
+}
+
+bool v2_persistent_cache_enabled() {
+    return persistent_cache_enabled;
+}
+
+static bool read_cached_block(FILE* f, v2_cached_block_t* cached) {
+    if (fread(cached, sizeof(v2_cached_block_t), 1, f) != 1) {
+        return false;
+    }
+    cached->guest_code = NULL;
+    cached->relocations = NULL;
+    cached->code = NULL;
+    cached->next = NULL;
+
+    if (cached->guest_words <= 0 || cached->guest_words > TEMP_CODE_SIZE
+        || cached->host_size <= 0 || cached->host_size > n64dynarec.code_region_size
+        || cached->num_relocations < 0 || cached->num_relocations > V2_MAX_HOST_POINTERS
+        || cached->link_entry_offset < -1 || cached->link_entry_offset >= cached->host_size
+        || cached->bound_link_entry_offset < -1 || cached->bound_link_entry_offset >= cached->host_size) {
+        return false;
+    }
+
+    cached->guest_code = malloc(cached->guest_words * sizeof(u32));
+    cached->relocations = malloc(cached->num_relocations * sizeof(v2_relocation_t));
+    cached->code = malloc(cached->host_size);
+    if (fread(cached->guest_code, sizeof(u32), cached->guest_words, f) != cached->guest_words
+        || fread(cached->relocations, sizeof(v2_relocation_t), cached->num_relocations, f) != cached->num_relocations
+        || fread(cached->code, 1, cached->host_size, f) != cached->host_size) {
+        return false;
+    }
+
+    // Every relocation patches a 64 bit immediate inside the block's code
+    for (int i = 0; i < cached->num_relocations; i++) {
+        v2_relocation_t* relocation = &cached->relocations[i];
+        if ((u64)relocation->code_offset + sizeof(u64) > (u64)cached->host_size) {
+            return false;
+        }
+        if (relocation->base != RELOCATION_BASE_IMAGE && relocation->base != RELOCATION_BASE_N64CPU) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void v2_persistent_cache_load(const char* rom_path, n64_rom_t* rom) {
+    if (!persistent_cache_enabled) {
+        return;
+    }
+
+    if (cache_lock == NULL) {
+        cache_lock = SDL_CreateMutex();
+    }
+
+    if (strlen(rom_path) + strlen(V2_PERSISTENT_CACHE_SUFFIX) >= PATH_MAX) {
+        logwarn("Path too long, not using a JIT cache file.");
+        return;
+    }
+    char path[PATH_MAX];
+    strcpy(path, rom_path);
+    strcat(path, V2_PERSISTENT_CACHE_SUFFIX);
+
+    // Resetting the system reloads the same ROM, keep what's already been cached
+    if (loaded && rom_crc1 == rom->header.crc1 && rom_crc2 == rom->header.crc2 && strcmp(cache_path, path) == 0) {
+        return;
+    }
+
+    v2_persistent_cache_save();
+    SDL_LockMutex(cache_lock);
+    clear_cache();
+    strcpy(cache_path, path);
+    rom_crc1 = rom->header.crc1;
+    rom_crc2 = rom->header.crc2;
+    loaded = true;
+    dirty = false;
+
+    FILE* f = fopen(cache_path, "rb");
+    if (f == NULL) {
+        SDL_UnlockMutex(cache_lock);
+        return;
+    }
+
+    v2_persistent_cache_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1
+        || memcmp(header.magic, PERSISTENT_CACHE_MAGIC, sizeof(PERSISTENT_CACHE_MAGIC)) != 0
+        || strncmp(header.build, N64_GIT_COMMIT_HASH, sizeof(header.build)) != 0
+        || header.image_signature != image_signature()
+        || header.n64cpu_size != sizeof(r4300i_t)) {
+        logwarn("%s was written by a different build, ignoring it", cache_path);
+    } else if (header.rom_crc1 != rom_crc1 || header.rom_crc2 != rom_crc2) {
+        logwarn("%s was written for a different ROM, ignoring it", cache_path);
+    } else {
+        for (int i = 0; i < header.num_blocks && num_blocks < V2_PERSISTENT_CACHE_MAX_BLOCKS; i++) {
+            v2_cached_block_t* cached = calloc(1, sizeof(v2_cached_block_t));
+            if (!read_cached_block(f, cached)) {
+                logwarn("%s is truncated or corrupt, only loaded %d blocks", cache_path, num_blocks);
+                free_cached_block(cached);
+                break;
+            }
+            insert_cached_block(cached);
+        }
+        loginfo("Loaded %d cached JIT blocks from %s", num_blocks, cache_path);
+    }
+    fclose(f);
+    SDL_UnlockMutex(cache_lock);
+}
+
+void v2_persistent_cache_save() {
+    if (!loaded || !dirty) {
+        return;
+    }
+
+    SDL_LockMutex(cache_lock);
+    FILE* f = fopen(cache_path, "wb");
+    if (f == NULL) {
+        logwarn("Failed to open %s for writing, not saving the JIT cache", cache_path);
+        SDL_UnlockMutex(cache_lock);
+        return;
+    }
+
+    v2_persistent_cache_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PERSISTENT_CACHE_MAGIC, sizeof(PERSISTENT_CACHE_MAGIC));
+    strncpy(header.build, N64_GIT_COMMIT_HASH, sizeof(header.build) - 1);
+    header.rom_crc1 = rom_crc1;
+    header.rom_crc2 = rom_crc2;
+    header.image_signature = image_signature();
+    header.n64cpu_size = sizeof(r4300i_t);
+    header.num_blocks = num_blocks;
+    fwrite(&header, sizeof(header), 1, f);
+
+    for (int i = 0; i < PERSISTENT_CACHE_BUCKETS; i++) {
+        for (v2_cached_block_t* cached = buckets[i]; cached != NULL; cached = cached->next) {
+            fwrite(cached, sizeof(v2_cached_block_t), 1, f);
+            fwrite(cached->guest_code, sizeof(u32), cached->guest_words, f);
+            fwrite(cached->relocations, sizeof(v2_relocation_t), cached->num_relocations, f);
+            fwrite(cached->code, 1, cached->host_size, f);
+        }
+    }
+    fclose(f);
+    dirty = false;
+    logalways("Persisted %d JIT blocks to disk", num_blocks);
+    SDL_UnlockMutex(cache_lock);
+}
+
+void v2_persistent_cache_record(dasm_State** Dst, n64_dynarec_block_t* block, u32 physical_address) {
+    // Superblocks depend on how the code behaved in this session, and aren't contiguous, so they're never saved
+    if (!loaded || block->host_size == 0 || temp_code_len == 0 || temp_code_is_trace || v2_num_host_pointers > V2_MAX_HOST_POINTERS) {
+        return;
+    }
+    // On the compile thread, status.fr may have changed since the block was requested. Don't save code that might have
+    // been compiled for the wrong register layout.
+    if (N64CP0.status.fr != block->sysconfig.fr) {
+        return;
+    }
+
+    u32 guest_code[TEMP_CODE_SIZE];
+    for (int i = 0; i < temp_code_len; i++) {
+        guest_code[i] = temp_code[i].raw;
+    }
+    u32 guest_hash = hash_guest_code(guest_code, temp_code_len);
+
+    SDL_LockMutex(cache_lock);
+    if (num_blocks >= V2_PERSISTENT_CACHE_MAX_BLOCKS) {
+        SDL_UnlockMutex(cache_lock);
+        return;
+    }
+    // Blocks get compiled again after the code cache is flushed, only keep one copy
+    for (v2_cached_block_t* cached = buckets[BUCKET_INDEX(physical_address)]; cached != NULL; cached = cached->next) {
+        if (cached->physical_address == physical_address && cached->virtual_address == block->virtual_address
+            && cached->sysconfig.raw == block->sysconfig.raw && cached->guest_hash == guest_hash
+            && cached->guest_words == temp_code_len && memcmp(cached->guest_code, guest_code, temp_code_len * sizeof(u32)) == 0) {
+            SDL_UnlockMutex(cache_lock);
+            return;
+        }
+    }
+
+    v2_cached_block_t* cached = calloc(1, sizeof(v2_cached_block_t));
+    cached->virtual_address = block->virtual_address;
+    cached->physical_address = physical_address;
+    cached->sysconfig = block->sysconfig;
+    cached->guest_hash = guest_hash;
+    cached->guest_words = temp_code_len;
+    cached->guest_size = block->guest_size;
+    cached->host_size = block->host_size;
+    cached->link_entry_offset = block->link_entry ? block->link_entry - (u8*)block->run : -1;
+    cached->bound_link_entry_offset = block->bound_link_entry ? block->bound_link_entry - (u8*)block->run : -1;
+    cached->entry_bindings = block->entry_bindings;
+
+    cached->guest_code = malloc(temp_code_len * sizeof(u32));
+    memcpy(cached->guest_code, guest_code, temp_code_len * sizeof(u32));
+
+    cached->num_relocations = v2_num_host_pointers;
+    cached->relocations = malloc(v2_num_host_pointers * sizeof(v2_relocation_t));
+    const uintptr_t n64cpu_addr = (uintptr_t)&N64CPU;
+    for (int i = 0; i < v2_num_host_pointers; i++) {
+        v2_relocation_t* relocation = &cached->relocations[i];
+        uintptr_t ptr = v2_host_pointers[i];
+        relocation->code_offset = v2_get_label_offset(Dst, V2_LABEL_HOST_POINTER(i)) - sizeof(u64);
+        // Besides N64CPU, everything the JIT points at is a function or global in the emulator itself
+        if (ptr >= n64cpu_addr && ptr - n64cpu_addr < sizeof(r4300i_t)) {
+            relocation->base = RELOCATION_BASE_N64CPU;
+            relocation->addend = ptr - n64cpu_addr;
+        } else {
+            relocation->base = RELOCATION_BASE_IMAGE;
+            relocation->addend = ptr - IMAGE_BASE;
+        }
+    }
+
+    cached->code = malloc(block->host_size);
+    memcpy(cached->code, block->run, block->host_size);
+
+    insert_cached_block(cached);
+    dirty = true;
+    SDL_UnlockMutex(cache_lock);
+}
+
+v2_cached_block_t* v2_persistent_cache_find(u64 virtual_address, u32 physical_address, n64_block_sysconfig_t sysconfig) {
+    if (!loaded) {
+        return NULL;
+    }
+
+    v2_cached_block_t* result = NULL;
+    SDL_LockMutex(cache_lock);
+    // Several blocks can share an address when games load different overlays there, so check the guest code too
+    for (v2_cached_block_t* cached = buckets[BUCKET_INDEX(physical_address)]; cached != NULL; cached = cached->next) {
+        if (cached->physical_address == physical_address && cached->virtual_address == virtual_address
+            && cached->sysconfig.raw == sysconfig.raw && guest_code_matches(cached)) {
+            result = cached;
+            break;
+        }
+    }
+    SDL_UnlockMutex(cache_lock);
+    return result;
+}
+
+void v2_persistent_cache_relocate(v2_cached_block_t* cached, u8* code) {
+    for (int i = 0; i < cached->num_relocations; i++) {
+        v2_relocation_t* relocation = &cached->relocations[i];
+        uintptr_t base;
+        switch (relocation->base) {
+            case RELOCATION_BASE_IMAGE:
+                base = IMAGE_BASE;
+                break;
+            case RELOCATION_BASE_N64CPU:
+                base = (uintptr_t)&N64CPU;
+                break;
+            default:
+                logfatal("Unknown relocation base %d", relocation->base);
+        }
+        u64 ptr = base + relocation->addend;
+        memcpy(code + relocation->code_offset, &ptr, sizeof(u64));
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef N64_V2_PERSISTENT_CACHE_H
+#define N64_V2_PERSISTENT_CACHE_H
+
+#include <dynarec/dynarec.h>
+#include <mem/n64rom.h>
+
+// Blocks compiled in earlier sessions are saved next to the ROM, and reused the next time the same guest code shows up at
+// the same address, instead of being compiled again.
+#define V2_PERSISTENT_CACHE_SUFFIX ".jitcache"
+#define V2_PERSISTENT_CACHE_MAX_BLOCKS 65536
+
+typedef enum v2_relocation_base {
+    RELOCATION_BASE_IMAGE, // functions and globals in the emulator itself
+    RELOCATION_BASE_N64CPU // the heap allocated N64CPU
+} v2_relocation_base_t;
+
+typedef struct v2_relocation {
+    u32 code_offset; // of the 64 bit immediate to patch
+    v2_relocation_base_t base;
+    s64 addend;
+} v2_relocation_t;
+
+typedef struct v2_cached_block {
+    u64 virtual_address;
+    u32 physical_address;
+    n64_block_sysconfig_t sysconfig;
+    u32 guest_hash;
+    int guest_words;
+    int guest_size;
+    int host_size;
+    int link_entry_offset; // -1 if the block can't be linked to
+    int bound_link_entry_offset; // -1 if the block has no entry bindings
+    u64 entry_bindings;
+    int num_relocations;
+
+    // Stored after the fixed size part in the file
+    u32* guest_code;
+    v2_relocation_t* relocations;
+    u8* code; // not relocated
+
+    struct v2_cached_block* next; // next block in the same bucket
+} v2_cached_block_t;
+
+void v2_set_persistent_cache_enabled(bool enabled);
+bool v2_persistent_cache_enabled();
+
+// Loads the cache for a ROM, saving the previous ROM's cache first if there was one
+void v2_persistent_cache_load(const char* rom_path, n64_rom_t* rom);
+void v2_persistent_cache_save();
+
+// Called right after a block is encoded, while its host pointer labels are still available and it hasn't been linked yet
+void v2_persistent_cache_record(dasm_State** Dst, n64_dynarec_block_t* block, u32 physical_address);
+
+// Returns a cached block compiled from the guest code currently in memory at this address, or NULL
+v2_cached_block_t* v2_persistent_cache_find(u64 virtual_address, u32 physical_address, n64_block_sysconfig_t sysconfig);
+// Patches a copy of a cached block's code for this session
+void v2_persistent_cache_relocate(v2_cached_block_t* cached, u8* code);
+
+#endif //N64_V2_PERSISTENT_CACHE_H
@@ -374,6 +374,7 @@ MIPS_INSTR(mips_ctc1) {
         case 31: {
             value &= 0x183ffff; // mask out bits held 0
             N64CPU.fcr31.raw = value;
+            fcr31_updated();
             check_fpu_exception();
             break;
         }
@@ -1,10 +1,12 @@
 #include "r4300i.h"
+#include "r4300i_decode_cache.h"
 #ifdef N64_DYNAREC_ENABLED
 #include <dynarec/dynarec.h>
 #endif
 #include <log.h>
 #include <system/n64system.h>
 #include <mem/n64bus.h>
+#include <mem/mem_util.h>
 #include <system/scheduler.h>
 #include "disassemble.h"
 #include "mips_instructions.h"
@@ -763,27 +765,15 @@ void on_tlb_exception(u64 address) {
     N64CP0.entry_hi.r = (address >> 62) & 0b11;
 }
 
-void r4300i_step() {
-    N64CPU.prev_branch = N64CPU.branch;
-    N64CPU.branch = false;
-
-    u64 pc = N64CPU.pc;
-
-    if (unlikely(check_address_error(0b11, pc))) {
-        on_tlb_exception(pc);
-        r4300i_handle_exception(pc, EXCEPTION_ADDRESS_ERROR_LOAD, 0);
-        return;
-    }
-
-    u32 physical_pc;
-    bool cached;
-    if (!resolve_virtual_address(pc, BUS_LOAD, &cached, &physical_pc)) {
-        // tlb exception
-        on_tlb_exception(pc);
-        r4300i_handle_exception(pc, get_tlb_exception_code(N64CP0.tlb_error, BUS_LOAD), 0);
-        return;
-    }
+// Fetches and runs the instruction at pc, once it's been translated. Returns the instruction.
+INLINE mips_instruction_t r4300i_execute(u64 pc, u32 physical_pc, bool cached) {
     mips_instruction_t instruction;
+    r4300i_decoded_instruction_t* decoded = get_decoded_instruction(physical_pc);
+#ifdef LOG_ENABLED
+    if (n64_log_verbosity >= LOG_VERBOSITY_DEBUG) {
+        decoded = NULL; // always decode, so every instruction is logged
+    }
+#endif
 
 #ifdef ENABLE_ICACHE
     if (cached) {
@@ -802,7 +792,12 @@ void r4300i_step() {
         instruction.raw = N64CPU.icache[cache_line].data[(physical_pc & 0x1F) >> 2];
     } else {
 #endif
-        instruction.raw = n64_read_physical_word(physical_pc);
+        if (decoded != NULL) {
+            // Writes to RDRAM don't invalidate the decoded copy, so fetch the word anyway and let the check below decide
+            instruction.raw = RDRAM_WORD(physical_pc);
+        } else {
+            instruction.raw = n64_read_physical_word(physical_pc);
+        }
 #ifdef ENABLE_ICACHE
     }
 #endif
@@ -811,10 +806,96 @@ void r4300i_step() {
     N64CPU.pc = N64CPU.next_pc;
     N64CPU.next_pc += 4;
 
-    r4300i_instruction_decode(pc, instruction)(instruction);
+    mipsinstr_handler_t handler;
+    // The decoded copy can be older than memory, or than the icache, so check the word that was actually fetched
+    if (decoded != NULL && decoded->handler != NULL && decoded->instruction.raw == instruction.raw) {
+        handler = decoded->handler;
+    } else {
+        handler = r4300i_instruction_decode(pc, instruction);
+        if (decoded != NULL) {
+            decoded->handler = handler;
+            decoded->instruction = instruction;
+        }
+    }
+    handler(instruction);
+    return instruction;
+}
+
+// Returns false if translating pc raised an exception
+INLINE bool r4300i_translate_pc(u64 pc, u32* physical_pc, bool* cached) {
+    if (unlikely(check_address_error(0b11, pc))) {
+        on_tlb_exception(pc);
+        r4300i_handle_exception(pc, EXCEPTION_ADDRESS_ERROR_LOAD, 0);
+        return false;
+    }
+
+    if (!resolve_virtual_address(pc, BUS_LOAD, cached, physical_pc)) {
+        // tlb exception
+        on_tlb_exception(pc);
+        r4300i_handle_exception(pc, get_tlb_exception_code(N64CP0.tlb_error, BUS_LOAD), 0);
+        return false;
+    }
+    return true;
+}
+
+void r4300i_step() {
+    N64CPU.prev_branch = N64CPU.branch;
+    N64CPU.branch = false;
+
+    u64 pc = N64CPU.pc;
+    u32 physical_pc;
+    bool cached;
+    if (r4300i_translate_pc(pc, &physical_pc, &cached)) {
+        r4300i_execute(pc, physical_pc, cached);
+    }
     N64CPU.exception = false; // only used in dynarec
 }
 
+int r4300i_run(int max_steps) {
+    // The translation of the page the run is in. Only instructions that can change how addresses are translated (all
+    // in COP0) and exceptions can change it, and both end the run.
+    u64 page_vaddr = 1; // never a page address, so the first instruction is always translated
+    u32 page_paddr = 0;
+    bool page_cached = false;
+
+    int steps = 0;
+    do {
+        N64CPU.prev_branch = N64CPU.branch;
+        N64CPU.branch = false;
+
+        u64 pc = N64CPU.pc;
+        u64 pc_page = pc & ~(u64)(DECODE_CACHE_PAGE_SIZE - 1);
+        // A jump can land on a misaligned pc in the same page, so that has to be checked every time. Translating it raises
+        // the address error.
+        if (pc_page != page_vaddr || unlikely(pc & 3)) {
+            u32 physical_pc;
+            if (!r4300i_translate_pc(pc, &physical_pc, &page_cached)) {
+                N64CPU.exception = false;
+                N64CP0.count++;
+                N64CP0.count &= 0x1FFFFFFFF;
+                scheduler_advance(1);
+                return steps + 1;
+            }
+            page_vaddr = pc_page;
+            page_paddr = physical_pc & ~(DECODE_CACHE_PAGE_SIZE - 1);
+        }
+
+        u32 physical_pc = page_paddr | (pc & (DECODE_CACHE_PAGE_SIZE - 1));
+        mips_instruction_t instruction = r4300i_execute(pc, physical_pc, page_cached);
+
+        N64CP0.count++;
+        N64CP0.count &= 0x1FFFFFFFF;
+        scheduler_advance(1);
+        steps++;
+
+        if (unlikely(N64CPU.exception || instruction.op == OPC_CP0)) {
+            N64CPU.exception = false;
+            break;
+        }
+    } while (steps < max_steps && !scheduler_event_due());
+    return steps;
+}
+
 void r4300i_interrupt_update() {
     N64CPU.interrupts = N64CPU.cp0.cause.interrupt_pending & N64CPU.cp0.status.im;
     scheduler_remove_event(SCHEDULER_HANDLE_INTERRUPT);
@@ -886,7 +967,21 @@ void cp0_status_updated() {
                || (N64CPU.cp0.user_mode && N64CPU.cp0.status.ux);
 #ifdef N64_DYNAREC_ENABLED
     n64dynarec.sysconfig.fr = N64CP0.status.fr;
+    n64dynarec.sysconfig.kernel_mode = N64CP0.kernel_mode;
+    n64dynarec.sysconfig.addressing_64bit = N64CP0.is_64bit_addressing;
+    n64dynarec.sysconfig.cp1_usable = N64CP0.status.cu1;
 #endif
-    N64CP0.resolve_virtual_address = get_resolve_virtual_address_handler();
+    resolve_virtual_address_handler handler = get_resolve_virtual_address_handler();
+    if (handler != N64CP0.resolve_virtual_address) {
+        // Translations cached in the JIT TLB depend on the addressing mode
+        flush_jit_tlb();
+    }
+    N64CP0.resolve_virtual_address = handler;
     r4300i_interrupt_update();
+}
+
+void fcr31_updated() {
+#ifdef N64_DYNAREC_ENABLED
+    n64dynarec.sysconfig.fpu_rounding = N64CPU.fcr31.rounding_mode;
+#endif
 }
\ No newline at end of file
@@ -524,6 +524,24 @@ typedef struct tlb_cache_entry {
     bool dirty;
 } tlb_cache_entry_t;
 
+// Direct-mapped virtual page -> physical page table, checked inline by the JIT before falling back to resolve_virtual_address.
+// Filled by successful JIT address translations, invalidated on TLB writes, ASID changes, and addressing mode changes.
+#define JIT_TLB_PAGE_SHIFT 12
+#define JIT_TLB_INDEX_BITS 12
+#define JIT_TLB_SIZE (1 << JIT_TLB_INDEX_BITS)
+#define GET_JIT_TLB_INDEX(vaddr) (((vaddr) >> JIT_TLB_PAGE_SHIFT) & (JIT_TLB_SIZE - 1))
+#define GET_JIT_TLB_PAGE_OFFSET(vaddr) ((vaddr) & ((1 << JIT_TLB_PAGE_SHIFT) - 1))
+// Low bit is always set for a valid tag, so a zeroed entry never matches
+#define GET_JIT_TLB_TAG(vaddr) (((vaddr) & ~(u64)((1 << JIT_TLB_PAGE_SHIFT) - 1)) | 1)
+
+typedef struct jit_tlb_entry {
+    u64 load_tag; // Tag of the page if loads from it can skip the slow path, 0 otherwise
+    u64 store_tag; // Tag of the page if stores to it can skip the slow path, 0 otherwise
+    u64 physical; // Physical address of the start of the page
+    u64 padding; // Keep entries a power of two in size so the JIT can index with a shift
+} jit_tlb_entry_t;
+static_assert(sizeof(jit_tlb_entry_t) == 32, "jit_tlb_entry_t should be 32 bytes");
+
 typedef bool (*resolve_virtual_address_handler)(u64 vaddr, bus_access_t bus_access, bool* cached, u32* paddr);
 
 typedef struct cp0 {
@@ -560,6 +578,9 @@ typedef struct cp0 {
 
     tlb_cache_entry_t tlb_cache[1 << TLB_CACHE_INDEX_BITS][TLB_CACHE_ASSOCIATIVITY];
 
+    jit_tlb_entry_t jit_tlb[JIT_TLB_SIZE];
+    u8 jit_tlb_asid; // ASID the JIT TLB was filled with
+
     bool kernel_mode;
     bool supervisor_mode;
     bool user_mode;
@@ -667,6 +688,10 @@ typedef struct r4300i {
 
     s64 int64_min;
 
+    // JIT block linking: cycles spent in linked blocks since the dispatcher was last entered, and how many may be spent
+    s32 block_link_cycles;
+    s32 block_link_limit;
+
 } r4300i_t;
 
 extern r4300i_t* n64cpu_ptr;
@@ -677,11 +702,16 @@ typedef void(*mipsinstr_handler_t)(mips_instruction_t);
 
 void on_tlb_exception(u64 address);
 void r4300i_step();
+// Runs up to max_steps instructions, advancing COUNT and the scheduler after each one. Stops early once a scheduler event
+// is due, after an exception, or after a COP0 instruction. Returns how many instructions ran.
+int r4300i_run(int max_steps);
 void r4300i_handle_exception(u64 pc, u32 code, int coprocessor_error);
 mipsinstr_handler_t r4300i_instruction_decode(u64 pc, mips_instruction_t instr);
 void r4300i_interrupt_update();
 bool instruction_stable(mips_instruction_t instr);
 void cp0_status_updated();
+void fcr31_updated();
+void cp0_entry_hi_updated();
 
 extern const char* register_names[];
 extern const char* cp0_register_names[];
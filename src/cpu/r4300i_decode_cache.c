@@ -0,0 +1,22 @@
+#include "r4300i_decode_cache.h"
+
+#include <stdlib.h>
+#include <log.h>
+
+r4300i_decoded_instruction_t* r4300i_decode_cache[DECODE_CACHE_NUM_PAGES];
+
+r4300i_decoded_instruction_t* r4300i_create_decode_cache_page(u32 page_index) {
+    r4300i_decoded_instruction_t* page = calloc(DECODE_CACHE_PAGE_SIZE >> 2, sizeof(r4300i_decoded_instruction_t));
+    if (page == NULL) {
+        logfatal("Failed to allocate a decode cache page for 0x%08X", page_index << DECODE_CACHE_PAGE_SHIFT);
+    }
+    r4300i_decode_cache[page_index] = page;
+    return page;
+}
+
+void invalidate_decode_cache() {
+    for (int i = 0; i < DECODE_CACHE_NUM_PAGES; i++) {
+        free(r4300i_decode_cache[i]);
+        r4300i_decode_cache[i] = NULL;
+    }
+}
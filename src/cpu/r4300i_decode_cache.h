@@ -0,0 +1,38 @@
+#ifndef N64_R4300I_DECODE_CACHE_H
+#define N64_R4300I_DECODE_CACHE_H
+
+#include "r4300i.h"
+#include <mem/n64mem.h>
+
+// Instructions the interpreter already decoded, by physical address, so running them again skips the decoders.
+// Only code in RDRAM is cached. Pages are allocated the first time code in them runs. Writes to memory don't touch the
+// cache: every entry is checked against the word that was fetched, so self-modifying code just gets decoded again.
+#define DECODE_CACHE_PAGE_SHIFT 12
+#define DECODE_CACHE_PAGE_SIZE (1 << DECODE_CACHE_PAGE_SHIFT)
+#define DECODE_CACHE_NUM_PAGES (N64_RDRAM_SIZE >> DECODE_CACHE_PAGE_SHIFT)
+
+typedef struct r4300i_decoded_instruction {
+    mipsinstr_handler_t handler; // NULL if not decoded yet
+    mips_instruction_t instruction;
+} r4300i_decoded_instruction_t;
+
+extern r4300i_decoded_instruction_t* r4300i_decode_cache[DECODE_CACHE_NUM_PAGES];
+
+r4300i_decoded_instruction_t* r4300i_create_decode_cache_page(u32 page_index);
+
+// NULL if the address can't be cached
+INLINE r4300i_decoded_instruction_t* get_decoded_instruction(u32 physical_address) {
+    if (physical_address >= N64_RDRAM_SIZE) {
+        return NULL;
+    }
+    u32 page_index = physical_address >> DECODE_CACHE_PAGE_SHIFT;
+    r4300i_decoded_instruction_t* page = r4300i_decode_cache[page_index];
+    if (unlikely(page == NULL)) {
+        page = r4300i_create_decode_cache_page(page_index);
+    }
+    return &page[(physical_address & (DECODE_CACHE_PAGE_SIZE - 1)) >> 2];
+}
+
+void invalidate_decode_cache();
+
+#endif //N64_R4300I_DECODE_CACHE_H
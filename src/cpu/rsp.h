@@ -8,6 +8,7 @@
 #include <system/n64system.h>
 #include <rdp/rdp.h>
 #include <mem/n64bus.h>
+#include <cpu/rsp_thread.h>
 #ifdef N64_DYNAREC_ENABLED
 #include <cpu/dynarec/dynarec.h>
 #endif
@@ -133,6 +134,7 @@ INLINE void quick_invalidate_rsp_icache(u32 address) {
     N64RSP.icache[index].handler = cache_rsp_instruction;
     N64RSP.icache[index].instruction.raw = word_from_byte_array(N64RSP.sp_imem, address);
 #ifdef N64_DYNAREC_V1_ENABLED
+    rsp_dynarec_imem_word_written(N64RSPDYNAREC, index, N64RSP.icache[index].instruction.raw);
     if (N64RSPDYNAREC->code_overlays[N64RSPDYNAREC->selected_code_overlay].code_mask[index]) {
         N64RSPDYNAREC->dirty = true;
     }
@@ -230,12 +232,10 @@ INLINE void rsp_dma_write() {
         }
 
 
-        // Invalidate all pages touched by the DMA
+        // Invalidate all blocks compiled from the bytes written by the DMA
         // This is probably unnecessary, since why would someone be copying code from the RSP to the CPU and then executing it?
 #ifdef N64_DYNAREC_ENABLED
-        for (int j = 0; j < length; j += BLOCKCACHE_PAGE_SIZE) {
-            invalidate_dynarec_page(dram_address + j);
-        }
+        invalidate_dynarec_range(dram_address, length);
 #endif
 
         int skip = i == N64RSP.io.dma.count ? 0 : N64RSP.io.dma.skip;
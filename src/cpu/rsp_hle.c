@@ -0,0 +1,70 @@
+#include "rsp_hle.h"
+
+#include <log.h>
+#include <metrics.h>
+
+#include "rsp.h"
+#include "rsp_hle_audio.h"
+
+// Where libultra leaves the OSTask in DMEM before starting the RSP
+#define OSTASK_ADDRESS    0xFC0
+#define OSTASK_TYPE       (OSTASK_ADDRESS + 0x00)
+#define OSTASK_UCODE_DATA (OSTASK_ADDRESS + 0x18)
+#define OSTASK_DATA_PTR   (OSTASK_ADDRESS + 0x30)
+#define OSTASK_DATA_SIZE  (OSTASK_ADDRESS + 0x34)
+
+#define M_AUDTASK 2
+
+static bool hle_audio = false;
+
+void rsp_set_hle_audio(bool enabled) {
+    hle_audio = enabled;
+}
+
+bool rsp_hle_audio_enabled() {
+    return hle_audio;
+}
+
+INLINE u32 task_word(u32 address) {
+    return be32toh(word_from_byte_array(N64RSP.sp_dmem, address));
+}
+
+// Same as the BREAK the microcode ends with, after signaling the task is done
+static void finish_task() {
+    N64RSP.status.signal_2 = true;
+    N64RSP.status.halt = true;
+    N64RSP.steps = 0;
+    N64RSP.status.broke = true;
+
+    if (N64RSP.status.intr_on_break) {
+        interrupt_raise(INTERRUPT_SP);
+    }
+}
+
+bool rsp_hle_try_task() {
+    if (!hle_audio || task_word(OSTASK_TYPE) != M_AUDTASK) {
+        return false;
+    }
+
+    u32 ucode_data = task_word(OSTASK_UCODE_DATA);
+    rsp_hle_audio_ucode_t ucode = rsp_hle_identify_audio_ucode(ucode_data);
+    if (ucode == AUDIO_UCODE_UNKNOWN) {
+        static u32 last_unknown_ucode_data = 0xFFFFFFFF;
+        if (ucode_data != last_unknown_ucode_data) {
+            logwarn("Unknown audio microcode (data at 0x%08X), running it on the RSP", ucode_data);
+            last_unknown_ucode_data = ucode_data;
+        }
+        return false;
+    }
+
+    u32 list_address = task_word(OSTASK_DATA_PTR);
+    u32 list_size = task_word(OSTASK_DATA_SIZE);
+    if (!rsp_hle_audio_list_supported(ucode, list_address, list_size)) {
+        return false;
+    }
+
+    rsp_hle_run_audio_list(ucode, list_address, list_size);
+    mark_metric(METRIC_RSP_HLE_TASK);
+    finish_task();
+    return true;
+}
@@ -0,0 +1,16 @@
+#ifndef N64_RSP_HLE_H
+#define N64_RSP_HLE_H
+
+#include <stdbool.h>
+
+// Optionally runs audio tasks natively, instead of running their microcode on the RSP. Only known microcodes are run this
+// way, anything else still runs on the RSP. It's much cheaper, but isn't bit exact, so it's off by default.
+
+void rsp_set_hle_audio(bool enabled);
+bool rsp_hle_audio_enabled();
+
+// Called when the CPU starts the RSP. Returns true if the task was run here, in which case the RSP has already halted and
+// signaled that it's done, as if the microcode had run.
+bool rsp_hle_try_task();
+
+#endif //N64_RSP_HLE_H
@@ -0,0 +1,1238 @@
+#include "rsp_hle_audio.h"
+
+#include <string.h>
+#include <log.h>
+#include <mem/mem_util.h>
+#include <system/n64system.h>
+
+#ifdef N64_HAVE_SSE
+#include <immintrin.h>
+#endif
+
+#include "rsp.h"
+
+#define AUDIO_MAX_COMMANDS 0x20
+#define NUM_SEGMENTS 16
+// Up to 16 predictors, of 2 rows of 8 coefficients each
+#define ADPCM_TABLE_SIZE (16 * 16)
+
+// Where ABI1's buffer addresses are relative to
+#define ABI1_DMEM_BASE 0x5C0
+
+// Command flags, as in libultra's abi.h
+#define A_INIT 0x01
+#define A_LOOP 0x02
+#define A_LEFT 0x02
+#define A_VOL  0x04
+#define A_AUX  0x08
+
+// NAudio always works on the same buffers, of the same size
+#define NAUDIO_COUNT     0x170 // 184 samples
+#define NAUDIO_MAIN      0x4F0
+#define NAUDIO_MAIN2     0x660
+#define NAUDIO_DRY_LEFT  0x9D0
+#define NAUDIO_DRY_RIGHT 0xB40
+#define NAUDIO_WET_LEFT  0xCB0
+#define NAUDIO_WET_RIGHT 0xE20
+
+// Where the envelope mixers keep their state between tasks, in the 80 bytes of RDRAM the game gives them. Only we ever
+// read it back, so it doesn't need to match what the microcode would have written.
+#define ENVMIX_STATE_WET      0
+#define ENVMIX_STATE_DRY      4
+#define ENVMIX_STATE_TARGET   8  // left, right
+#define ENVMIX_STATE_STEP     16 // left, right. The rate, for the exponential ramps
+#define ENVMIX_STATE_SEQUENCE 24 // left, right. Exponential ramps only
+#define ENVMIX_STATE_VALUE    32 // left, right
+
+// 4 tap interpolation filter, for each of 64 positions between two input samples
+static const s16 resample_lut[64 * 4] = {
+    (s16)0x0C39, (s16)0x66AD, (s16)0x0D46, (s16)0xFFDF,
+    (s16)0x0B39, (s16)0x6696, (s16)0x0E5F, (s16)0xFFD8,
+    (s16)0x0A44, (s16)0x6669, (s16)0x0F83, (s16)0xFFD0,
+    (s16)0x095A, (s16)0x6626, (s16)0x10B4, (s16)0xFFC8,
+    (s16)0x087D, (s16)0x65CD, (s16)0x11F0, (s16)0xFFBF,
+    (s16)0x07AB, (s16)0x655E, (s16)0x1338, (s16)0xFFB6,
+    (s16)0x06E4, (s16)0x64D9, (s16)0x148C, (s16)0xFFAC,
+    (s16)0x0628, (s16)0x643F, (s16)0x15EB, (s16)0xFFA1,
+    (s16)0x0577, (s16)0x638F, (s16)0x1756, (s16)0xFF96,
+    (s16)0x04D1, (s16)0x62CB, (s16)0x18CB, (s16)0xFF8A,
+    (s16)0x0435, (s16)0x61F3, (s16)0x1A4C, (s16)0xFF7E,
+    (s16)0x03A4, (s16)0x6106, (s16)0x1BD7, (s16)0xFF71,
+    (s16)0x031C, (s16)0x6007, (s16)0x1D6C, (s16)0xFF64,
+    (s16)0x029F, (s16)0x5EF5, (s16)0x1F0B, (s16)0xFF56,
+    (s16)0x022A, (s16)0x5DD0, (s16)0x20B3, (s16)0xFF48,
+    (s16)0x01BE, (s16)0x5C9A, (s16)0x2264, (s16)0xFF3A,
+    (s16)0x015B, (s16)0x5B53, (s16)0x241E, (s16)0xFF2C,
+    (s16)0x0101, (s16)0x59FC, (s16)0x25E0, (s16)0xFF1E,
+    (s16)0x00AE, (s16)0x5896, (s16)0x27A9, (s16)0xFF10,
+    (s16)0x0063, (s16)0x5720, (s16)0x297A, (s16)0xFF02,
+    (s16)0x001F, (s16)0x559D, (s16)0x2B50, (s16)0xFEF4,
+    (s16)0xFFE2, (s16)0x540D, (s16)0x2D2C, (s16)0xFEE8,
+    (s16)0xFFAC, (s16)0x5270, (s16)0x2F0D, (s16)0xFEDB,
+    (s16)0xFF7C, (s16)0x50C7, (s16)0x30F3, (s16)0xFED0,
+    (s16)0xFF53, (s16)0x4F14, (s16)0x32DC, (s16)0xFEC6,
+    (s16)0xFF2E, (s16)0x4D57, (s16)0x34C8, (s16)0xFEBD,
+    (s16)0xFF0F, (s16)0x4B91, (s16)0x36B6, (s16)0xFEB6,
+    (s16)0xFEF5, (s16)0x49C2, (s16)0x38A5, (s16)0xFEB0,
+    (s16)0xFEDF, (s16)0x47ED, (s16)0x3A95, (s16)0xFEAC,
+    (s16)0xFECE, (s16)0x4611, (s16)0x3C85, (s16)0xFEAB,
+    (s16)0xFEC0, (s16)0x4430, (s16)0x3E74, (s16)0xFEAC,
+    (s16)0xFEB6, (s16)0x424A, (s16)0x4060, (s16)0xFEAF,
+    (s16)0xFEAF, (s16)0x4060, (s16)0x424A, (s16)0xFEB6,
+    (s16)0xFEAC, (s16)0x3E74, (s16)0x4430, (s16)0xFEC0,
+    (s16)0xFEAB, (s16)0x3C85, (s16)0x4611, (s16)0xFECE,
+    (s16)0xFEAC, (s16)0x3A95, (s16)0x47ED, (s16)0xFEDF,
+    (s16)0xFEB0, (s16)0x38A5, (s16)0x49C2, (s16)0xFEF5,
+    (s16)0xFEB6, (s16)0x36B6, (s16)0x4B91, (s16)0xFF0F,
+    (s16)0xFEBD, (s16)0x34C8, (s16)0x4D57, (s16)0xFF2E,
+    (s16)0xFEC6, (s16)0x32DC, (s16)0x4F14, (s16)0xFF53,
+    (s16)0xFED0, (s16)0x30F3, (s16)0x50C7, (s16)0xFF7C,
+    (s16)0xFEDB, (s16)0x2F0D, (s16)0x5270, (s16)0xFFAC,
+    (s16)0xFEE8, (s16)0x2D2C, (s16)0x540D, (s16)0xFFE2,
+    (s16)0xFEF4, (s16)0x2B50, (s16)0x559D, (s16)0x001F,
+    (s16)0xFF02, (s16)0x297A, (s16)0x5720, (s16)0x0063,
+    (s16)0xFF10, (s16)0x27A9, (s16)0x5896, (s16)0x00AE,
+    (s16)0xFF1E, (s16)0x25E0, (s16)0x59FC, (s16)0x0101,
+    (s16)0xFF2C, (s16)0x241E, (s16)0x5B53, (s16)0x015B,
+    (s16)0xFF3A, (s16)0x2264, (s16)0x5C9A, (s16)0x01BE,
+    (s16)0xFF48, (s16)0x20B3, (s16)0x5DD0, (s16)0x022A,
+    (s16)0xFF56, (s16)0x1F0B, (s16)0x5EF5, (s16)0x029F,
+    (s16)0xFF64, (s16)0x1D6C, (s16)0x6007, (s16)0x031C,
+    (s16)0xFF71, (s16)0x1BD7, (s16)0x6106, (s16)0x03A4,
+    (s16)0xFF7E, (s16)0x1A4C, (s16)0x61F3, (s16)0x0435,
+    (s16)0xFF8A, (s16)0x18CB, (s16)0x62CB, (s16)0x04D1,
+    (s16)0xFF96, (s16)0x1756, (s16)0x638F, (s16)0x0577,
+    (s16)0xFFA1, (s16)0x15EB, (s16)0x643F, (s16)0x0628,
+    (s16)0xFFAC, (s16)0x148C, (s16)0x64D9, (s16)0x06E4,
+    (s16)0xFFB6, (s16)0x1338, (s16)0x655E, (s16)0x07AB,
+    (s16)0xFFBF, (s16)0x11F0, (s16)0x65CD, (s16)0x087D,
+    (s16)0xFFC8, (s16)0x10B4, (s16)0x6626, (s16)0x095A,
+    (s16)0xFFD0, (s16)0x0F83, (s16)0x6669, (s16)0x0A44,
+    (s16)0xFFD8, (s16)0x0E5F, (s16)0x6696, (s16)0x0B39,
+    (s16)0xFFDF, (s16)0x0D46, (s16)0x66AD, (s16)0x0C39,
+};
+
+typedef void (*audio_command_t)(u32 w1, u32 w2);
+
+typedef struct envelope_ramp {
+    s32 value;
+    s32 step;
+    s32 target;
+} envelope_ramp_t;
+
+static struct {
+    u32 segments[NUM_SEGMENTS];
+    u16 in;
+    u16 out;
+    u16 count;
+    u16 dry_right;
+    u16 wet_left;
+    u16 wet_right;
+    s16 vol[2];
+    s16 target[2];
+    s32 rate[2];
+    s16 dry;
+    s16 wet;
+    u32 loop;
+    s16 table[ADPCM_TABLE_SIZE]; // ADPCM codebook, or pole filter coefficients
+} abi1;
+
+static struct {
+    s16 vol[2];
+    s16 target[2];
+    s32 rate[2];
+    s16 dry;
+    s16 wet;
+    u32 loop;
+    s16 table[ADPCM_TABLE_SIZE];
+} naudio;
+
+static struct {
+    u16 in;
+    u16 out;
+    u16 count;
+    u32 loop;
+    u16 env_values[3];
+    u16 env_steps[3];
+    s16 table[ADPCM_TABLE_SIZE];
+} abi2;
+
+// DMEM is stored in the RSP's byte order, RDRAM stores big endian words as host words. Words copied between the two
+// have to be swapped, the same as the DMA engine does.
+INLINE u8 dmem_u8(u16 address) {
+    return N64RSP.sp_dmem[address & 0xFFF];
+}
+
+INLINE void set_dmem_u8(u16 address, u8 value) {
+    N64RSP.sp_dmem[address & 0xFFF] = value;
+}
+
+INLINE s16 dmem_s16(u16 address) {
+    return be16toh(half_from_byte_array(N64RSP.sp_dmem, address & 0xFFE));
+}
+
+INLINE void set_dmem_s16(u16 address, s16 value) {
+    half_to_byte_array(N64RSP.sp_dmem, address & 0xFFE, htobe16(value));
+}
+
+INLINE s16 sample(u16 index) {
+    return dmem_s16(index << 1);
+}
+
+INLINE void set_sample(u16 index, s16 value) {
+    set_dmem_s16(index << 1, value);
+}
+
+INLINE s16 rdram_s16(u32 address) {
+    return half_from_byte_array(n64sys.mem.rdram, HALF_ADDRESS(address & (N64_RDRAM_SIZE - 2)));
+}
+
+INLINE void set_rdram_s16(u32 address, s16 value) {
+    half_to_byte_array(n64sys.mem.rdram, HALF_ADDRESS(address & (N64_RDRAM_SIZE - 2)), value);
+}
+
+INLINE u32 rdram_u32(u32 address) {
+    return word_from_byte_array(n64sys.mem.rdram, WORD_ADDRESS(address & (N64_RDRAM_SIZE - 4)));
+}
+
+INLINE void set_rdram_u32(u32 address, u32 value) {
+    word_to_byte_array(n64sys.mem.rdram, WORD_ADDRESS(address & (N64_RDRAM_SIZE - 4)), value);
+}
+
+INLINE s16 clamp_s16(s64 value) {
+    if (value < -32768) return -32768;
+    if (value > 32767) return 32767;
+    return value;
+}
+
+#ifdef N64_HAVE_SSE
+// SSE can work on a buffer right where it is in DMEM if it doesn't wrap around the end, and starts on a sample
+INLINE bool vector_ok(u16 address, int bytes) {
+    return (address & 1) == 0 && address + bytes <= SP_DMEM_SIZE;
+}
+
+// Swaps the bytes of each sample, between DMEM's order and the host's
+INLINE s128 swap_samples(s128 samples) {
+    return _mm_shuffle_epi8(samples, _mm_set_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1));
+}
+
+INLINE s128 load_samples(u16 address) {
+    return swap_samples(_mm_loadu_si128((s128*)&N64RSP.sp_dmem[address]));
+}
+
+INLINE void store_samples(u16 address, s128 samples) {
+    _mm_storeu_si128((s128*)&N64RSP.sp_dmem[address], swap_samples(samples));
+}
+
+// Sign extends the low and high 4 samples to 32 bits
+INLINE s128 widen_low(s128 samples) {
+    return _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+}
+
+INLINE s128 widen_high(s128 samples) {
+    return _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+}
+
+// (samples * gains) >> shift, for the low and high 4 samples, in 32 bits
+INLINE void widening_product(s128 samples, s128 gains, int shift, s128* low, s128* high) {
+    s128 product_low = _mm_mullo_epi16(samples, gains);
+    s128 product_high = _mm_mulhi_epi16(samples, gains);
+    *low = _mm_srai_epi32(_mm_unpacklo_epi16(product_low, product_high), shift);
+    *high = _mm_srai_epi32(_mm_unpackhi_epi16(product_low, product_high), shift);
+}
+
+// (samples * gains) >> 16, with the gains unsigned
+INLINE s128 mulhi_signed_unsigned(s128 samples, s128 gains) {
+    // _mm_mulhi_epi16 takes gains with the top bit set as 0x10000 less than they are
+    return _mm_add_epi16(_mm_mulhi_epi16(samples, gains), _mm_and_si128(samples, _mm_srai_epi16(gains, 15)));
+}
+#endif
+
+INLINE u32 segmented_address(u32 w2, const u32* segments) {
+    u8 segment = (w2 >> 24) & 0x3F;
+    u32 offset = w2 & 0xFFFFFF;
+    if (segment >= NUM_SEGMENTS) {
+        logwarn("Audio list used invalid segment %d", segment);
+        return offset;
+    }
+    return segments[segment] + offset;
+}
+
+INLINE void set_segment(u32 w2, u32* segments) {
+    u8 segment = (w2 >> 24) & 0x3F;
+    if (segment >= NUM_SEGMENTS) {
+        logwarn("Audio list set invalid segment %d", segment);
+        return;
+    }
+    segments[segment] = w2 & 0xFFFFFF;
+}
+
+// Loads halves from RDRAM into a codebook/filter table
+static void load_table(s16* table, u32 address, int count) {
+    if (count > ADPCM_TABLE_SIZE) {
+        count = ADPCM_TABLE_SIZE;
+    }
+    for (int i = 0; i < count; i++) {
+        table[i] = rdram_s16(address + i * 2);
+    }
+}
+
+static void audio_clear(u16 dmem, u16 count) {
+    for (int i = 0; i < count; i++) {
+        set_dmem_u8(dmem + i, 0);
+    }
+}
+
+static void audio_load(u16 dmem, u32 address, u16 count) {
+    // Same alignment as the DMA engine
+    dmem &= ~3;
+    address &= ~7;
+    count = (count + 7) & ~7;
+    for (int i = 0; i < count; i += 4) {
+        word_to_byte_array(N64RSP.sp_dmem, (dmem + i) & 0xFFC, htobe32(rdram_u32(address + i)));
+    }
+}
+
+static void audio_save(u16 dmem, u32 address, u16 count) {
+    dmem &= ~3;
+    address &= ~7;
+    count = (count + 7) & ~7;
+    for (int i = 0; i < count; i += 4) {
+        set_rdram_u32(address + i, be32toh(word_from_byte_array(N64RSP.sp_dmem, (dmem + i) & 0xFFC)));
+    }
+}
+
+static void audio_move(u16 dmemo, u16 dmemi, u16 count) {
+    for (int i = 0; i < count; i++) {
+        set_dmem_u8(dmemo + i, dmem_u8(dmemi + i));
+    }
+}
+
+static void audio_copy_every_other_sample(u16 dmemo, u16 dmemi, u16 count) {
+    for (int i = 0; i < count; i++) {
+        set_dmem_s16(dmemo + i * 2, dmem_s16(dmemi + i * 4));
+    }
+}
+
+static void audio_repeat64(u16 dmemo, u16 dmemi, u8 count) {
+    s16 buffer[64];
+    for (int i = 0; i < 64; i++) {
+        buffer[i] = dmem_s16(dmemi + i * 2);
+    }
+    for (int repeat = 0; repeat < count; repeat++) {
+        for (int i = 0; i < 64; i++) {
+            set_dmem_s16(dmemo + i * 2, buffer[i]);
+        }
+        dmemo += 128;
+    }
+}
+
+static void audio_copy_blocks(u16 dmemo, u16 dmemi, u16 block_size, u8 count) {
+    // Always copies at least one block, of at least 0x20 bytes
+    int blocks_left = count;
+    do {
+        int bytes_left = block_size;
+        do {
+            audio_move(dmemo, dmemi, 0x20);
+            bytes_left -= 0x20;
+            dmemi += 0x20;
+            dmemo += 0x20;
+        } while (bytes_left > 0);
+        blocks_left--;
+    } while (blocks_left > 0);
+}
+
+static void audio_interleave(u16 dmemo, u16 left, u16 right, u16 count) {
+    // Two samples from each side at a time
+    int samples = (count >> 2) * 2;
+    for (int i = 0; i < samples; i++) {
+        set_dmem_s16(dmemo + i * 4, dmem_s16(left + i * 2));
+        set_dmem_s16(dmemo + i * 4 + 2, dmem_s16(right + i * 2));
+    }
+}
+
+static void audio_mix(u16 dmemo, u16 dmemi, u16 count, s16 gain) {
+    int samples = count >> 1;
+    int i = 0;
+#ifdef N64_HAVE_SSE
+    if (vector_ok(dmemo, samples * 2) && vector_ok(dmemi, samples * 2)) {
+        s128 gains = _mm_set1_epi16(gain);
+        for (; i + 8 <= samples; i += 8) {
+            s128 out = load_samples(dmemo + i * 2);
+            s128 product_low, product_high;
+            widening_product(load_samples(dmemi + i * 2), gains, 15, &product_low, &product_high);
+            s128 sum_low = _mm_add_epi32(widen_low(out), product_low);
+            s128 sum_high = _mm_add_epi32(widen_high(out), product_high);
+            store_samples(dmemo + i * 2, _mm_packs_epi32(sum_low, sum_high));
+        }
+    }
+#endif
+    for (; i < samples; i++) {
+        u16 address = dmemo + i * 2;
+        set_dmem_s16(address, clamp_s16(dmem_s16(address) + ((dmem_s16(dmemi + i * 2) * gain) >> 15)));
+    }
+}
+
+static void audio_add(u16 dmemo, u16 dmemi, u16 count) {
+    int samples = count >> 1;
+    int i = 0;
+#ifdef N64_HAVE_SSE
+    if (vector_ok(dmemo, samples * 2) && vector_ok(dmemi, samples * 2)) {
+        for (; i + 8 <= samples; i += 8) {
+            u16 address = dmemo + i * 2;
+            store_samples(address, _mm_adds_epi16(load_samples(address), load_samples(dmemi + i * 2)));
+        }
+    }
+#endif
+    for (; i < samples; i++) {
+        u16 address = dmemo + i * 2;
+        set_dmem_s16(address, clamp_s16(dmem_s16(address) + dmem_s16(dmemi + i * 2)));
+    }
+}
+
+// gain is Q4.4
+static void audio_multiply_q44(u16 dmem, u16 count, s8 gain) {
+    int samples = count >> 1;
+    int i = 0;
+#ifdef N64_HAVE_SSE
+    if (vector_ok(dmem, samples * 2)) {
+        s128 gains = _mm_set1_epi16(gain);
+        for (; i + 8 <= samples; i += 8) {
+            u16 address = dmem + i * 2;
+            s128 product_low, product_high;
+            widening_product(load_samples(address), gains, 4, &product_low, &product_high);
+            store_samples(address, _mm_packs_epi32(product_low, product_high));
+        }
+    }
+#endif
+    for (; i < samples; i++) {
+        u16 address = dmem + i * 2;
+        set_dmem_s16(address, clamp_s16((dmem_s16(address) * gain) >> 4));
+    }
+}
+
+// Decodes a frame's samples, before prediction. Returns how many bytes of input it used.
+static int adpcm_unpack_frame(s16* frame, u16 dmemi, u8 scale, bool two_bit_per_sample) {
+    if (two_bit_per_sample) {
+        int shift = scale < 14 ? 14 - scale : 0;
+        for (int i = 0; i < 4; i++) {
+            u8 byte = dmem_u8(dmemi + i);
+            *(frame++) = (s16)((byte & 0xC0) << 8) >> shift;
+            *(frame++) = (s16)((byte & 0x30) << 10) >> shift;
+            *(frame++) = (s16)((byte & 0x0C) << 12) >> shift;
+            *(frame++) = (s16)((byte & 0x03) << 14) >> shift;
+        }
+        return 4;
+    } else {
+        int shift = scale < 12 ? 12 - scale : 0;
+        for (int i = 0; i < 8; i++) {
+            u8 byte = dmem_u8(dmemi + i);
+            *(frame++) = (s16)((byte & 0xF0) << 8) >> shift;
+            *(frame++) = (s16)((byte & 0x0F) << 12) >> shift;
+        }
+        return 8;
+    }
+}
+
+// Predicts 8 samples from the two before them, and adds the residuals in src
+static void adpcm_predict(s16* dst, const s16* src, const s16* book, s16 older, s16 newer) {
+    const s16* book1 = book;
+    const s16* book2 = book + 8;
+    for (int i = 0; i < 8; i++) {
+        s64 accu = (s64)src[i] * 2048 + (s64)book1[i] * older + (s64)book2[i] * newer;
+        for (int j = 0; j < i; j++) {
+            accu += book2[j] * src[i - 1 - j];
+        }
+        dst[i] = clamp_s16(accu >> 11);
+    }
+}
+
+static void audio_adpcm(bool init, bool loop, bool two_bit_per_sample, u16 dmemo, u16 dmemi, u16 count,
+                        const s16* codebook, u32 loop_address, u32 last_frame_address) {
+    s16 last_frame[16];
+    if (init) {
+        memset(last_frame, 0, sizeof(last_frame));
+    } else {
+        u32 address = loop ? loop_address : last_frame_address;
+        for (int i = 0; i < 16; i++) {
+            last_frame[i] = rdram_s16(address + i * 2);
+        }
+    }
+
+    // The output starts with the frame before
+    for (int i = 0; i < 16; i++, dmemo += 2) {
+        set_dmem_s16(dmemo, last_frame[i]);
+    }
+
+    for (; count != 0; count -= 32) {
+        u8 header = dmem_u8(dmemi++);
+        const s16* book = codebook + ((header & 0xF) << 4);
+        s16 frame[16];
+        dmemi += adpcm_unpack_frame(frame, dmemi, header >> 4, two_bit_per_sample);
+
+        adpcm_predict(last_frame, frame, book, last_frame[14], last_frame[15]);
+        adpcm_predict(last_frame + 8, frame + 8, book, last_frame[6], last_frame[7]);
+
+        for (int i = 0; i < 16; i++, dmemo += 2) {
+            set_dmem_s16(dmemo, last_frame[i]);
+        }
+    }
+
+    for (int i = 0; i < 16; i++) {
+        set_rdram_s16(last_frame_address + i * 2, last_frame[i]);
+    }
+}
+
+// pitch is Q16.16. The 4 samples before the input are filled in from the state at address, and are where it's saved.
+static void audio_resample(bool init, u16 dmemo, u16 dmemi, u16 count, u32 pitch, u32 address) {
+    u16 ipos = (dmemi >> 1) - 4;
+    u16 opos = dmemo >> 1;
+    u32 pitch_accu;
+
+    if (init) {
+        for (int i = 0; i < 4; i++) {
+            set_sample(ipos + i, 0);
+        }
+        pitch_accu = 0;
+    } else {
+        for (int i = 0; i < 4; i++) {
+            set_sample(ipos + i, rdram_s16(address + i * 2));
+        }
+        pitch_accu = (u16)rdram_s16(address + 8);
+    }
+
+    for (int i = 0; i < count >> 1; i++) {
+        const s16* lut = resample_lut + ((pitch_accu & 0xFC00) >> 8);
+        s32 accu = sample(ipos) * lut[0]
+                   + sample(ipos + 1) * lut[1]
+                   + sample(ipos + 2) * lut[2]
+                   + sample(ipos + 3) * lut[3];
+        set_sample(opos++, clamp_s16(accu >> 15));
+        pitch_accu += pitch;
+        ipos += pitch_accu >> 16;
+        pitch_accu &= 0xFFFF;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        set_rdram_s16(address + i * 2, sample(ipos + i));
+    }
+    set_rdram_s16(address + 8, pitch_accu);
+}
+
+// Zero order hold, no filtering
+static void audio_resample_zoh(u16 dmemo, u16 dmemi, u16 count, u32 pitch, u32 pitch_accu) {
+    u16 ipos = dmemi >> 1;
+    u16 opos = dmemo >> 1;
+    for (int i = 0; i < count >> 1; i++) {
+        set_sample(opos++, sample(ipos));
+        pitch_accu += pitch;
+        ipos += pitch_accu >> 16;
+        pitch_accu &= 0xFFFF;
+    }
+}
+
+static void audio_polef(bool init, u16 dmemo, u16 dmemi, u16 count, u16 gain, s16* table, u32 address) {
+    const s16* h1 = table;
+    s16* h2 = table + 8;
+    s16 h2_before[8];
+    s16 l1 = 0;
+    s16 l2 = 0;
+
+    count = (count + 15) & ~15;
+    if (!init) {
+        l1 = rdram_s16(address + 4);
+        l2 = rdram_s16(address + 6);
+    }
+
+    // The microcode scales the second row of coefficients in place, so the next filter with the same table sees them
+    for (int i = 0; i < 8; i++) {
+        h2_before[i] = h2[i];
+        h2[i] = ((s32)h2[i] * gain) >> 14;
+    }
+
+    for (; count != 0; count -= 16) {
+        s16 frame[8];
+        for (int i = 0; i < 8; i++, dmemi += 2) {
+            frame[i] = dmem_s16(dmemi);
+        }
+        for (int i = 0; i < 8; i++) {
+            s64 accu = (s64)frame[i] * gain + (s64)h1[i] * l1 + (s64)h2_before[i] * l2;
+            for (int j = 0; j < i; j++) {
+                accu += h2[j] * frame[i - 1 - j];
+            }
+            set_dmem_s16(dmemo + i * 2, clamp_s16(accu >> 14));
+        }
+        l1 = dmem_s16(dmemo + 12);
+        l2 = dmem_s16(dmemo + 14);
+        dmemo += 16;
+    }
+
+    // The last 4 samples are the state for next time
+    for (int i = 0; i < 4; i++) {
+        set_rdram_s16(address + i * 2, dmem_s16(dmemo - 8 + i * 2));
+    }
+}
+
+INLINE s16 ramp_step(envelope_ramp_t* ramp) {
+    ramp->value = (s32)((u32)ramp->value + (u32)ramp->step);
+    bool target_reached = ramp->step <= 0 ? ramp->value <= ramp->target : ramp->value >= ramp->target;
+    if (target_reached) {
+        ramp->value = ramp->target;
+        ramp->step = 0;
+    }
+    return ramp->value >> 16;
+}
+
+INLINE s16 envmix_gain(s16 volume, s16 level) {
+    return clamp_s16((volume * level + 0x4000) >> 15);
+}
+
+INLINE void envmix_mix(u16 address, s16 value, s16 gain) {
+    set_dmem_s16(address, clamp_s16(dmem_s16(address) + ((value * gain) >> 15)));
+}
+
+// Mixes a sample into the dry buffers, and the wet ones if aux is set
+INLINE void envmix_sample(bool aux, u16 dmem_dl, u16 dmem_dr, u16 dmem_wl, u16 dmem_wr, u16 offset, s16 value,
+                          s16 left_volume, s16 right_volume, s16 dry, s16 wet) {
+    envmix_mix(dmem_dl + offset, value, envmix_gain(left_volume, dry));
+    envmix_mix(dmem_dr + offset, value, envmix_gain(right_volume, dry));
+    if (aux) {
+        envmix_mix(dmem_wl + offset, value, envmix_gain(left_volume, wet));
+        envmix_mix(dmem_wr + offset, value, envmix_gain(right_volume, wet));
+    }
+}
+
+// ABI1's envelope mixer, with the volume ramping exponentially towards its target every 8 samples
+static void audio_envmix_exp(bool init, bool aux, u16 dmem_dl, u16 dmem_dr, u16 dmem_wl, u16 dmem_wr, u16 dmemi,
+                             u16 count, s16 dry, s16 wet, const s16* vol, const s16* target, const s32* rate,
+                             u32 address) {
+    envelope_ramp_t ramps[2];
+    s32 sequence[2];
+    s32 rates[2];
+
+    for (int i = 0; i < 2; i++) {
+        if (init) {
+            ramps[i].value = vol[i] * 0x10000;
+            ramps[i].target = target[i] * 0x10000;
+            rates[i] = rate[i];
+            sequence[i] = (s32)((s64)vol[i] * rate[i]);
+        } else {
+            ramps[i].value = rdram_u32(address + ENVMIX_STATE_VALUE + i * 4);
+            ramps[i].target = rdram_u32(address + ENVMIX_STATE_TARGET + i * 4);
+            rates[i] = rdram_u32(address + ENVMIX_STATE_STEP + i * 4);
+            sequence[i] = rdram_u32(address + ENVMIX_STATE_SEQUENCE + i * 4);
+        }
+        // Only 0 once the target is reached
+        ramps[i].step = (s32)((s64)ramps[i].target - ramps[i].value);
+    }
+    if (!init) {
+        wet = rdram_s16(address + ENVMIX_STATE_WET);
+        dry = rdram_s16(address + ENVMIX_STATE_DRY);
+    }
+
+    u16 offset = 0;
+    for (int block = 0; block < count; block += 16) {
+        for (int i = 0; i < 2; i++) {
+            if (ramps[i].step != 0) {
+                sequence[i] = ((s64)sequence[i] * rates[i]) >> 16;
+                ramps[i].step = (s32)(((s64)sequence[i] - ramps[i].value) >> 3);
+            }
+        }
+        for (int i = 0; i < 8; i++, offset += 2) {
+            s16 left_volume = ramp_step(&ramps[0]);
+            s16 right_volume = ramp_step(&ramps[1]);
+            envmix_sample(aux, dmem_dl, dmem_dr, dmem_wl, dmem_wr, offset, dmem_s16(dmemi + offset),
+                          left_volume, right_volume, dry, wet);
+        }
+    }
+
+    set_rdram_s16(address + ENVMIX_STATE_WET, wet);
+    set_rdram_s16(address + ENVMIX_STATE_DRY, dry);
+    for (int i = 0; i < 2; i++) {
+        set_rdram_u32(address + ENVMIX_STATE_TARGET + i * 4, ramps[i].target);
+        set_rdram_u32(address + ENVMIX_STATE_STEP + i * 4, rates[i]);
+        set_rdram_u32(address + ENVMIX_STATE_SEQUENCE + i * 4, sequence[i]);
+        set_rdram_u32(address + ENVMIX_STATE_VALUE + i * 4, ramps[i].value);
+    }
+}
+
+// NAudio's envelope mixer, with the volume ramping linearly every sample
+static void audio_envmix_lin(bool init, u16 dmem_dl, u16 dmem_dr, u16 dmem_wl, u16 dmem_wr, u16 dmemi, u16 count,
+                             s16 dry, s16 wet, const s16* vol, const s16* target, const s32* rate, u32 address) {
+    envelope_ramp_t ramps[2];
+    for (int i = 0; i < 2; i++) {
+        if (init) {
+            ramps[i].step = rate[i] / 8;
+            ramps[i].value = vol[i] * 0x10000;
+            ramps[i].target = target[i] * 0x10000;
+        } else {
+            ramps[i].step = rdram_u32(address + ENVMIX_STATE_STEP + i * 4);
+            ramps[i].value = rdram_u32(address + ENVMIX_STATE_VALUE + i * 4);
+            ramps[i].target = rdram_u32(address + ENVMIX_STATE_TARGET + i * 4);
+        }
+    }
+    if (!init) {
+        wet = rdram_s16(address + ENVMIX_STATE_WET);
+        dry = rdram_s16(address + ENVMIX_STATE_DRY);
+    }
+
+    for (int i = 0; i < count >> 1; i++) {
+        s16 left_volume = ramp_step(&ramps[0]);
+        s16 right_volume = ramp_step(&ramps[1]);
+        envmix_sample(true, dmem_dl, dmem_dr, dmem_wl, dmem_wr, i * 2, dmem_s16(dmemi + i * 2),
+                      left_volume, right_volume, dry, wet);
+    }
+
+    set_rdram_s16(address + ENVMIX_STATE_WET, wet);
+    set_rdram_s16(address + ENVMIX_STATE_DRY, dry);
+    for (int i = 0; i < 2; i++) {
+        set_rdram_u32(address + ENVMIX_STATE_TARGET + i * 4, ramps[i].target);
+        set_rdram_u32(address + ENVMIX_STATE_STEP + i * 4, ramps[i].step);
+        set_rdram_u32(address + ENVMIX_STATE_VALUE + i * 4, ramps[i].value);
+    }
+}
+
+INLINE s16 nead_scale(s16 value, u16 env_value, s16 xor) {
+    return (s16)((value * env_value) >> 16) ^ xor;
+}
+
+// ABI2's envelope mixer. The envelopes only step every 8 samples, so each group of 8 is mixed with the same volumes.
+static void audio_envmix_nead(bool swap_wet_lr, u16 dmem_dl, u16 dmem_dr, u16 dmem_wl, u16 dmem_wr, u16 dmemi,
+                              int count, u16* env_values, const u16* env_steps, const s16* xors) {
+    if (swap_wet_lr) {
+        u16 temp = dmem_wl;
+        dmem_wl = dmem_wr;
+        dmem_wr = temp;
+    }
+
+    count = (count + 7) & ~7;
+    for (int i = 0; i < count; i += 8) {
+        u16 offset = i * 2;
+#ifdef N64_HAVE_SSE
+        if (vector_ok(dmemi + offset, 16) && vector_ok(dmem_dl + offset, 16) && vector_ok(dmem_dr + offset, 16)
+            && vector_ok(dmem_wl + offset, 16) && vector_ok(dmem_wr + offset, 16)) {
+            s128 in = load_samples(dmemi + offset);
+            s128 left = _mm_xor_si128(mulhi_signed_unsigned(in, _mm_set1_epi16(env_values[0])), _mm_set1_epi16(xors[0]));
+            s128 right = _mm_xor_si128(mulhi_signed_unsigned(in, _mm_set1_epi16(env_values[1])), _mm_set1_epi16(xors[1]));
+            s128 wet_volume = _mm_set1_epi16(env_values[2]);
+            s128 wet_left = _mm_xor_si128(mulhi_signed_unsigned(left, wet_volume), _mm_set1_epi16(xors[2]));
+            s128 wet_right = _mm_xor_si128(mulhi_signed_unsigned(right, wet_volume), _mm_set1_epi16(xors[3]));
+
+            // One buffer at a time, in case any of them are the same
+            store_samples(dmem_dl + offset, _mm_adds_epi16(load_samples(dmem_dl + offset), left));
+            store_samples(dmem_dr + offset, _mm_adds_epi16(load_samples(dmem_dr + offset), right));
+            store_samples(dmem_wl + offset, _mm_adds_epi16(load_samples(dmem_wl + offset), wet_left));
+            store_samples(dmem_wr + offset, _mm_adds_epi16(load_samples(dmem_wr + offset), wet_right));
+        } else
+#endif
+        {
+            for (int j = 0; j < 8; j++) {
+                u16 address = offset + j * 2;
+                s16 in = dmem_s16(dmemi + address);
+                s16 left = nead_scale(in, env_values[0], xors[0]);
+                s16 right = nead_scale(in, env_values[1], xors[1]);
+                s16 wet_left = nead_scale(left, env_values[2], xors[2]);
+                s16 wet_right = nead_scale(right, env_values[2], xors[3]);
+                set_dmem_s16(dmem_dl + address, clamp_s16(dmem_s16(dmem_dl + address) + left));
+                set_dmem_s16(dmem_dr + address, clamp_s16(dmem_s16(dmem_dr + address) + right));
+                set_dmem_s16(dmem_wl + address, clamp_s16(dmem_s16(dmem_wl + address) + wet_left));
+                set_dmem_s16(dmem_wr + address, clamp_s16(dmem_s16(dmem_wr + address) + wet_right));
+            }
+        }
+        env_values[0] += env_steps[0];
+        env_values[1] += env_steps[1];
+        env_values[2] += env_steps[2];
+    }
+}
+
+static void audio_noop(u32 w1, u32 w2) {}
+
+static void abi1_adpcm(u32 w1, u32 w2) {
+    u8 flags = w1 >> 16;
+    u32 address = segmented_address(w2, abi1.segments);
+    audio_adpcm(flags & A_INIT, flags & A_LOOP, false, abi1.out, abi1.in, (abi1.count + 31) & ~31, abi1.table,
+                abi1.loop, address);
+}
+
+static void abi1_clearbuff(u32 w1, u32 w2) {
+    u16 count = w2 & 0xFFF;
+    if (count != 0) {
+        audio_clear((w1 & 0xFFFF) + ABI1_DMEM_BASE, (count + 15) & ~15);
+    }
+}
+
+static void abi1_envmixer(u32 w1, u32 w2) {
+    u8 flags = w1 >> 16;
+    u32 address = segmented_address(w2, abi1.segments);
+    audio_envmix_exp(flags & A_INIT, flags & A_AUX, abi1.out, abi1.dry_right, abi1.wet_left, abi1.wet_right, abi1.in,
+                     abi1.count, abi1.dry, abi1.wet, abi1.vol, abi1.target, abi1.rate, address);
+}
+
+static void abi1_loadbuff(u32 w1, u32 w2) {
+    if (abi1.count != 0) {
+        audio_load(abi1.in, segmented_address(w2, abi1.segments), abi1.count);
+    }
+}
+
+static void abi1_resample(u32 w1, u32 w2) {
+    u8 flags = w1 >> 16;
+    u16 pitch = w1;
+    u32 address = segmented_address(w2, abi1.segments);
+    audio_resample(flags & A_INIT, abi1.out, abi1.in, (abi1.count + 15) & ~15, pitch << 1, address);
+}
+
+static void abi1_savebuff(u32 w1, u32 w2) {
+    if (abi1.count != 0) {
+        audio_save(abi1.out, segmented_address(w2, abi1.segments), abi1.count);
+    }
+}
+
+static void abi1_segment(u32 w1, u32 w2) {
+    set_segment(w2, abi1.segments);
+}
+
+static void abi1_setbuff(u32 w1, u32 w2) {
+    u8 flags = w1 >> 16;
+    if (flags & A_AUX) {
+        abi1.dry_right = (w1 & 0xFFFF) + ABI1_DMEM_BASE;
+        abi1.wet_left = (w2 >> 16) + ABI1_DMEM_BASE;
+        abi1.wet_right = (w2 & 0xFFFF) + ABI1_DMEM_BASE;
+    } else {
+        abi1.in = (w1 & 0xFFFF) + ABI1_DMEM_BASE;
+        abi1.out = (w2 >> 16) + ABI1_DMEM_BASE;
+        abi1.count = w2;
+    }
+}
+
+static void abi1_setvol(u32 w1, u32 w2) {
+    u8 flags = w1 >> 16;
+    if (flags & A_AUX) {
+        abi1.dry = w1;
+        abi1.wet = w2;
+    } else {
+        int side = (flags & A_LEFT) ? 0 : 1;
+        if (flags & A_VOL) {
+            abi1.vol[side] = w1;
+        } else {
+            abi1.target[side] = w1;
+            abi1.rate[side] = w2;
+        }
+    }
+}
+
+static void abi1_dmemmove(u32 w1, u32 w2) {
+    u16 count = w2;
+    if (count != 0) {
+        audio_move((w2 >> 16) + ABI1_DMEM_BASE, (w1 & 0xFFFF) + ABI1_DMEM_BASE, (count + 15) & ~15);
+    }
+}
+
+static void abi1_loadadpcm(u32 w1, u32 w2) {
+    u16 count = w1;
+    load_table(abi1.table, segmented_address(w2, abi1.segments), ((count + 7) & ~7) >> 1);
+}
+
+static void abi1_mixer(u32 w1, u32 w2) {
+    if (abi1.count != 0) {
+        audio_mix((w2 & 0xFFFF) + ABI1_DMEM_BASE, (w2 >> 16) + ABI1_DMEM_BASE, (abi1.count + 31) & ~31, w1);
+    }
+}
+
+static void abi1_interleave(u32 w1, u32 w2) {
+    if (abi1.count != 0) {
+        audio_interleave(abi1.out, (w2 >> 16) + ABI1_DMEM_BASE, (w2 & 0xFFFF) + ABI1_DMEM_BASE,
+                         (abi1.count + 15) & ~15);
+    }
+}
+
+static void abi1_polef(u32 w1, u32 w2) {
+    u8 flags = w1 >> 16;
+    if (abi1.count != 0) {
+        audio_polef(flags & A_INIT, abi1.out, abi1.in, abi1.count, w1, abi1.table, segmented_address(w2, abi1.segments));
+    }
+}
+
+static void abi1_setloop(u32 w1, u32 w2) {
+    abi1.loop = segmented_address(w2, abi1.segments);
+}
+
+static void naudio_adpcm(u32 w1, u32 w2) {
+    u8 flags = w2 >> 28;
+    u16 count = (w2 >> 16) & 0xFFF;
+    u16 dmemi = ((w2 >> 12) & 0xF) + NAUDIO_MAIN;
+    u16 dmemo = (w2 & 0xFFF) + NAUDIO_MAIN;
+    audio_adpcm(flags & A_INIT, flags & A_LOOP, false, dmemo, dmemi, (count + 31) & ~31, naudio.table, naudio.loop,
+                w1 & 0xFFFFFF);
+}
+
+static void naudio_clearbuff(u32 w1, u32 w2) {
+    audio_clear((w1 & 0xFFFF) + NAUDIO_MAIN, w2 & 0xFFF);
+}
+
+static void naudio_envmixer(u32 w1, u32 w2) {
+    u8 flags = w1 >> 16;
+    naudio.vol[1] = w1;
+    audio_envmix_lin(flags & A_INIT, NAUDIO_DRY_LEFT, NAUDIO_DRY_RIGHT, NAUDIO_WET_LEFT, NAUDIO_WET_RIGHT, NAUDIO_MAIN,
+                     NAUDIO_COUNT, naudio.dry, naudio.wet, naudio.vol, naudio.target, naudio.rate, w2 & 0xFFFFFF);
+}
+
+static void naudio_loadbuff(u32 w1, u32 w2) {
+    audio_load(w1 & 0xFFF, w2 & 0xFFFFFF, (w1 >> 12) & 0xFFF);
+}
+
+static void naudio_resample(u32 w1, u32 w2) {
+    u8 flags = w2 >> 30;
+    u16 pitch = w2 >> 14;
+    u16 dmemi = ((w2 >> 2) & 0xFFF) + NAUDIO_MAIN;
+    u16 dmemo = (w2 & 3) ? NAUDIO_MAIN2 : NAUDIO_MAIN;
+    audio_resample(flags & A_INIT, dmemo, dmemi, NAUDIO_COUNT, pitch << 1, w1 & 0xFFFFFF);
+}
+
+static void naudio_savebuff(u32 w1, u32 w2) {
+    audio_save(w1 & 0xFFF, w2 & 0xFFFFFF, (w1 >> 12) & 0xFFF);
+}
+
+static void naudio_setvol(u32 w1, u32 w2) {
+    u8 flags = w1 >> 16;
+    if (flags & A_VOL) {
+        if (flags & A_LEFT) {
+            naudio.vol[0] = w1;
+            naudio.dry = w2 >> 16;
+            naudio.wet = w2;
+        } else {
+            naudio.target[1] = w1;
+            naudio.rate[1] = w2;
+        }
+    } else {
+        naudio.target[0] = w1;
+        naudio.rate[0] = w2;
+    }
+}
+
+static void naudio_dmemmove(u32 w1, u32 w2) {
+    u16 count = w2;
+    audio_move((w2 >> 16) + NAUDIO_MAIN, (w1 & 0xFFFF) + NAUDIO_MAIN, (count + 3) & ~3);
+}
+
+static void naudio_loadadpcm(u32 w1, u32 w2) {
+    u16 count = w1;
+    load_table(naudio.table, w2 & 0xFFFFFF, count >> 1);
+}
+
+static void naudio_mixer(u32 w1, u32 w2) {
+    audio_mix((w2 & 0xFFFF) + NAUDIO_MAIN, (w2 >> 16) + NAUDIO_MAIN, NAUDIO_COUNT, w1);
+}
+
+static void naudio_interleave(u32 w1, u32 w2) {
+    audio_interleave(NAUDIO_MAIN, NAUDIO_DRY_LEFT, NAUDIO_DRY_RIGHT, NAUDIO_COUNT);
+}
+
+static void naudio_setloop(u32 w1, u32 w2) {
+    naudio.loop = w2 & 0xFFFFFF;
+}
+
+static void abi2_adpcm(u32 w1, u32 w2) {
+    u8 flags = w1 >> 16;
+    audio_adpcm(flags & A_INIT, flags & A_LOOP, flags & 0x4, abi2.out, abi2.in, (abi2.count + 31) & ~31, abi2.table,
+                abi2.loop, w2 & 0xFFFFFF);
+}
+
+static void abi2_clearbuff(u32 w1, u32 w2) {
+    u16 count = w2 & 0xFFF;
+    if (count != 0) {
+        audio_clear(w1, count);
+    }
+}
+
+static void abi2_addmixer(u32 w1, u32 w2) {
+    audio_add(w2, w2 >> 16, (w1 >> 12) & 0xFF0);
+}
+
+static void abi2_resample(u32 w1, u32 w2) {
+    u8 flags = w1 >> 16;
+    u16 pitch = w1;
+    audio_resample(flags & A_INIT, abi2.out, abi2.in, (abi2.count + 15) & ~15, pitch << 1, w2 & 0xFFFFFF);
+}
+
+static void abi2_resample_zoh(u32 w1, u32 w2) {
+    u16 pitch = w1;
+    u16 pitch_accu = w2;
+    audio_resample_zoh(abi2.out, abi2.in, abi2.count, pitch << 1, pitch_accu);
+}
+
+static void abi2_setbuff(u32 w1, u32 w2) {
+    abi2.in = w1;
+    abi2.out = w2 >> 16;
+    abi2.count = w2;
+}
+
+static void abi2_duplicate(u32 w1, u32 w2) {
+    audio_repeat64(w2 >> 16, w1, w1 >> 16);
+}
+
+static void abi2_dmemmove(u32 w1, u32 w2) {
+    u16 count = w2;
+    if (count != 0) {
+        audio_move(w2 >> 16, w1, (count + 3) & ~3);
+    }
+}
+
+static void abi2_loadadpcm(u32 w1, u32 w2) {
+    u16 count = w1;
+    load_table(abi2.table, w2 & 0xFFFFFF, count >> 1);
+}
+
+static void abi2_mixer(u32 w1, u32 w2) {
+    audio_mix(w2, w2 >> 16, (w1 >> 12) & 0xFF0, w1);
+}
+
+static void abi2_interleave(u32 w1, u32 w2) {
+    audio_interleave(w1, w2 >> 16, w2, (w1 >> 12) & 0xFF0);
+}
+
+static void abi2_interleave_mk(u32 w1, u32 w2) {
+    if (abi2.count != 0) {
+        audio_interleave(abi2.out, w2 >> 16, w2, abi2.count);
+    }
+}
+
+static void abi2_hilogain(u32 w1, u32 w2) {
+    audio_multiply_q44(w2 >> 16, w1 & 0xFFF, w1 >> 16);
+}
+
+static void abi2_setloop(u32 w1, u32 w2) {
+    abi2.loop = w2 & 0xFFFFFF;
+}
+
+static void abi2_copy_blocks(u32 w1, u32 w2) {
+    audio_copy_blocks(w2 >> 16, w1, w2, w1 >> 16);
+}
+
+static void abi2_interl(u32 w1, u32 w2) {
+    audio_copy_every_other_sample(w2, w2 >> 16, w1);
+}
+
+static void abi2_envsetup1(u32 w1, u32 w2) {
+    abi2.env_values[2] = (w1 >> 8) & 0xFF00;
+    abi2.env_steps[2] = w1;
+    abi2.env_steps[0] = w2 >> 16;
+    abi2.env_steps[1] = w2;
+}
+
+static void abi2_envsetup1_mk(u32 w1, u32 w2) {
+    abi2.env_values[2] = (w1 >> 8) & 0xFF00;
+    abi2.env_steps[2] = 0;
+    abi2.env_steps[0] = w2 >> 16;
+    abi2.env_steps[1] = w2;
+}
+
+static void abi2_envsetup2(u32 w1, u32 w2) {
+    abi2.env_values[0] = w2 >> 16;
+    abi2.env_values[1] = w2;
+}
+
+static void abi2_envmixer(u32 w1, u32 w2) {
+    s16 xors[4];
+    xors[0] = 0 - (s16)((w1 & 0x2) >> 1);
+    xors[1] = 0 - (s16)(w1 & 0x1);
+    xors[2] = 0 - (s16)((w1 & 0x8) >> 3);
+    xors[3] = 0 - (s16)((w1 & 0x4) >> 2);
+    audio_envmix_nead((w1 >> 4) & 1, (w2 >> 20) & 0xFF0, (w2 >> 12) & 0xFF0, (w2 >> 4) & 0xFF0, (w2 << 4) & 0xFF0,
+                      (w1 >> 12) & 0xFF0, (w1 >> 8) & 0xFF, abi2.env_values, abi2.env_steps, xors);
+}
+
+static void abi2_envmixer_mk(u32 w1, u32 w2) {
+    // No wet negation or swapping in this one
+    s16 xors[4];
+    xors[0] = 0 - (s16)((w1 & 0x2) >> 1);
+    xors[1] = 0 - (s16)(w1 & 0x1);
+    xors[2] = 0;
+    xors[3] = 0;
+    audio_envmix_nead(false, (w2 >> 20) & 0xFF0, (w2 >> 12) & 0xFF0, (w2 >> 4) & 0xFF0, (w2 << 4) & 0xFF0,
+                      (w1 >> 12) & 0xFF0, (w1 >> 8) & 0xFF, abi2.env_values, abi2.env_steps, xors);
+}
+
+static void abi2_loadbuff(u32 w1, u32 w2) {
+    audio_load(w1 & 0xFFF, w2 & 0xFFFFFF, (w1 >> 12) & 0xFFF);
+}
+
+static void abi2_savebuff(u32 w1, u32 w2) {
+    audio_save(w1 & 0xFFF, w2 & 0xFFFFFF, (w1 >> 12) & 0xFFF);
+}
+
+static void abi2_polef(u32 w1, u32 w2) {
+    u8 flags = w1 >> 16;
+    if (abi2.count != 0) {
+        audio_polef(flags & A_INIT, abi2.out, abi2.in, abi2.count, w1, abi2.table, w2 & 0xFFFFFF);
+    }
+}
+
+// Commands left out are ones we can't run, and make the task run on the RSP instead
+static const audio_command_t abi1_commands[AUDIO_MAX_COMMANDS] = {
+    [0x00] = audio_noop,
+    [0x01] = abi1_adpcm,
+    [0x02] = abi1_clearbuff,
+    [0x03] = abi1_envmixer,
+    [0x04] = abi1_loadbuff,
+    [0x05] = abi1_resample,
+    [0x06] = abi1_savebuff,
+    [0x07] = abi1_segment,
+    [0x08] = abi1_setbuff,
+    [0x09] = abi1_setvol,
+    [0x0A] = abi1_dmemmove,
+    [0x0B] = abi1_loadadpcm,
+    [0x0C] = abi1_mixer,
+    [0x0D] = abi1_interleave,
+    [0x0E] = abi1_polef,
+    [0x0F] = abi1_setloop
+};
+
+static const audio_command_t naudio_commands[AUDIO_MAX_COMMANDS] = {
+    [0x00] = audio_noop,
+    [0x01] = naudio_adpcm,
+    [0x02] = naudio_clearbuff,
+    [0x03] = naudio_envmixer,
+    [0x04] = naudio_loadbuff,
+    [0x05] = naudio_resample,
+    [0x06] = naudio_savebuff,
+    [0x09] = naudio_setvol,
+    [0x0A] = naudio_dmemmove,
+    [0x0B] = naudio_loadadpcm,
+    [0x0C] = naudio_mixer,
+    [0x0D] = naudio_interleave,
+    [0x0E] = audio_noop, // sent all the time, but nothing audible is known to depend on it
+    [0x0F] = naudio_setloop
+};
+
+static const audio_command_t abi2_mk_commands[AUDIO_MAX_COMMANDS] = {
+    [0x00] = audio_noop,
+    [0x01] = abi2_adpcm,
+    [0x02] = abi2_clearbuff,
+    [0x05] = abi2_resample,
+    [0x07] = audio_noop, // segments aren't used
+    [0x08] = abi2_setbuff,
+    [0x0A] = abi2_dmemmove,
+    [0x0B] = abi2_loadadpcm,
+    [0x0C] = abi2_mixer,
+    [0x0D] = abi2_interleave_mk,
+    [0x0E] = abi2_polef,
+    [0x0F] = abi2_setloop,
+    [0x10] = abi2_copy_blocks,
+    [0x11] = abi2_interl,
+    [0x12] = abi2_envsetup1_mk,
+    [0x13] = abi2_envmixer_mk,
+    [0x14] = abi2_loadbuff,
+    [0x15] = abi2_savebuff,
+    [0x16] = abi2_envsetup2
+};
+
+static const audio_command_t abi2_zelda_commands[AUDIO_MAX_COMMANDS] = {
+    [0x00] = audio_noop,
+    [0x01] = abi2_adpcm,
+    [0x02] = abi2_clearbuff,
+    [0x04] = abi2_addmixer,
+    [0x05] = abi2_resample,
+    [0x06] = abi2_resample_zoh,
+    [0x08] = abi2_setbuff,
+    [0x09] = abi2_duplicate,
+    [0x0A] = abi2_dmemmove,
+    [0x0B] = abi2_loadadpcm,
+    [0x0C] = abi2_mixer,
+    [0x0D] = abi2_interleave,
+    [0x0E] = abi2_hilogain,
+    [0x0F] = abi2_setloop,
+    [0x10] = abi2_copy_blocks,
+    [0x11] = abi2_interl,
+    [0x12] = abi2_envsetup1,
+    [0x13] = abi2_envmixer,
+    [0x14] = abi2_loadbuff,
+    [0x15] = abi2_savebuff,
+    [0x16] = abi2_envsetup2
+};
+
+static const audio_command_t* get_commands(rsp_hle_audio_ucode_t ucode) {
+    switch (ucode) {
+        case AUDIO_UCODE_ABI1:
+            return abi1_commands;
+        case AUDIO_UCODE_NAUDIO:
+            return naudio_commands;
+        case AUDIO_UCODE_ABI2_MK:
+            return abi2_mk_commands;
+        case AUDIO_UCODE_ABI2_ZELDA:
+            return abi2_zelda_commands;
+        case AUDIO_UCODE_UNKNOWN:
+            break;
+    }
+    logfatal("No audio commands for unknown microcode");
+}
+
+rsp_hle_audio_ucode_t rsp_hle_identify_audio_ucode(u32 ucode_data_address) {
+    // A few words of each microcode's data are enough to tell them apart
+    if (rdram_u32(ucode_data_address) == 0x00000001) {
+        if (rdram_u32(ucode_data_address + 0x30) == 0xF0000F00) {
+            switch (rdram_u32(ucode_data_address + 0x28)) {
+                case 0x1E24138C:
+                    return AUDIO_UCODE_ABI1;
+            }
+        } else {
+            switch (rdram_u32(ucode_data_address + 0x10)) {
+                case 0x11181350:
+                    return AUDIO_UCODE_ABI2_MK;
+                case 0x1F681230: // Ocarina of Time, Majora's Mask (J)
+                case 0x1F801250: // Majora's Mask
+                    return AUDIO_UCODE_ABI2_ZELDA;
+            }
+        }
+    } else {
+        switch (rdram_u32(ucode_data_address + 0x10)) {
+            case 0x0000127C:
+                return AUDIO_UCODE_NAUDIO;
+        }
+    }
+    return AUDIO_UCODE_UNKNOWN;
+}
+
+const char* rsp_hle_audio_ucode_name(rsp_hle_audio_ucode_t ucode) {
+    switch (ucode) {
+        case AUDIO_UCODE_UNKNOWN:
+            return "unknown";
+        case AUDIO_UCODE_ABI1:
+            return "ABI1";
+        case AUDIO_UCODE_NAUDIO:
+            return "NAudio";
+        case AUDIO_UCODE_ABI2_MK:
+            return "ABI2 (Mario Kart)";
+        case AUDIO_UCODE_ABI2_ZELDA:
+            return "ABI2 (Zelda)";
+    }
+    return "invalid";
+}
+
+bool rsp_hle_audio_list_supported(rsp_hle_audio_ucode_t ucode, u32 list_address, u32 list_size) {
+    const audio_command_t* commands = get_commands(ucode);
+    for (u32 offset = 0; offset + 8 <= list_size; offset += 8) {
+        u8 command = (rdram_u32(list_address + offset) >> 24) & 0x7F;
+        if (command >= AUDIO_MAX_COMMANDS || commands[command] == NULL) {
+            static u64 warned[AUDIO_UCODE_ABI2_ZELDA + 1][128 / 64];
+            if (!(warned[ucode][command / 64] & (1ull << (command % 64)))) {
+                logwarn("%s audio lists with command 0x%02X will run on the RSP, since it isn't supported",
+                        rsp_hle_audio_ucode_name(ucode), command);
+                warned[ucode][command / 64] |= 1ull << (command % 64);
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+void rsp_hle_run_audio_list(rsp_hle_audio_ucode_t ucode, u32 list_address, u32 list_size) {
+    const audio_command_t* commands = get_commands(ucode);
+    if (ucode == AUDIO_UCODE_ABI1) {
+        memset(abi1.segments, 0, sizeof(abi1.segments));
+    }
+    for (u32 offset = 0; offset + 8 <= list_size; offset += 8) {
+        u32 w1 = rdram_u32(list_address + offset);
+        u32 w2 = rdram_u32(list_address + offset + 4);
+        commands[(w1 >> 24) & 0x7F](w1, w2);
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef N64_RSP_HLE_AUDIO_H
+#define N64_RSP_HLE_AUDIO_H
+
+#include <stdbool.h>
+#include <util.h>
+
+// The audio microcodes we know how to run natively. Each one gets its own command table.
+typedef enum rsp_hle_audio_ucode {
+    AUDIO_UCODE_UNKNOWN,
+    AUDIO_UCODE_ABI1,       // the libultra one most games use
+    AUDIO_UCODE_NAUDIO,     // Nintendo's later one, with fixed buffers
+    AUDIO_UCODE_ABI2_MK,    // Mario Kart 64, Wave Race 64 (E)
+    AUDIO_UCODE_ABI2_ZELDA  // Ocarina of Time, Majora's Mask
+} rsp_hle_audio_ucode_t;
+
+// Looks at the microcode's data segment in RDRAM to tell which microcode it is
+rsp_hle_audio_ucode_t rsp_hle_identify_audio_ucode(u32 ucode_data_address);
+const char* rsp_hle_audio_ucode_name(rsp_hle_audio_ucode_t ucode);
+
+// Whether every command in the list is one we can run. If not, the whole task has to run on the RSP instead, since
+// there's no going back once part of it has run.
+bool rsp_hle_audio_list_supported(rsp_hle_audio_ucode_t ucode, u32 list_address, u32 list_size);
+void rsp_hle_run_audio_list(rsp_hle_audio_ucode_t ucode, u32 list_address, u32 list_size);
+
+#endif //N64_RSP_HLE_AUDIO_H
@@ -141,6 +141,7 @@ RSP_INSTR(rsp_spc_and) {
 }
 
 RSP_INSTR(rsp_spc_break) {
+    RSP_RUN_ON_EMULATION_THREAD(rsp_spc_break, instruction);
     N64RSP.status.halt = true;
     N64RSP.steps = 0;
     N64RSP.status.broke = true;
@@ -259,11 +260,16 @@ RSP_INSTR(rsp_spc_jalr) {
 }
 
 RSP_INSTR(rsp_mfc0) {
+    // The RDP's registers are owned by the emulation thread, the SP's are only changed by it after syncing
+    if (instruction.r.rd >= RSP_CP0_CMD_START) {
+        RSP_RUN_ON_EMULATION_THREAD(rsp_mfc0, instruction);
+    }
     s32 value = get_rsp_cp0_register(instruction.r.rd);
     set_rsp_register(instruction.r.rt, value);
 }
 
 RSP_INSTR(rsp_mtc0) {
+    RSP_RUN_ON_EMULATION_THREAD(rsp_mtc0, instruction);
     u32 value = get_rsp_register(instruction.r.rt);
     set_rsp_cp0_register(instruction.r.rd, value);
 }
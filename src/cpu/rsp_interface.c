@@ -1,5 +1,6 @@
 #include "rsp_interface.h"
 #include "rsp.h"
+#include "rsp_hle.h"
 
 typedef union sp_status_write {
     u32 raw;
@@ -113,9 +114,14 @@ void write_word_spreg(u32 address, u32 value) {
             rsp_dma_write();
             break;
         }
-        case ADDR_SP_STATUS_REG:
+        case ADDR_SP_STATUS_REG: {
+            bool was_halted = N64RSP.status.halt;
             rsp_status_reg_write(value);
+            if (was_halted && !N64RSP.status.halt && rsp_hle_audio_enabled()) {
+                rsp_hle_try_task();
+            }
             break;
+        }
         case ADDR_SP_DMA_FULL_REG:
             logfatal("Write to unsupported SP reg: ADDR_SP_DMA_FULL_REG");
         case ADDR_SP_DMA_BUSY_REG:
@@ -0,0 +1,109 @@
+#include "rsp_thread.h"
+
+#include <SDL_thread.h>
+#include <SDL_mutex.h>
+#include <log.h>
+
+typedef enum rsp_thread_state {
+    RSP_THREAD_IDLE,
+    RSP_THREAD_RUNNING,
+    RSP_THREAD_CALLING // waiting for the emulation thread to run call_handler
+} rsp_thread_state_t;
+
+static bool threaded = false;
+bool rsp_batch_in_flight = false;
+_Thread_local bool on_rsp_thread = false;
+
+static SDL_Thread* rsp_thread = NULL;
+static SDL_sem* batch_posted = NULL; // there's a batch for the RSP thread to run
+static SDL_sem* thread_waiting = NULL; // the RSP thread finished its batch, or needs a call run
+static SDL_sem* call_done = NULL;
+
+static int state = RSP_THREAD_IDLE; // rsp_thread_state_t, accessed atomically
+static void (*batch_run)();
+static void (*call_handler)(mips_instruction_t);
+static mips_instruction_t call_instruction;
+
+INLINE rsp_thread_state_t get_state() {
+    return __atomic_load_n(&state, __ATOMIC_ACQUIRE);
+}
+
+INLINE void set_state(rsp_thread_state_t new_state) {
+    __atomic_store_n(&state, new_state, __ATOMIC_RELEASE);
+}
+
+static int rsp_thread_main(void* data) {
+    on_rsp_thread = true;
+    while (true) {
+        SDL_SemWait(batch_posted);
+        batch_run();
+        set_state(RSP_THREAD_IDLE);
+        SDL_SemPost(thread_waiting);
+    }
+    return 0;
+}
+
+static void start_rsp_thread() {
+    batch_posted = SDL_CreateSemaphore(0);
+    thread_waiting = SDL_CreateSemaphore(0);
+    call_done = SDL_CreateSemaphore(0);
+    rsp_thread = SDL_CreateThread(rsp_thread_main, "RSP", NULL);
+    if (rsp_thread == NULL) {
+        logfatal("Failed to start the RSP thread: %s", SDL_GetError());
+    }
+}
+
+void rsp_set_threaded(bool enabled) {
+    rsp_sync();
+    threaded = enabled;
+}
+
+bool rsp_threaded() {
+    return threaded;
+}
+
+void rsp_run_batch(void (*run)()) {
+    if (!threaded) {
+        run();
+        return;
+    }
+
+    rsp_sync();
+    if (rsp_thread == NULL) {
+        start_rsp_thread();
+    }
+    batch_run = run;
+    set_state(RSP_THREAD_RUNNING);
+    rsp_batch_in_flight = true;
+    SDL_SemPost(batch_posted);
+}
+
+void rsp_wait_for_batch() {
+    while (true) {
+        SDL_SemWait(thread_waiting);
+        rsp_thread_state_t current = get_state();
+        switch (current) {
+            case RSP_THREAD_IDLE:
+                rsp_batch_in_flight = false;
+                return;
+            case RSP_THREAD_CALLING:
+                // The RSP thread is stopped until the call is done, so anything the handler touches is already in sync
+                rsp_batch_in_flight = false;
+                call_handler(call_instruction);
+                rsp_batch_in_flight = true;
+                set_state(RSP_THREAD_RUNNING);
+                SDL_SemPost(call_done);
+                break;
+            case RSP_THREAD_RUNNING:
+                logfatal("RSP thread signaled while still running");
+        }
+    }
+}
+
+void rsp_thread_call(void (*handler)(mips_instruction_t), mips_instruction_t instruction) {
+    call_handler = handler;
+    call_instruction = instruction;
+    set_state(RSP_THREAD_CALLING);
+    SDL_SemPost(thread_waiting);
+    SDL_SemWait(call_done);
+}
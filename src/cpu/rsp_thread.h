@@ -0,0 +1,44 @@
+#ifndef N64_RSP_THREAD_H
+#define N64_RSP_THREAD_H
+
+#include <stdbool.h>
+#include <util.h>
+#include "mips_instruction_decode.h"
+
+// Optionally runs the RSP on its own host thread, at the same time as the CPU.
+//
+// The emulation thread hands the RSP thread the steps it would otherwise have run inline, and keeps going. Before it
+// touches anything the RSP can see (SP and DP registers, DMEM, IMEM) or hands over more steps, it waits for the RSP
+// thread to finish, so the RSP is never more than one batch behind. RSP instructions with effects outside of the RSP
+// (DMA, interrupts, the RDP) are run by the emulation thread on the RSP thread's behalf while it waits. None of this
+// depends on how fast either thread is, so runs are still deterministic.
+
+extern bool rsp_batch_in_flight;
+extern _Thread_local bool on_rsp_thread;
+
+void rsp_set_threaded(bool enabled);
+bool rsp_threaded();
+
+// Runs the steps in N64RSP.steps with run(), on the RSP thread if it's enabled, otherwise right away
+void rsp_run_batch(void (*run)());
+// Waits for the RSP thread to finish its batch, running anything it asks for in the meantime
+void rsp_wait_for_batch();
+
+INLINE void rsp_sync() {
+    if (unlikely(rsp_batch_in_flight)) {
+        rsp_wait_for_batch();
+    }
+}
+
+// Blocks the RSP thread until the emulation thread has run handler(instruction) for it
+void rsp_thread_call(void (*handler)(mips_instruction_t), mips_instruction_t instruction);
+
+// For RSP instructions with effects outside of the RSP
+#define RSP_RUN_ON_EMULATION_THREAD(handler, instruction) do { \
+    if (unlikely(on_rsp_thread)) {                             \
+        rsp_thread_call(handler, instruction);                 \
+        return;                                                \
+    }                                                          \
+} while (0)
+
+#endif //N64_RSP_THREAD_H
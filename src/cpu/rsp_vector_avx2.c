@@ -0,0 +1,216 @@
+#include "rsp_vector_avx2.h"
+
+#include <log.h>
+
+#include "rsp.h"
+
+bool rsp_vector_avx2 = false;
+
+#ifndef N64_HAVE_SSE
+void rsp_vector_detect_avx2() {}
+#else
+#include <immintrin.h>
+
+void rsp_vector_detect_avx2() {
+    __builtin_cpu_init();
+    rsp_vector_avx2 = __builtin_cpu_supports("avx2");
+    if (rsp_vector_avx2) {
+        logdebug("Using AVX2 for the RSP multiply instructions");
+    }
+}
+
+#define AVX2 static inline __attribute__((always_inline, target("avx2")))
+#define AVX2_KERNEL(NAME) __attribute__((target("avx2"))) RSP_VECTOR_AVX2(NAME)
+
+// The 48 bit accumulator, sign extended from bit 47. hm holds bits 16-47, l holds bits 0-15, but is allowed to grow
+// past 16 bits between normalize() calls, to carry into hm.
+typedef struct avx2_accumulator {
+    __m256i hm;
+    __m256i l;
+} avx2_accumulator_t;
+
+AVX2 __m256i sext(vu_reg_t* reg) {
+    return _mm256_cvtepi16_epi32(reg->single);
+}
+
+AVX2 __m256i zext(vu_reg_t* reg) {
+    return _mm256_cvtepu16_epi32(reg->single);
+}
+
+AVX2 __m256i low16(__m256i value) {
+    return _mm256_and_si256(value, _mm256_set1_epi32(0xFFFF));
+}
+
+AVX2 __m128i pack_signed(__m256i value) {
+    return _mm_packs_epi32(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+}
+
+// Every lane has to be in 0-0xFFFF already
+AVX2 __m128i pack_unsigned(__m256i value) {
+    return _mm_packus_epi32(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+}
+
+AVX2 avx2_accumulator_t load_accumulator() {
+    avx2_accumulator_t acc;
+    acc.hm = _mm256_or_si256(_mm256_slli_epi32(sext(&N64RSP.acc.h), 16), zext(&N64RSP.acc.m));
+    acc.l = zext(&N64RSP.acc.l);
+    return acc;
+}
+
+AVX2 avx2_accumulator_t normalize(avx2_accumulator_t acc) {
+    acc.hm = _mm256_add_epi32(acc.hm, _mm256_srli_epi32(acc.l, 16));
+    acc.l = low16(acc.l);
+    return acc;
+}
+
+AVX2 void store_accumulator(avx2_accumulator_t acc) {
+    N64RSP.acc.h.single = pack_signed(_mm256_srai_epi32(acc.hm, 16));
+    N64RSP.acc.m.single = pack_unsigned(low16(acc.hm));
+    N64RSP.acc.l.single = pack_unsigned(acc.l);
+}
+
+// Adds a signed 32 bit product to the accumulator, starting at bit 0
+AVX2 avx2_accumulator_t accumulate(avx2_accumulator_t acc, __m256i product) {
+    acc.l = _mm256_add_epi32(acc.l, low16(product));
+    acc.hm = _mm256_add_epi32(acc.hm, _mm256_srai_epi32(product, 16));
+    return normalize(acc);
+}
+
+// Adds a signed 32 bit product to the accumulator, starting at bit 1. Doubling the product could overflow 32 bits, so
+// it's split up first.
+AVX2 avx2_accumulator_t accumulate_doubled(avx2_accumulator_t acc, __m256i product) {
+    acc.l = _mm256_add_epi32(acc.l, low16(_mm256_slli_epi32(product, 1)));
+    acc.hm = _mm256_add_epi32(acc.hm, _mm256_srai_epi32(product, 15));
+    return normalize(acc);
+}
+
+// Same as clamp_signed(acc >> 16)
+AVX2 __m128i clamp_signed(avx2_accumulator_t acc) {
+    return pack_signed(acc.hm);
+}
+
+// Same as clamp_unsigned(acc >> 16)
+AVX2 __m128i clamp_unsigned(avx2_accumulator_t acc) {
+    __m128i clamped = pack_signed(acc.hm);
+    clamped = _mm_andnot_si128(_mm_srai_epi16(clamped, 15), clamped);
+    __m128i overflow = pack_signed(_mm256_cmpgt_epi32(acc.hm, _mm256_set1_epi32(0x7FFF)));
+    return _mm_or_si128(clamped, overflow);
+}
+
+// The low slice if the high and mid slices are its sign extension, otherwise 0 or 0xFFFF depending on the sign
+AVX2 __m128i clamp_low(avx2_accumulator_t acc) {
+    __m256i sign_extended = _mm256_cmpeq_epi32(_mm256_srai_epi32(_mm256_slli_epi32(acc.hm, 16), 16), acc.hm);
+    __m256i saturated = _mm256_andnot_si256(_mm256_srai_epi32(acc.hm, 31), _mm256_set1_epi32(0xFFFF));
+    return pack_unsigned(_mm256_blendv_epi8(saturated, acc.l, sign_extended));
+}
+
+// The products below match the multiplicand types of the scalar versions, vte first
+AVX2 __m256i multiply_ss(vu_reg_t* vs, vu_reg_t* vte) {
+    return _mm256_mullo_epi32(sext(vte), sext(vs));
+}
+
+AVX2 __m256i multiply_us(vu_reg_t* vs, vu_reg_t* vte) {
+    return _mm256_mullo_epi32(zext(vte), sext(vs));
+}
+
+AVX2 __m256i multiply_su(vu_reg_t* vs, vu_reg_t* vte) {
+    return _mm256_mullo_epi32(sext(vte), zext(vs));
+}
+
+// Logical shift, the product is unsigned
+AVX2 __m256i multiply_uu_high(vu_reg_t* vs, vu_reg_t* vte) {
+    return _mm256_srli_epi32(_mm256_mullo_epi32(zext(vte), zext(vs)), 16);
+}
+
+AVX2 avx2_accumulator_t rounded_doubled(__m256i product) {
+    avx2_accumulator_t acc;
+    acc.hm = _mm256_setzero_si256();
+    acc.l = _mm256_set1_epi32(0x8000);
+    return accumulate_doubled(acc, product);
+}
+
+AVX2_KERNEL(rsp_vec_vmacf) {
+    avx2_accumulator_t acc = accumulate_doubled(load_accumulator(), multiply_ss(vs, vte));
+    store_accumulator(acc);
+    vd->single = clamp_signed(acc);
+}
+
+AVX2_KERNEL(rsp_vec_vmacu) {
+    avx2_accumulator_t acc = accumulate_doubled(load_accumulator(), multiply_ss(vs, vte));
+    store_accumulator(acc);
+    vd->single = clamp_unsigned(acc);
+}
+
+AVX2_KERNEL(rsp_vec_vmadh) {
+    avx2_accumulator_t acc = load_accumulator();
+    acc.hm = _mm256_add_epi32(acc.hm, multiply_ss(vs, vte));
+    store_accumulator(acc);
+    vd->single = clamp_signed(acc);
+}
+
+AVX2_KERNEL(rsp_vec_vmadl) {
+    avx2_accumulator_t acc = load_accumulator();
+    acc.l = _mm256_add_epi32(acc.l, multiply_uu_high(vs, vte));
+    acc = normalize(acc);
+    store_accumulator(acc);
+    vd->single = clamp_low(acc);
+}
+
+AVX2_KERNEL(rsp_vec_vmadm) {
+    avx2_accumulator_t acc = accumulate(load_accumulator(), multiply_us(vs, vte));
+    store_accumulator(acc);
+    vd->single = clamp_signed(acc);
+}
+
+AVX2_KERNEL(rsp_vec_vmadn) {
+    avx2_accumulator_t acc = accumulate(load_accumulator(), multiply_su(vs, vte));
+    store_accumulator(acc);
+    vd->single = clamp_low(acc);
+}
+
+AVX2_KERNEL(rsp_vec_vmudh) {
+    avx2_accumulator_t acc;
+    acc.hm = multiply_ss(vs, vte);
+    acc.l = _mm256_setzero_si256();
+    store_accumulator(acc);
+    vd->single = clamp_signed(acc);
+}
+
+AVX2_KERNEL(rsp_vec_vmudl) {
+    avx2_accumulator_t acc;
+    acc.hm = _mm256_setzero_si256();
+    acc.l = multiply_uu_high(vs, vte);
+    store_accumulator(acc);
+    vd->single = clamp_low(acc);
+}
+
+AVX2_KERNEL(rsp_vec_vmudm) {
+    __m256i product = multiply_us(vs, vte);
+    avx2_accumulator_t acc;
+    acc.hm = _mm256_srai_epi32(product, 16);
+    acc.l = low16(product);
+    store_accumulator(acc);
+    vd->single = clamp_signed(acc);
+}
+
+AVX2_KERNEL(rsp_vec_vmudn) {
+    __m256i product = multiply_su(vs, vte);
+    avx2_accumulator_t acc;
+    acc.hm = _mm256_srai_epi32(product, 16);
+    acc.l = low16(product);
+    store_accumulator(acc);
+    vd->single = clamp_low(acc);
+}
+
+AVX2_KERNEL(rsp_vec_vmulf) {
+    avx2_accumulator_t acc = rounded_doubled(multiply_ss(vs, vte));
+    store_accumulator(acc);
+    vd->single = clamp_signed(acc);
+}
+
+AVX2_KERNEL(rsp_vec_vmulu) {
+    avx2_accumulator_t acc = rounded_doubled(multiply_ss(vs, vte));
+    store_accumulator(acc);
+    vd->single = clamp_unsigned(acc);
+}
+#endif
@@ -0,0 +1,31 @@
+#ifndef N64_RSP_VECTOR_AVX2_H
+#define N64_RSP_VECTOR_AVX2_H
+
+#include <stdbool.h>
+#include "rsp_types.h"
+
+// AVX2 versions of the multiply family. They widen the accumulator to 32 bit lanes, one holding the high and mid slices
+// and one holding the low slice, so all eight elements are updated at once. Only used when the host supports AVX2.
+
+// Set by rsp_vector_detect_avx2(). Can be cleared to go back to the scalar (or SSE) versions.
+extern bool rsp_vector_avx2;
+void rsp_vector_detect_avx2();
+
+#ifdef N64_HAVE_SSE
+#define RSP_VECTOR_AVX2(NAME) void NAME##_avx2(vu_reg_t* vs, vu_reg_t* vte, vu_reg_t* vd)
+
+RSP_VECTOR_AVX2(rsp_vec_vmacf);
+RSP_VECTOR_AVX2(rsp_vec_vmacu);
+RSP_VECTOR_AVX2(rsp_vec_vmadh);
+RSP_VECTOR_AVX2(rsp_vec_vmadl);
+RSP_VECTOR_AVX2(rsp_vec_vmadm);
+RSP_VECTOR_AVX2(rsp_vec_vmadn);
+RSP_VECTOR_AVX2(rsp_vec_vmudh);
+RSP_VECTOR_AVX2(rsp_vec_vmudl);
+RSP_VECTOR_AVX2(rsp_vec_vmudm);
+RSP_VECTOR_AVX2(rsp_vec_vmudn);
+RSP_VECTOR_AVX2(rsp_vec_vmulf);
+RSP_VECTOR_AVX2(rsp_vec_vmulu);
+#endif
+
+#endif //N64_RSP_VECTOR_AVX2_H
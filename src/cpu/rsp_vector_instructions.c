@@ -13,6 +13,7 @@
 
 #include "rsp.h"
 #include "rsp_rom.h"
+#include "rsp_vector_avx2.h"
 #include "n64_rsp_bus.h"
 
 #define defvs vu_reg_t* vs = &N64RSP.vu_regs[instruction.cp2_vec.vs]
@@ -20,6 +21,12 @@
 #define defvd vu_reg_t* vd = &N64RSP.vu_regs[instruction.cp2_vec.vd]
 #define defvte vu_reg_t vte = get_vte(&N64RSP.vu_regs[instruction.cp2_vec.vt], instruction.cp2_vec.e)
 
+#ifdef N64_HAVE_SSE
+#define avx2_dispatch(NAME) do { if (rsp_vector_avx2) { NAME##_avx2(vs, &vte, vd); return; } } while (0)
+#else
+#define avx2_dispatch(NAME) do {} while (0)
+#endif
+
 INLINE s16 clamp_signed(s64 value) {
     if (value < -32768) return -32768;
     if (value > 32767) return 32767;
@@ -909,6 +916,7 @@ RSP_VECTOR_INSTR(rsp_vec_vmacf) {
     defvs;
     defvd;
     defvte;
+    avx2_dispatch(rsp_vec_vmacf);
     for (int e = 0; e < 8; e++) {
         s16 multiplicand1 = vte.elements[e];
         s16 multiplicand2 = vs->elements[e];
@@ -948,6 +956,7 @@ RSP_VECTOR_INSTR(rsp_vec_vmacu) {
     defvs;
     defvd;
     defvte;
+    avx2_dispatch(rsp_vec_vmacu);
     for (int e = 0; e < 8; e++) {
         s16 multiplicand1 = vte.elements[e];
         s16 multiplicand2 = vs->elements[e];
@@ -970,6 +979,7 @@ RSP_VECTOR_INSTR(rsp_vec_vmadh) {
     defvs;
     defvd;
     defvte;
+    avx2_dispatch(rsp_vec_vmadh);
 #ifdef N64_HAVE_SSE
     s128 lo, hi, omask;
     lo                 = _mm_mullo_epi16(vs->single, vte.single);
@@ -1007,6 +1017,7 @@ RSP_VECTOR_INSTR(rsp_vec_vmadl) {
     defvs;
     defvd;
     defvte;
+    avx2_dispatch(rsp_vec_vmadl);
     for (int e = 0; e < 8; e++) {
         u64 multiplicand1 = vte.elements[e];
         u64 multiplicand2 = vs->elements[e];
@@ -1034,6 +1045,7 @@ RSP_VECTOR_INSTR(rsp_vec_vmadm) {
     defvs;
     defvd;
     defvte;
+    avx2_dispatch(rsp_vec_vmadm);
 #ifdef N64_HAVE_SSE
     s128 lo, hi, sign, vta, omask;
     lo                 = _mm_mullo_epi16(vs->single, vte.single);
@@ -1080,6 +1092,7 @@ RSP_VECTOR_INSTR(rsp_vec_vmadn) {
     defvs;
     defvd;
     defvte;
+    avx2_dispatch(rsp_vec_vmadn);
 #ifdef N64_HAVE_SSE
     s128 lo, hi, sign, vsa, omask, nhi, nmd, shi, smd, cmask, cval;
     lo                 = _mm_mullo_epi16(vs->single, vte.single);
@@ -1190,6 +1203,7 @@ RSP_VECTOR_INSTR(rsp_vec_vmudh) {
     defvs;
     defvd;
     defvte;
+    avx2_dispatch(rsp_vec_vmudh);
     for (int e = 0; e < 8; e++) {
         s16 multiplicand1 = vte.elements[e];
         s16 multiplicand2 = vs->elements[e];
@@ -1211,6 +1225,7 @@ RSP_VECTOR_INSTR(rsp_vec_vmudl) {
     defvs;
     defvd;
     defvte;
+    avx2_dispatch(rsp_vec_vmudl);
     for (int e = 0; e < 8; e++) {
         u64 multiplicand1 = vte.elements[e];
         u64 multiplicand2 = vs->elements[e];
@@ -1237,6 +1252,7 @@ RSP_VECTOR_INSTR(rsp_vec_vmudm) {
     defvs;
     defvd;
     defvte;
+    avx2_dispatch(rsp_vec_vmudm);
     for (int e = 0; e < 8; e++) {
         u16 multiplicand1 = vte.elements[e];
         s16 multiplicand2 = vs->elements[e];
@@ -1256,6 +1272,7 @@ RSP_VECTOR_INSTR(rsp_vec_vmudn) {
     defvs;
     defvd;
     defvte;
+    avx2_dispatch(rsp_vec_vmudn);
     for (int e = 0; e < 8; e++) {
         s16 multiplicand1 = vte.elements[e];
         u16 multiplicand2 = vs->elements[e];
@@ -1283,6 +1300,7 @@ RSP_VECTOR_INSTR(rsp_vec_vmulf) {
     defvs;
     defvd;
     defvte;
+    avx2_dispatch(rsp_vec_vmulf);
     for (int e = 0; e < 8; e++) {
         s16 multiplicand1 = vte.elements[e];
         s16 multiplicand2 = vs->elements[e];
@@ -1322,6 +1340,7 @@ RSP_VECTOR_INSTR(rsp_vec_vmulu) {
     defvs;
     defvd;
     defvte;
+    avx2_dispatch(rsp_vec_vmulu);
     for (int e = 0; e < 8; e++) {
         s16 multiplicand1 = vte.elements[e];
         s16 multiplicand2 = vs->elements[e];
@@ -6,6 +6,9 @@
 
 #define RSP_VECTOR_INSTR(NAME) void NAME(mips_instruction_t instruction)
 
+// Defined in rsp_rom.h, the RSP dynarec reads it too
+extern const u16 rcp_rom[];
+
 RSP_VECTOR_INSTR(rsp_lwc2_lbv);
 RSP_VECTOR_INSTR(rsp_lwc2_ldv);
 RSP_VECTOR_INSTR(rsp_lwc2_lfv);
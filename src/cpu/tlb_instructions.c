@@ -42,6 +42,8 @@ void do_tlbr() {
     N64CP0.entry_lo0.g = entry.global;
     N64CP0.entry_lo1.g = entry.global;
     N64CP0.page_mask.raw = entry.page_mask.raw;
+
+    cp0_entry_hi_updated();
 }
 
 MIPS_INSTR(mips_tlbr) {
@@ -51,3 +53,11 @@ MIPS_INSTR(mips_tlbr) {
 MIPS_INSTR(mips_tlbwr) {
     do_tlbwi(get_cp0_random());
 }
+
+// Non-global JIT TLB entries are only valid for the ASID they were resolved with
+void cp0_entry_hi_updated() {
+    if (N64CP0.entry_hi.asid != N64CP0.jit_tlb_asid) {
+        flush_jit_tlb();
+        N64CP0.jit_tlb_asid = N64CP0.entry_hi.asid;
+    }
+}
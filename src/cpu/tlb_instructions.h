@@ -4,11 +4,34 @@
 #include "r4300i.h"
 #include "mips_instruction_decode.h"
 #include <mem/n64bus.h>
+#ifdef N64_DYNAREC_ENABLED
+#include <cpu/dynarec/dynarec.h>
+#endif
 
 #ifndef MIPS_INSTR
 #define MIPS_INSTR(NAME) void NAME(mips_instruction_t instruction)
 #endif
 
+INLINE void flush_jit_tlb() {
+    memset(N64CP0.jit_tlb, 0, sizeof(N64CP0.jit_tlb));
+#ifdef N64_DYNAREC_ENABLED
+    unlink_mapped_dynarec_blocks();
+#endif
+}
+
+INLINE void clear_jit_tlb(u64 start, u64 end) {
+    if (((end - start) >> JIT_TLB_PAGE_SHIFT) >= JIT_TLB_SIZE) {
+        flush_jit_tlb();
+    } else {
+        for (u64 page = start; page <= end; page += (1 << JIT_TLB_PAGE_SHIFT)) {
+            memset(&N64CP0.jit_tlb[GET_JIT_TLB_INDEX(page)], 0, sizeof(jit_tlb_entry_t));
+        }
+#ifdef N64_DYNAREC_ENABLED
+        unlink_mapped_dynarec_blocks();
+#endif
+    }
+}
+
 INLINE void clear_tlb_cache(tlb_entry_t entry) {
     if (entry.initialized) {
         u64 page_mask = entry.page_mask.raw | 0x1FFF;
@@ -21,6 +44,8 @@ INLINE void clear_tlb_cache(tlb_entry_t entry) {
         for (u32 index = start_index; index <= end_index; index++) {
             memset(N64CP0.tlb_cache[index], 0, TLB_CACHE_ASSOCIATIVITY * sizeof(tlb_cache_entry_t));
         }
+
+        clear_jit_tlb(start, end);
     }
 }
 
@@ -12,7 +12,15 @@
 #include <signal.h>
 #include <imgui/imgui_ui.h>
 #include <settings.h>
+#include <cpu/rsp_thread.h>
+#include <cpu/rsp_hle.h>
 #include "frontend.h"
+#ifdef N64_DYNAREC_ENABLED
+#include <dynarec/v2/v2_compile_thread.h>
+#include <dynarec/v2/v2_persistent_cache.h>
+#include <dynarec/v2/v2_compiler.h>
+#include <dynarec/dynarec_profiler.h>
+#endif
 
 void usage(cflags_t* flags) {
     cflags_print_usage(flags,
@@ -49,6 +57,18 @@ int main(int argc, char** argv) {
 #ifdef N64_DYNAREC_ENABLED
     bool interpreter = false;
     cflags_add_bool(flags, 'i', "interpreter", &interpreter, "Force the use of the interpreter");
+
+    bool async_jit = false;
+    cflags_add_bool(flags, '\0', "async-jit", &async_jit, "Compile JIT blocks on a background thread, interpreting them until they're ready");
+
+    bool jit_cache = false;
+    cflags_add_bool(flags, '\0', "jit-cache", &jit_cache, "Save compiled JIT blocks next to the ROM and reuse them on the next boot");
+
+    bool superblocks = false;
+    cflags_add_bool(flags, '\0', "superblocks", &superblocks, "Profile the branches JIT blocks end in, and recompile hot paths into superblocks");
+
+    const char* jit_profile_path = NULL;
+    cflags_add_string(flags, '\0', "jit-profile", &jit_profile_path, "Count runs, cycles and compiles per JIT block, and write them to this file as JSON on exit. Disables block linking.");
 #else
     bool interpreter = true;
 #endif
@@ -56,6 +76,12 @@ int main(int argc, char** argv) {
     bool software_mode = false;
     cflags_add_bool(flags, 's', "software-mode", &software_mode, "Use software mode RDP (UNFINISHED!)");
 
+    bool rsp_thread = false;
+    cflags_add_bool(flags, '\0', "rsp-thread", &rsp_thread, "Run the RSP on its own thread, waiting for it only when the CPU touches its state");
+
+    bool hle_audio = false;
+    cflags_add_bool(flags, '\0', "hle-audio", &hle_audio, "Run known audio microcode natively instead of on the RSP. Much faster, but less accurate");
+
     bool debug = false;
 #ifdef N64_DEBUG_MODE
 #ifndef N64_WIN
@@ -87,6 +113,29 @@ int main(int argc, char** argv) {
     }
     #endif
 
+    if (rsp_thread) {
+        rsp_set_threaded(true);
+    }
+
+    if (hle_audio) {
+        rsp_set_hle_audio(true);
+    }
+
+#ifdef N64_DYNAREC_ENABLED
+    if (async_jit) {
+        v2_set_async_compilation_enabled(true);
+    }
+    if (jit_cache) {
+        v2_set_persistent_cache_enabled(true);
+    }
+    if (superblocks) {
+        v2_set_superblocks_enabled(true);
+    }
+    if (jit_profile_path != NULL) {
+        dynarec_profiler_enable(jit_profile_path);
+    }
+#endif
+
     if (record_tas_movie && tas_movie_path == NULL) {
         usage(flags);
         logdie("Must specify tas movie path (with -m) when recording a tas movie.");
@@ -2,12 +2,17 @@
 
 // TODO: support as much of this as possible: https://github.com/skylersaleh/SkyEmu/blob/dev/docs/HTTP_CONTROL_SERVER.md
 
+#include <algorithm>
 #include <cstdlib>
 #include <format>
+#include <vector>
 
 extern "C" {
     #include <common/settings.h>
     #include <mem/n64bus.h>
+#ifdef N64_DYNAREC_ENABLED
+    #include <cpu/dynarec/dynarec_profiler.h>
+#endif
 }
 #include <debugger/debugger.hpp>
 
@@ -192,6 +197,53 @@ void http_api_init() {
         res.set_content(result.dump(), "application/json");
     });
 
+#ifdef N64_DYNAREC_ENABLED
+    // Hottest blocks first. ?limit=N returns only the first N.
+    svr.Get("/jit/profile", [&](const httplib::Request& req, httplib::Response& res) {
+        if (!dynarec_profiler_enabled()) {
+            HTTP_ERROR("The JIT profiler is not enabled, start with --jit-profile", BadRequest_400);
+        }
+        int limit = DYNAREC_PROFILER_MAX_BLOCKS;
+        if (req.has_param("limit")) {
+            try {
+                limit = std::clamp(std::stoi(req.get_param_value("limit")), 0, DYNAREC_PROFILER_MAX_BLOCKS);
+            } catch (std::exception&) {
+                HTTP_ERROR("Invalid limit", BadRequest_400);
+            }
+        }
+
+        std::vector<dynarec_block_profile_t> profiles(DYNAREC_PROFILER_MAX_BLOCKS);
+        int count = dynarec_profiler_snapshot(profiles.data(), DYNAREC_PROFILER_MAX_BLOCKS);
+
+        json result;
+        u64 total_cycles = 0;
+        json blocks = json::array({});
+        for (int i = 0; i < count; i++) {
+            const dynarec_block_profile_t& profile = profiles[i];
+            total_cycles += profile.cycles;
+            if (i >= limit) {
+                continue;
+            }
+            json block;
+            block["virtual_address"] = std::format("{:016X}", profile.virtual_address);
+            block["physical_address"] = std::format("{:08X}", profile.physical_address);
+            block["sysconfig"] = profile.sysconfig.raw;
+            block["executions"] = profile.executions;
+            block["cycles"] = profile.cycles;
+            block["host_size"] = profile.host_size;
+            block["guest_size"] = profile.guest_size;
+            block["compilations"] = profile.compilations;
+            block["compile_ns"] = profile.compile_ns;
+            block["invalidations"] = profile.invalidations;
+            block["superblock"] = profile.superblock;
+            blocks.push_back(block);
+        }
+        result["total_cycles"] = total_cycles;
+        result["blocks"] = blocks;
+        res.set_content(result.dump(), "application/json");
+    });
+#endif
+
     svr.Get("/control/quit", [&](const httplib::Request& req, httplib::Response& res) {
         n64sys.debugger_state.broken = false; // if we're paused, we need to unpause for the quit to work
         n64_request_quit();
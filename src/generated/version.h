@@ -1,5 +1,5 @@
 #ifndef N64_VERSION_H
 #define N64_VERSION_H
 #include <assert.h>
-#define N64_GIT_COMMIT_HASH ""
+#define N64_GIT_COMMIT_HASH "c74eb1384e23182e9008c3d83412e441a3e22b5a"
 #endif // N64_VERSION_H
@@ -193,6 +193,7 @@ void render_metrics_window() {
         ImPlot::PlotLine("RSP Steps", rsp_steps.data, METRICS_HISTORY_ITEMS, 1, 0, flags, rsp_steps.offset);
         ImPlot::EndPlot();
     }
+    ImGui::Text("Audio tasks run natively this frame: %" PRId64, get_metric(METRIC_RSP_HLE_TASK));
 
     ImGui::Text("Block compilations this frame: %" PRId64, get_metric(METRIC_BLOCK_COMPILATION));
     ImPlot::SetNextAxisLimits(ImAxis_Y1, 0, block_compilations.max(), ImGuiCond_Always);
@@ -201,6 +202,11 @@ void render_metrics_window() {
         ImPlot::PlotBars("Block compilations", block_compilations.data, METRICS_HISTORY_ITEMS, 1, 0, flags, block_compilations.offset);
         ImPlot::EndPlot();
     }
+    ImGui::Text("Blocks loaded from the JIT cache this frame: %" PRId64, get_metric(METRIC_BLOCK_PERSISTENT_CACHE_HIT));
+    ImGui::Text("Blocks invalidated by writes this frame: %" PRId64, get_metric(METRIC_BLOCK_INVALIDATION));
+    ImGui::Text("Invalidated blocks found unchanged this frame: %" PRId64, get_metric(METRIC_BLOCK_REVALIDATION));
+    ImGui::Text("Superblocks compiled this frame: %" PRId64, get_metric(METRIC_SUPERBLOCK_COMPILATION));
+    ImGui::Text("Links keeping guest registers in host registers this frame: %" PRId64, get_metric(METRIC_BLOCK_BOUND_LINK));
 
     ImGui::Text("Block sysconfig misses this frame: %" PRId64, get_metric(METRIC_BLOCK_SYSCONFIG_MISS));
     ImPlot::SetNextAxisLimits(ImAxis_Y1, 0, block_sysconfig_misses.max(), ImGuiCond_Always);
@@ -272,10 +278,10 @@ void render_dynarec_block_browser() {
         mips_block.clear();
         host_block.clear();
         for (int outer_index = 0; outer_index < BLOCKCACHE_OUTER_SIZE; outer_index++) {
-            if (n64dynarec.blockcache[outer_index]) {
-                n64_dynarec_block_t* block_list = n64dynarec.blockcache[outer_index];
+            if (get_dynarec_page(outer_index)) {
                 for (int inner_index = 0; inner_index < BLOCKCACHE_INNER_SIZE; inner_index++) {
-                    if (block_list[inner_index].run != nullptr) {
+                    n64_dynarec_block_t* b = get_dynarec_block(INDICES_TO_ADDRESS(outer_index, inner_index));
+                    if (b != nullptr && b->run != nullptr) {
                         u32 addr = INDICES_TO_ADDRESS(outer_index, inner_index);
                         if (addr == old_selected_block.address) {
                             old_selected_block_still_valid = true;
@@ -323,9 +329,8 @@ void render_dynarec_block_browser() {
     ImGui::SameLine();
 
     if (host_block.count(selected_block.address) == 0 || mips_block.count(selected_block.address) == 0) {
-        n64_dynarec_block_t* block_list = n64dynarec.blockcache[selected_block.outer_index];
-        if (block_list && block_list[selected_block.inner_index].host_size > 0) {
-            n64_dynarec_block_t* b = &block_list[selected_block.inner_index];
+        n64_dynarec_block_t* b = get_dynarec_block(INDICES_TO_ADDRESS(selected_block.outer_index, selected_block.inner_index));
+        if (b != nullptr && b->host_size > 0) {
             host_block[selected_block.address] = disassemble_multi(DisassemblyArch::HOST,  (uintptr_t)b->run, (u8*)b->run, b->host_size);
             bool valid_guest_addr = false;
             u8* guest_block_address;
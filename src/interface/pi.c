@@ -178,18 +178,10 @@ void write_word_pireg(u32 address, u32 value) {
                 u8 b = pi_dma_read_byte(cart_addr + i);
                 logtrace("CART to DRAM: Copying 0x%02X from 0x%08X to 0x%08X", b, cart_addr + i, dram_addr + i);
                 RDRAM_BYTE(dram_addr + i) = b;
-#ifdef N64_DYNAREC_ENABLED
-                invalidate_dynarec_page(BYTE_ADDRESS(dram_addr + i));
-#endif
             }
 
 #ifdef N64_DYNAREC_ENABLED
-            u32 begin_index = BLOCKCACHE_OUTER_INDEX(dram_addr);
-            u32 end_index = BLOCKCACHE_OUTER_INDEX(dram_addr + length);
-
-            for (u32 i = begin_index; i <= end_index; i++) {
-                invalidate_dynarec_page_by_index(i);
-            }
+            invalidate_dynarec_range(dram_addr, length);
 #endif
 
             int complete_in = timing_pi_access(pi_get_domain(cart_addr), length);
@@ -379,6 +379,7 @@ void n64_write_physical_dword(u32 address, u64 value) {
     logdebug("Writing 0x%016" PRIX64 " to [0x%08X]", value, address);
 #ifdef N64_DYNAREC_ENABLED
     invalidate_dynarec_page(address);
+    invalidate_dynarec_page(address + 4);
 #endif
     switch (address) {
         case REGION_RDRAM:
@@ -390,6 +391,7 @@ void n64_write_physical_dword(u32 address, u64 value) {
         case REGION_RDRAM_UNUSED:
             return;
         case REGION_SP_MEM: {
+            rsp_sync();
             value >>= 32; // TODO: this is probably wrong, it probably depends on the address.
             if (address & 0x1000) {
                 word_to_byte_array((u8*) &N64RSP.sp_imem, DWORD_ADDRESS(address & 0xFFF), value);
@@ -460,6 +462,7 @@ u64 n64_read_physical_dword(u32 address) {
         case REGION_RDRAM_REGS:
             logfatal("Reading dword from address 0x%08X in unsupported region: REGION_RDRAM_REGS", address);
         case REGION_SP_MEM:
+            rsp_sync();
             if (address & 0x1000) {
                 return dword_from_byte_array((u8*) &N64RSP.sp_imem, DWORD_ADDRESS(address & 0xFFF));
             } else {
@@ -521,6 +524,7 @@ void n64_write_physical_word(u32 address, u32 value) {
         case REGION_RDRAM_UNUSED:
             return;
         case REGION_SP_MEM:
+            rsp_sync();
             if (address & 0x1000) {
                 word_to_byte_array((u8*) &N64RSP.sp_imem, WORD_ADDRESS(address & 0xFFF), value);
                 invalidate_rsp_icache(WORD_ADDRESS(address));
@@ -529,9 +533,11 @@ void n64_write_physical_word(u32 address, u32 value) {
             }
             break;
         case REGION_SP_REGS:
+            rsp_sync();
             write_word_spreg(address, value);
             break;
         case REGION_DP_COMMAND_REGS:
+            rsp_sync();
             write_word_dpcreg(address, value);
             break;
         case REGION_DP_SPAN_REGS:
@@ -591,14 +597,17 @@ u32 n64_read_physical_word(u32 address) {
         case REGION_RDRAM_REGS:
             return read_word_rdramreg(address);
         case REGION_SP_MEM:
+            rsp_sync();
             if (address & 0x1000) {
                 return word_from_byte_array((u8*) &N64RSP.sp_imem, WORD_ADDRESS(address & 0xFFF));
             } else {
                 return be32toh(word_from_byte_array((u8*) &N64RSP.sp_dmem, address & 0xFFF));
             }
         case REGION_SP_REGS:
+            rsp_sync();
             return read_word_spreg(address);
         case REGION_DP_COMMAND_REGS:
+            rsp_sync();
             return read_word_dpcreg(address);
             logfatal("Reading word from address 0x%08X in unsupported region: REGION_DP_COMMAND_REGS", address);
         case REGION_DP_SPAN_REGS:
@@ -676,6 +685,7 @@ void n64_write_physical_half(u32 address, u32 value) {
         case REGION_RDRAM_UNUSED:
             return;
         case REGION_SP_MEM:
+            rsp_sync();
             value = bus_edge_case_half_pif_spmem(address, value);
             address &= ~3;
             if (address & 0x1000) {
@@ -749,6 +759,7 @@ u16 n64_read_physical_half(u32 address) {
         case REGION_RDRAM_REGS:
             logfatal("Reading u16 from address 0x%08X in unsupported region: REGION_RDRAM_REGS", address);
         case REGION_SP_MEM:
+            rsp_sync();
             if (address & 0x1000) {
                 return half_from_byte_array((u8*) &N64RSP.sp_imem, HALF_ADDRESS(address & 0xFFF));
             } else {
@@ -803,6 +814,7 @@ void n64_write_physical_byte(u32 address, u32 value) {
         case REGION_RDRAM_REGS:
             logfatal("Writing byte 0x%02X to address 0x%08X in unsupported region: REGION_RDRAM_REGS", value & 0xFF, address);
         case REGION_SP_MEM:
+            rsp_sync();
             value = value << (8 * (3 - (address & 3)));
             address = (address & 0xFFF) & ~3;
             if (address & 0x1000) {
@@ -863,6 +875,7 @@ u8 n64_read_physical_byte(u32 address) {
         case REGION_RDRAM_REGS:
             logfatal("Reading byte from address 0x%08X in unsupported region: REGION_RDRAM_REGS", address);
         case REGION_SP_MEM:
+            rsp_sync();
             if (address & 0x1000) {
                 return N64RSP.sp_imem[BYTE_ADDRESS(address) - SREGION_SP_IMEM];
             } else {
@@ -11,8 +11,12 @@
 #include <interface/vi.h>
 #include <interface/ai.h>
 #include <cpu/rsp.h>
+#include <cpu/rsp_vector_avx2.h>
 #ifdef N64_DYNAREC_ENABLED
 #include <cpu/dynarec/dynarec.h>
+#include <cpu/r4300i_decode_cache.h>
+#include <cpu/dynarec/v2/v2_persistent_cache.h>
+#include <cpu/dynarec/dynarec_profiler.h>
 #include <dynarec/rsp_dynarec.h>
 #endif
 #include <util.h>
@@ -53,6 +57,9 @@ void n64_load_rom(const char* rom_path) {
     gamedb_match(&n64sys);
     devices_init(n64sys.mem.save_type);
     init_savedata(&n64sys.mem, rom_path);
+#ifdef N64_DYNAREC_ENABLED
+    v2_persistent_cache_load(rom_path, &n64sys.mem.rom);
+#endif
     if (n64sys.rom_path != rom_path) {
         strcpy(n64sys.rom_path, rom_path);
     }
@@ -78,9 +85,11 @@ void init_n64system(const char* rom_path, bool enable_frontend, bool enable_debu
     logalways("Opened log for writing");
 #endif
 
+    rsp_sync();
     memset(&n64sys, 0x00, sizeof(n64_system_t));
     memset(&N64CPU, 0x00, sizeof(N64CPU));
     memset(&N64RSP, 0x00, sizeof(N64RSP));
+    rsp_vector_detect_avx2();
     init_mem(&n64sys.mem);
 
     n64sys.video_type = video_type;
@@ -111,6 +120,7 @@ void init_n64system(const char* rom_path, bool enable_frontend, bool enable_debu
 }
 
 void reset_n64system() {
+    rsp_sync();
     force_persist_backup();
     if (n64sys.mem.save_data != NULL) {
         free(n64sys.mem.save_data);
@@ -146,6 +156,7 @@ void reset_n64system() {
     N64CP0.status.raw = 0;
     N64CP0.status.bev = true;
     cp0_status_updated();
+    fcr31_updated();
     N64CP0.cause.raw  = 0xB000007C;
     N64CP0.EPC        = 0xFFFFFFFFFFFFFFFF;
     N64CP0.PRId       = 0x00000B22;
@@ -157,6 +168,9 @@ void reset_n64system() {
     memset(n64sys.mem.rdram, 0, N64_RDRAM_SIZE);
     memset(N64RSP.sp_dmem, 0, SP_DMEM_SIZE);
     memset(N64RSP.sp_imem, 0, SP_IMEM_SIZE);
+#ifdef N64_DYNAREC_V1_ENABLED
+    rsp_dynarec_rehash_imem(N64RSPDYNAREC);
+#endif
     memset(n64sys.mem.pif_ram, 0, PIF_RAM_SIZE);
 
     n64sys.vi.num_halflines = 262;
@@ -166,6 +180,7 @@ void reset_n64system() {
 #ifdef N64_DYNAREC_ENABLED
     invalidate_dynarec_all_pages();
 #endif
+    invalidate_decode_cache();
 
     scheduler_reset();
     scheduler_enqueue_relative((u64)n64sys.vi.cycles_per_halfline, SCHEDULER_VI_HALFLINE);
@@ -333,14 +348,15 @@ int n64_system_step(bool dynarec, int steps) {
         handle_scheduler_event(&event);
 
         ai_step(cpu_steps);
+        rsp_sync();
         if (!N64RSP.status.halt) {
             // 2 RSP steps per 3 CPU steps
             N64RSP.steps += (cpu_steps / 3) * 2;
             cpu_steps %= 3;
 #ifdef N64_DYNAREC_V1_ENABLED
-            rsp_dynarec_run();
+            rsp_run_batch(rsp_dynarec_run);
 #else
-            rsp_run();
+            rsp_run_batch(rsp_run);
 #endif
         } else {
             N64RSP.steps = 0;
@@ -367,25 +383,26 @@ void jit_system_loop() {
     while (!should_quit) {
         static int cpu_steps = 0;
         while (true) {
-            int taken = jit_system_step();
-            cpu_steps += taken;
+            // Already advances the scheduler and COUNT
+            cpu_steps += n64_dynarec_run(scheduler_ticks_until_next_event());
             static scheduler_event_t event;
-            if (scheduler_tick(taken, &event)) {
+            if (scheduler_tick(0, &event)) {
                 handle_scheduler_event(&event);
                 break;
             }
         }
 
         ai_step(cpu_steps);
+        rsp_sync();
         if (!N64RSP.status.halt) {
             // 2 RSP steps per 3 CPU steps
             N64RSP.steps += (cpu_steps / 3) * 2;
             cpu_steps %= 3;
 
 #ifdef N64_DYNAREC_V1_ENABLED
-            rsp_dynarec_run();
+            rsp_run_batch(rsp_dynarec_run);
 #else
-            rsp_run();
+            rsp_run_batch(rsp_run);
 #endif
         } else {
             N64RSP.steps = 0;
@@ -396,7 +413,12 @@ void jit_system_loop() {
 }
 #endif
 
+// Most instructions the interpreter runs before catching up the RSP and AI, if no scheduler event comes first
+#define INTERPRETER_MAX_RUN 64
+
 void interpreter_system_loop() {
+#if defined(N64_DEBUG_MODE) || defined(LOG_CPU_STATE)
+    // Breakpoints and CPU state logging need to see every instruction
     while (!should_quit) {
         interpreter_system_step();
         ai_step(1);
@@ -405,6 +427,32 @@ void interpreter_system_loop() {
             handle_scheduler_event(&event);
         }
     }
+#else
+    static int cpu_steps = 0;
+    while (!should_quit) {
+        // Advances the scheduler itself, and stops as soon as an event is due
+        int taken = r4300i_run(INTERPRETER_MAX_RUN);
+        cpu_steps += taken;
+
+        rsp_sync();
+        if (N64RSP.status.halt) {
+            cpu_steps = 0;
+            N64RSP.steps = 0;
+        } else {
+            // 2 RSP steps per 3 CPU steps
+            N64RSP.steps += (cpu_steps / 3) * 2;
+            cpu_steps %= 3;
+
+            rsp_run_batch(rsp_run);
+        }
+
+        ai_step(taken);
+        static scheduler_event_t event;
+        if (scheduler_tick(0, &event)) {
+            handle_scheduler_event(&event);
+        }
+    }
+#endif
 }
 
 void n64_system_loop() {
@@ -420,10 +468,16 @@ void n64_system_loop() {
 }
 
 void n64_system_cleanup() {
+    rsp_sync();
 #ifndef N64_WIN
     debugger_cleanup();
 #endif
 
+#ifdef N64_DYNAREC_ENABLED
+    v2_persistent_cache_save();
+    dynarec_profiler_dump();
+#endif
+
     free(n64sys.mem.rom.rom);
     n64sys.mem.rom.rom = NULL;
 
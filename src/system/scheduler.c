@@ -1,6 +1,9 @@
 #include <stdlib.h>
 #include <log.h>
 #include "scheduler.h"
+#ifdef N64_DYNAREC_ENABLED
+#include <cpu/dynarec/dynarec.h>
+#endif
 
 scheduler_t n64scheduler;
 
@@ -47,6 +50,10 @@ void scheduler_enqueue_absolute(u64 at_ticks, scheduler_event_type_t event_type)
     ins->event.type = event_type;
     ins->event.time = at_ticks;
 
+#ifdef N64_DYNAREC_ENABLED
+    n64_dynarec_stop_run();
+#endif
+
     // special case when list is empty
     if (n64scheduler.scheduler_list == NULL) {
         n64scheduler.scheduler_list = ins;
@@ -35,6 +35,16 @@ typedef struct scheduler {
 
 extern scheduler_t n64scheduler;
 
+// Advance time without checking for events. Follow up with scheduler_tick(0, ...) to pop the event that's due, if any.
+INLINE void scheduler_advance(u64 ticks) {
+    n64scheduler.scheduler_ticks += ticks;
+}
+
+// Whether scheduler_tick(0, ...) would pop an event right now
+INLINE bool scheduler_event_due() {
+    return n64scheduler.scheduler_list != NULL && n64scheduler.scheduler_list->event.time < n64scheduler.scheduler_ticks;
+}
+
 void scheduler_reset();
 bool scheduler_tick(u64 cycles, scheduler_event_t* event);
 u64 scheduler_remove_event(scheduler_event_type_t event_type);
@@ -255,8 +255,10 @@ void run_compare_parent() {
     bool cached;
     bool resolved = resolve_virtual_address(start_pc, BUS_LOAD, &cached, &physical);
     if (resolved) {
-         block = &n64dynarec.blockcache[BLOCKCACHE_OUTER_INDEX(physical)][BLOCKCACHE_INNER_INDEX(physical)];
-        if (physical >= N64_RDRAM_SIZE) {
+         block = get_dynarec_block(physical);
+        if (block == NULL) {
+            printf("no block compiled at this address\n");
+        } else if (physical >= N64_RDRAM_SIZE) {
             printf("outside of RDAM, can't disassemble (TODO)\n");
         } else {
             print_multi_guest(start_pc, &n64sys.mem.rdram[physical], block->guest_size);
@@ -272,10 +274,10 @@ void run_compare_parent() {
         printf("Unavailable, a new block has been compiled in the meantime.\n");
     }
     printf("Host code:\n");
-    if (resolved) {
+    if (block != NULL) {
         print_multi_host((uintptr_t)block->run, (u8*)block->run, block->host_size);
     } else {
-        printf("TLB miss PC, host code unavailable\n");
+        printf("TLB miss PC or no block, host code unavailable\n");
     }
     print_state();
 }
@@ -0,0 +1,26 @@
+arch n64.cpu
+endian msb
+
+include "regs.inc"
+
+origin $00000000
+base $80000000
+
+//; Converts 2.5 to a word three times in what used to be one block: in round to nearest, after switching to round towards
+//; +infinity, and after switching back. Float ops are compiled for the rounding mode the block is entered with, so each
+//; write to FCR31 has to end the block for the conversions after it to round the right way.
+lui t0, 0x4020
+mtc1 t0, 0
+cfc1 t2, 31
+cvt.w.s 2, 0
+ori t1, t2, 2
+ctc1 t1, 31
+cvt.w.s 4, 0
+ctc1 t2, 31
+cvt.w.s 6, 0
+mfc1 a0, 2
+mfc1 a1, 4
+mfc1 a2, 6
+end:
+j end
+nop
@@ -59,7 +59,32 @@ void test_branch_likely(bool jit) {
     logalways("[PASSED ] Branch likely test with %s", jit ? "dynarec" : "interpreter");
 }
 
+void test_rounding_mode_change(bool jit) {
+    logalways("[RUNNING] Rounding mode change test with %s", jit ? "dynarec" : "interpreter");
+    init_n64system(NULL, false, false, UNKNOWN_VIDEO_TYPE, false);
+    set_pc_word_r4300i(0x80000000);
+    N64CP0.status.cu1 = true;
+    cp0_status_updated();
+    N64CPU.fcr31.raw = 0;
+    fcr31_updated();
+
+    load_code("dynarec_v2_tests/rounding_mode_change.bin");
+
+    // The code ends in a loop at 0x80000030
+    for (int i = 0; i < 100 && N64CPU.pc != 0xFFFFFFFF80000030ULL; i++) {
+        n64_system_step(jit, 1);
+    }
+    assert_eq_u64("pc", 0xFFFFFFFF80000030ULL, N64CPU.pc);
+
+    assert_reg_value((u64)2, MIPS_REG_A0); // round to nearest, ties to even
+    assert_reg_value((u64)3, MIPS_REG_A1); // round towards +infinity
+    assert_reg_value((u64)2, MIPS_REG_A2); // back to round to nearest
+    logalways("[PASSED ] Rounding mode change test with %s", jit ? "dynarec" : "interpreter");
+}
+
 int main(int argc, char** argv) {
     test_branch_likely(false);
     test_branch_likely(true);
+    test_rounding_mode_change(false);
+    test_rounding_mode_change(true);
 }
\ No newline at end of file
@@ -0,0 +1,208 @@
+#include <string.h>
+#include <system/n64system.h>
+#include <cpu/rsp.h>
+#include <cpu/rsp_vector_instructions.h>
+#include <cpu/dynarec/rsp_dynarec.h>
+#include <mem/mem_util.h>
+
+// The RSP dynarec emits these instructions inline instead of calling the interpreter handlers, so run both with the
+// same random operands, accumulators, flags and elements, and check they end up in the same state.
+
+typedef struct vector_instruction {
+    const char* name;
+    u8 funct;
+    void (*handler)(mips_instruction_t);
+} vector_instruction_t;
+
+const vector_instruction_t vector_instructions[] = {
+        {"vand",  FUNCT_RSP_VEC_VAND,  rsp_vec_vand},
+        {"vnand", FUNCT_RSP_VEC_VNAND, rsp_vec_vnand},
+        {"vor",   FUNCT_RSP_VEC_VOR,   rsp_vec_vor},
+        {"vnor",  FUNCT_RSP_VEC_VNOR,  rsp_vec_vnor},
+        {"vxor",  FUNCT_RSP_VEC_VXOR,  rsp_vec_vxor},
+        {"vnxor", FUNCT_RSP_VEC_VNXOR, rsp_vec_vnxor},
+        {"vmudh", FUNCT_RSP_VEC_VMUDH, rsp_vec_vmudh},
+        {"vmadh", FUNCT_RSP_VEC_VMADH, rsp_vec_vmadh},
+        {"vmudm", FUNCT_RSP_VEC_VMUDM, rsp_vec_vmudm},
+        {"vmadm", FUNCT_RSP_VEC_VMADM, rsp_vec_vmadm},
+        {"vmudn", FUNCT_RSP_VEC_VMUDN, rsp_vec_vmudn},
+        {"vmadn", FUNCT_RSP_VEC_VMADN, rsp_vec_vmadn},
+        {"vmudl", FUNCT_RSP_VEC_VMUDL, rsp_vec_vmudl},
+        {"vmadl", FUNCT_RSP_VEC_VMADL, rsp_vec_vmadl},
+        {"vch",   FUNCT_RSP_VEC_VCH,   rsp_vec_vch},
+        {"vcl",   FUNCT_RSP_VEC_VCL,   rsp_vec_vcl},
+        {"vrcp",  FUNCT_RSP_VEC_VRCP,  rsp_vec_vrcp},
+};
+
+#define NUM_VECTOR_INSTRUCTIONS (sizeof(vector_instructions) / sizeof(vector_instruction_t))
+#define DIFFERENTIAL_ITERATIONS 20000
+#define RSP_BREAK 0x0000000D
+
+u64 random_state = 0x9E3779B97F4A7C15;
+
+u16 random_element() {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    // Lean towards the values around the clamping and carry boundaries
+    const u16 edges[] = {0x0000, 0x0001, 0x7FFF, 0x8000, 0x8001, 0xFFFF};
+    if ((random_state >> 60) < 4) {
+        return edges[(random_state >> 32) % 6];
+    }
+    return random_state >> 16;
+}
+
+void randomize(vu_reg_t* reg) {
+    for (int i = 0; i < 8; i++) {
+        reg->elements[i] = random_element();
+    }
+}
+
+// Flags are always all ones or all zeroes, see FLAGREG_BOOL
+void randomize_flags(vu_reg_t* reg) {
+    for (int i = 0; i < 8; i++) {
+        reg->elements[i] = FLAGREG_BOOL(random_element() & 1);
+    }
+}
+
+typedef struct vector_state {
+    vu_reg_t regs[4];
+    vu_reg_t acch;
+    vu_reg_t accm;
+    vu_reg_t accl;
+    vu_reg_t vcc_l;
+    vu_reg_t vcc_h;
+    vu_reg_t vco_l;
+    vu_reg_t vco_h;
+    vu_reg_t vce;
+    s16 divout;
+    bool divin_loaded;
+} vector_state_t;
+
+void load_state(const vector_state_t* state) {
+    memcpy(&N64RSP.vu_regs[0], state->regs, sizeof(state->regs));
+    N64RSP.acc.h = state->acch;
+    N64RSP.acc.m = state->accm;
+    N64RSP.acc.l = state->accl;
+    N64RSP.vcc.l = state->vcc_l;
+    N64RSP.vcc.h = state->vcc_h;
+    N64RSP.vco.l = state->vco_l;
+    N64RSP.vco.h = state->vco_h;
+    N64RSP.vce = state->vce;
+    N64RSP.divout = state->divout;
+    N64RSP.divin_loaded = state->divin_loaded;
+}
+
+void save_state(vector_state_t* state) {
+    memset(state, 0, sizeof(vector_state_t)); // so the padding compares equal
+    memcpy(state->regs, &N64RSP.vu_regs[0], sizeof(state->regs));
+    state->acch = N64RSP.acc.h;
+    state->accm = N64RSP.acc.m;
+    state->accl = N64RSP.acc.l;
+    state->vcc_l = N64RSP.vcc.l;
+    state->vcc_h = N64RSP.vcc.h;
+    state->vco_l = N64RSP.vco.l;
+    state->vco_h = N64RSP.vco.h;
+    state->vce = N64RSP.vce;
+    state->divout = N64RSP.divout;
+    state->divin_loaded = N64RSP.divin_loaded;
+}
+
+// Compiles a block of just this instruction and a break, and runs it
+void run_compiled(mips_instruction_t instr) {
+    word_to_byte_array(N64RSP.sp_imem, 0, instr.raw);
+    word_to_byte_array(N64RSP.sp_imem, 4, RSP_BREAK);
+    reset_rsp_dynarec_code_overlays(N64RSPDYNAREC);
+    rsp_dynarec_rehash_imem(N64RSPDYNAREC);
+
+    N64RSP.pc = 0;
+    N64RSP.status.halt = false;
+    rsp_dynarec_step();
+    if (!N64RSP.status.halt) {
+        logfatal("The compiled block didn't reach the break");
+    }
+}
+
+void print_vureg_diff(const char* name, const vu_reg_t* expected, const vu_reg_t* actual) {
+    printf("%-6s expected: ", name);
+    for (int i = 0; i < 8; i++) {
+        printf("%04X ", expected->elements[i]);
+    }
+    printf("\n%-6s actual:   ", name);
+    for (int i = 0; i < 8; i++) {
+        if (expected->elements[i] != actual->elements[i]) {
+            printf(COLOR_RED "%04X " COLOR_END, actual->elements[i]);
+        } else {
+            printf("%04X ", actual->elements[i]);
+        }
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv) {
+    init_n64system(NULL, false, false, UNKNOWN_VIDEO_TYPE, false);
+
+    bool failed = false;
+    for (int i = 0; i < DIFFERENTIAL_ITERATIONS && !failed; i++) {
+        const vector_instruction_t* instruction = &vector_instructions[i % NUM_VECTOR_INSTRUCTIONS];
+
+        vector_state_t initial;
+        memset(&initial, 0, sizeof(vector_state_t));
+        for (int reg = 0; reg < 4; reg++) {
+            randomize(&initial.regs[reg]);
+        }
+        randomize(&initial.acch);
+        randomize(&initial.accm);
+        randomize(&initial.accl);
+        randomize_flags(&initial.vcc_l);
+        randomize_flags(&initial.vcc_h);
+        randomize_flags(&initial.vco_l);
+        randomize_flags(&initial.vco_h);
+        randomize_flags(&initial.vce);
+        initial.divout = random_element();
+        initial.divin_loaded = random_element() & 1;
+
+        // vd can be the same register as vs or vt
+        mips_instruction_t instr;
+        instr.raw = 0;
+        instr.cp2_vec.op = OPC_CP2;
+        instr.cp2_vec.is_vec = 1;
+        instr.cp2_vec.funct = instruction->funct;
+        instr.cp2_vec.vs = random_element() & 3;
+        instr.cp2_vec.vt = random_element() & 3;
+        instr.cp2_vec.vd = random_element() & 3;
+        instr.cp2_vec.e  = random_element() & 15;
+
+        vector_state_t expected, actual;
+        load_state(&initial);
+        instruction->handler(instr);
+        save_state(&expected);
+
+        load_state(&initial);
+        run_compiled(instr);
+        save_state(&actual);
+
+        if (memcmp(&expected, &actual, sizeof(vector_state_t)) != 0) {
+            printf("%s vd=%d vs=%d vt=%d e=%d\n", instruction->name, instr.cp2_vec.vd, instr.cp2_vec.vs, instr.cp2_vec.vt, instr.cp2_vec.e);
+            const char* reg_names[] = {"v0", "v1", "v2", "v3"};
+            for (int reg = 0; reg < 4; reg++) {
+                print_vureg_diff(reg_names[reg], &expected.regs[reg], &actual.regs[reg]);
+            }
+            print_vureg_diff("acc.h", &expected.acch, &actual.acch);
+            print_vureg_diff("acc.m", &expected.accm, &actual.accm);
+            print_vureg_diff("acc.l", &expected.accl, &actual.accl);
+            print_vureg_diff("vcc.l", &expected.vcc_l, &actual.vcc_l);
+            print_vureg_diff("vcc.h", &expected.vcc_h, &actual.vcc_h);
+            print_vureg_diff("vco.l", &expected.vco_l, &actual.vco_l);
+            print_vureg_diff("vco.h", &expected.vco_h, &actual.vco_h);
+            print_vureg_diff("vce", &expected.vce, &actual.vce);
+            printf("divout expected: %04X actual: %04X\n", (u16)expected.divout, (u16)actual.divout);
+            failed = true;
+        }
+    }
+
+    if (!failed) {
+        printf("Compiled code matched the interpreter for %d random vector instructions\n", DIFFERENTIAL_ITERATIONS);
+    }
+    return failed;
+}
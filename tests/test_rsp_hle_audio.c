@@ -0,0 +1,102 @@
+#include <string.h>
+#include <system/n64system.h>
+#include <mem/n64bus.h>
+#include <cpu/rsp.h>
+#include <cpu/rsp_hle.h>
+#include <cpu/rsp_interface.h>
+
+// Runs a small ABI1 audio task the way a game starts one: the OSTask is DMAed into DMEM, then the RSP is started through
+// SP_STATUS, and the output is read back from RDRAM.
+
+#define TASK_ADDRESS       0x100000
+#define UCODE_DATA_ADDRESS 0x110000
+#define LIST_ADDRESS       0x120000
+#define SAMPLES_ADDRESS    0x200000
+#define OUTPUT_OFFSET      0x1000
+
+#define NUM_SAMPLES 16
+
+// Where ABI1's buffer addresses are relative to
+#define ABI1_DMEM_BASE 0x5C0
+#define DMEM_OUTPUT (0x04000000 + ABI1_DMEM_BASE + 0x100)
+
+#define SP_CLEAR_HALT 0x1
+
+const s16 input_samples[NUM_SAMPLES] = {
+        0x0000, 0x0001, 0x0002, -3, 0x1234, -0x1234, 0x7000, -0x7000,
+        0x7FFF, -0x8000, 0x0100, -0x0100, 0x5555, 0x2AAA, -1, 0x4000
+};
+
+void write_words(u32 address, const u32* words, int count) {
+    for (int i = 0; i < count; i++) {
+        n64_write_physical_word(address + i * 4, words[i]);
+    }
+}
+
+// What the MIXER below does to each sample, with a gain of 0.5: out = clamp(out + in / 2)
+s16 expected_sample(s16 sample) {
+    s32 mixed = sample + ((sample * 0x4000) >> 15);
+    if (mixed > 32767) return 32767;
+    if (mixed < -32768) return -32768;
+    return mixed;
+}
+
+int main(int argc, char** argv) {
+    init_n64system(NULL, false, false, UNKNOWN_VIDEO_TYPE, false);
+    rsp_set_hle_audio(true);
+
+    // Enough of ABI1's data segment to identify it
+    n64_write_physical_word(UCODE_DATA_ADDRESS + 0x00, 0x00000001);
+    n64_write_physical_word(UCODE_DATA_ADDRESS + 0x28, 0x1E24138C);
+    n64_write_physical_word(UCODE_DATA_ADDRESS + 0x30, 0xF0000F00);
+
+    for (int i = 0; i < NUM_SAMPLES; i++) {
+        n64_write_physical_half(SAMPLES_ADDRESS + i * 2, (u16)input_samples[i]);
+    }
+
+    const u32 list[] = {
+            0x07000000, 0x01000000 | SAMPLES_ADDRESS,    // SEGMENT 1 = the samples
+            0x08000000, 0x01000000 | NUM_SAMPLES * 2,    // SETBUFF in = 0x000, out = 0x100
+            0x04000000, 0x01000000,                      // LOADBUFF in <- samples
+            0x0A000000, 0x01000000 | NUM_SAMPLES * 2,    // DMEMMOVE 0x100 <- 0x000
+            0x0C004000, 0x00000100,                      // MIXER 0x100 += 0x000 * 0.5
+            0x06000000, 0x01000000 | OUTPUT_OFFSET,      // SAVEBUFF out -> samples + OUTPUT_OFFSET
+    };
+    write_words(LIST_ADDRESS, list, sizeof(list) / sizeof(u32));
+
+    u32 task[16];
+    memset(task, 0, sizeof(task));
+    task[0x00 / 4] = 2; // M_AUDTASK
+    task[0x18 / 4] = UCODE_DATA_ADDRESS;
+    task[0x30 / 4] = LIST_ADDRESS;
+    task[0x34 / 4] = sizeof(list);
+    write_words(TASK_ADDRESS, task, 16);
+
+    n64_write_physical_word(ADDR_SP_MEM_ADDR_REG, 0xFC0);
+    n64_write_physical_word(ADDR_SP_DRAM_ADDR_REG, TASK_ADDRESS);
+    n64_write_physical_word(ADDR_SP_RD_LEN_REG, sizeof(task) - 1);
+
+    n64_write_physical_word(ADDR_SP_STATUS_REG, SP_CLEAR_HALT);
+
+    bool failed = false;
+    if (!N64RSP.status.halt || !N64RSP.status.broke || !N64RSP.status.signal_2) {
+        printf("The task wasn't run natively\n");
+        failed = true;
+    }
+
+    // The output has to be right both in RDRAM, and in DMEM as the CPU sees it
+    for (int i = 0; i < NUM_SAMPLES; i++) {
+        s16 expected = expected_sample(input_samples[i]);
+        s16 actual = n64_read_physical_half(SAMPLES_ADDRESS + OUTPUT_OFFSET + i * 2);
+        s16 actual_dmem = n64_read_physical_half(DMEM_OUTPUT + i * 2);
+        if (actual != expected || actual_dmem != expected) {
+            printf("Sample %d: expected %04X, got %04X in RDRAM and %04X in DMEM\n", i, (u16)expected, (u16)actual, (u16)actual_dmem);
+            failed = true;
+        }
+    }
+
+    if (!failed) {
+        printf("Passed!\n");
+    }
+    return failed;
+}
@@ -2,6 +2,7 @@
 #include <system/n64system.h>
 #include <cpu/rsp.h>
 #include <cpu/rsp_vector_instructions.h>
+#include <cpu/rsp_vector_avx2.h>
 
 bool print_vureg_comparing_ln(vu_reg_t* reg, const u16* compare) {
     bool failed = false;
@@ -25,9 +26,127 @@ bool print_vureg_comparing_ln(vu_reg_t* reg, const u16* compare) {
     return failed;
 }
 
-int main(int argc, char** argv) {
-    init_n64system(NULL, false, false, UNKNOWN_VIDEO_TYPE, false);
+typedef struct multiply_instruction {
+    const char* name;
+    void (*handler)(mips_instruction_t);
+} multiply_instruction_t;
+
+const multiply_instruction_t multiply_instructions[] = {
+        {"vmacf", rsp_vec_vmacf},
+        {"vmacu", rsp_vec_vmacu},
+        {"vmadh", rsp_vec_vmadh},
+        {"vmadl", rsp_vec_vmadl},
+        {"vmadm", rsp_vec_vmadm},
+        {"vmadn", rsp_vec_vmadn},
+        {"vmudh", rsp_vec_vmudh},
+        {"vmudl", rsp_vec_vmudl},
+        {"vmudm", rsp_vec_vmudm},
+        {"vmudn", rsp_vec_vmudn},
+        {"vmulf", rsp_vec_vmulf},
+        {"vmulu", rsp_vec_vmulu},
+};
+
+#define NUM_MULTIPLY_INSTRUCTIONS (sizeof(multiply_instructions) / sizeof(multiply_instruction_t))
+#define DIFFERENTIAL_ITERATIONS 200000
+
+u64 random_state = 0x9E3779B97F4A7C15;
+
+u16 random_element() {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    // Lean towards the values around the clamping and carry boundaries
+    const u16 edges[] = {0x0000, 0x0001, 0x7FFF, 0x8000, 0x8001, 0xFFFF};
+    if ((random_state >> 60) < 4) {
+        return edges[(random_state >> 32) % 6];
+    }
+    return random_state >> 16;
+}
+
+void randomize(vu_reg_t* reg) {
+    for (int i = 0; i < 8; i++) {
+        reg->elements[i] = random_element();
+    }
+}
+
+typedef struct multiply_state {
+    vu_reg_t regs[4];
+    vu_reg_t acch;
+    vu_reg_t accm;
+    vu_reg_t accl;
+} multiply_state_t;
+
+void run_multiply(const multiply_instruction_t* instruction, mips_instruction_t instr, const multiply_state_t* initial, multiply_state_t* result) {
+    memcpy(&N64RSP.vu_regs[0], initial->regs, sizeof(initial->regs));
+    N64RSP.acc.h = initial->acch;
+    N64RSP.acc.m = initial->accm;
+    N64RSP.acc.l = initial->accl;
+
+    instruction->handler(instr);
+
+    memcpy(result->regs, &N64RSP.vu_regs[0], sizeof(result->regs));
+    result->acch = N64RSP.acc.h;
+    result->accm = N64RSP.acc.m;
+    result->accl = N64RSP.acc.l;
+}
+
+// Runs the AVX2 versions of the multiply instructions against the scalar (or SSE) ones, with random operands,
+// accumulators and elements
+bool differential_test() {
+    if (!rsp_vector_avx2) {
+        printf("AVX2 isn't supported here, skipping the differential test\n");
+        return false;
+    }
+
+    bool failed = false;
+    for (int i = 0; i < DIFFERENTIAL_ITERATIONS && !failed; i++) {
+        const multiply_instruction_t* instruction = &multiply_instructions[i % NUM_MULTIPLY_INSTRUCTIONS];
+
+        multiply_state_t initial;
+        for (int reg = 0; reg < 4; reg++) {
+            randomize(&initial.regs[reg]);
+        }
+        randomize(&initial.acch);
+        randomize(&initial.accm);
+        randomize(&initial.accl);
+
+        // vd can be the same register as vs or vt
+        mips_instruction_t instr;
+        instr.raw = 0;
+        instr.cp2_vec.vs = random_element() & 3;
+        instr.cp2_vec.vt = random_element() & 3;
+        instr.cp2_vec.vd = random_element() & 3;
+        instr.cp2_vec.e  = random_element() & 15;
+
+        multiply_state_t expected, actual;
+        rsp_vector_avx2 = false;
+        run_multiply(instruction, instr, &initial, &expected);
+        rsp_vector_avx2 = true;
+        run_multiply(instruction, instr, &initial, &actual);
+
+        if (memcmp(&expected, &actual, sizeof(multiply_state_t)) != 0) {
+            printf("%s vd=%d vs=%d vt=%d e=%d\n", instruction->name, instr.cp2_vec.vd, instr.cp2_vec.vs, instr.cp2_vec.vt, instr.cp2_vec.e);
+            for (int reg = 0; reg < 4; reg++) {
+                printf("v%d\n", reg);
+                print_vureg_comparing_ln(&actual.regs[reg], expected.regs[reg].elements);
+            }
+            printf("acc.h\n");
+            print_vureg_comparing_ln(&actual.acch, expected.acch.elements);
+            printf("acc.m\n");
+            print_vureg_comparing_ln(&actual.accm, expected.accm.elements);
+            printf("acc.l\n");
+            print_vureg_comparing_ln(&actual.accl, expected.accl.elements);
+            failed = true;
+        }
+    }
+
+    if (!failed) {
+        printf("AVX2 matched for %d random multiplies\n", DIFFERENTIAL_ITERATIONS);
+    }
+    return failed;
+}
 
+bool vmadm_overflow_test() {
     u16 initial_acch[] = {0x7FFF, 0x7FFF, 0x7FFF, 0x7FFF, 0x7FFF, 0x7FFF, 0x7FFF, 0x7FFF };
     u16 initial_accm[] = {0xF060, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF };
     u16 initial_accl[] = {0x7E67, 0xFFFC, 0xFFFC, 0xFFFC, 0xFFFC, 0xFFFC, 0xFFFC, 0xFFFC };
@@ -67,9 +186,29 @@ int main(int argc, char** argv) {
     printf("acc.l\n");
     failed |= print_vureg_comparing_ln(&N64RSP.acc.l, expected_accl);
 
+    return failed;
+}
+
+int main(int argc, char** argv) {
+    init_n64system(NULL, false, false, UNKNOWN_VIDEO_TYPE, false);
+
+    bool failed = false;
+    bool avx2 = rsp_vector_avx2;
+
+    rsp_vector_avx2 = false;
+    failed |= vmadm_overflow_test();
+    if (avx2) {
+        rsp_vector_avx2 = true;
+        failed |= vmadm_overflow_test();
+    }
+
     if (failed) {
         //logfatal("Tests failed!");
     } else {
         printf("Passed!\n");
     }
+
+    // Unlike the case above, this one has to pass
+    rsp_vector_avx2 = avx2;
+    return differential_test();
 }